@@ -1,20 +1,235 @@
 #include "globals.hpp"
 #include "mlp_sgd.cpp"
 
-std::vector<Node *> all_nodes;
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+
+std::vector<GraphNode *> all_nodes;
+
+Arena node_arena;
+
+Tape *capturing_tape = nullptr;
+
+Arena::Arena(std::size_t block_size) : block_size(block_size), current(0), offset(0)
+{
+}
+
+// The objects left in the arena are not destroyed at exit: their matrices come from the memory
+// pool, which may already be gone by then.
+Arena::~Arena()
+{
+    for (Block &block : blocks)
+    {
+        std::free(block.data);
+    }
+}
+
+// Moves to the next block when the current one is full: the blocks of the previous steps first,
+// then a new block (larger than block_size for a larger request).
+void *Arena::allocate(std::size_t bytes, std::size_t alignment)
+{
+    for (;; ++current, offset = 0)
+    {
+        if (current == blocks.size())
+        {
+            std::size_t size = std::max(block_size, bytes + alignment);
+            void *data = std::malloc(size);
+            if (data == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            blocks.push_back({static_cast<unsigned char *>(data), size});
+        }
+        std::uintptr_t base = reinterpret_cast<std::uintptr_t>(blocks[current].data);
+        std::size_t start = (base + offset + alignment - 1) / alignment * alignment - base;
+        if (start + bytes <= blocks[current].size)
+        {
+            offset = start + bytes;
+            return blocks[current].data + start;
+        }
+    }
+}
+
+void Arena::reset()
+{
+    for (auto it = destructors.rbegin(); it != destructors.rend(); ++it)
+    {
+        it->destroy(it->object);
+    }
+    destructors.clear();
+    current = 0;
+    offset = 0;
+}
+
+std::size_t Arena::bytesUsed() const
+{
+    std::size_t used = offset;
+    for (std::size_t b = 0; b < current && b < blocks.size(); ++b)
+    {
+        used += blocks[b].size;
+    }
+    return used;
+}
+
+std::size_t Arena::capacity() const
+{
+    std::size_t total = 0;
+    for (const Block &block : blocks)
+    {
+        total += block.size;
+    }
+    return total;
+}
+
+void Arena::swap(Arena &other)
+{
+    std::swap(block_size, other.block_size);
+    blocks.swap(other.blocks);
+    std::swap(current, other.current);
+    std::swap(offset, other.offset);
+    destructors.swap(other.destructors);
+}
+
+// Reverse topological sweep with reference counts: a first pass counts the consumers of every
+// node reachable from this one (one per use, so `x * x` counts twice), then a node is ready
+// once all of them have run their backward step. The stacks are kept from one pass to the next.
+// The stack is per thread and the stamps of the passes are unique across threads (atomic), so
+// that threads may each run the backward pass of their own graph, even through nodes another
+// thread reached before; the nodes of one graph must not be reached by two threads at once.
+void GraphNode::backward()
+{
+    static std::atomic<unsigned> passes(0);
+    const unsigned pass = passes.fetch_add(1, std::memory_order_relaxed) + 1;
+    thread_local std::vector<GraphNode *> stack;
+    stack.clear();
+    stack.push_back(this);
+    backward_pass = pass;
+    pending_consumers = 0;
+    while (!stack.empty())
+    {
+        GraphNode *node = stack.back();
+        stack.pop_back();
+        for (int k = 0; k < node->numDependencies(); ++k)
+        {
+            GraphNode *dep = node->dependency(k);
+            if (dep->backward_pass != pass)
+            {
+                dep->backward_pass = pass;
+                dep->pending_consumers = 0;
+                stack.push_back(dep);
+            }
+            ++dep->pending_consumers;
+        }
+    }
+
+    stack.push_back(this);
+    while (!stack.empty())
+    {
+        GraphNode *node = stack.back();
+        stack.pop_back();
+        if (node->backward_op)
+        {
+            node->backward_op();
+        }
+        for (int k = 0; k < node->numDependencies(); ++k)
+        {
+            GraphNode *dep = node->dependency(k);
+            if (--dep->pending_consumers == 0)
+            {
+                stack.push_back(dep);
+            }
+        }
+    }
+}
 
 // Function to push a Node* into the vector (initializing if nullptr)
-void push_node(Node *node)
+void push_node(GraphNode *node)
 {
     all_nodes.push_back(node);
 }
 
-// Function to clear the vector and free allocated memory
+// The nodes are destroyed by the arena, with everything else of the step.
 void clear_nodes()
 {
-    for (Node *node : all_nodes)
+    all_nodes.clear();
+    node_arena.reset();
+}
+
+Tape::Tape() : first_node(0)
+{
+}
+
+// A capture left unfinished (e.g. by an exception) is ended first, so that node_arena and
+// all_nodes get back what they had before it.
+Tape::~Tape()
+{
+    if (capturing_tape == this)
     {
-        delete node; // Free dynamically allocated memory
+        end();
     }
-    all_nodes.clear();
-}
\ No newline at end of file
+    arena.reset();
+}
+
+// During the capture, node_arena is the arena of the tape: the nodes, their matrices and their
+// closures are made there by the usual code, and stay there when node_arena is swapped back.
+void Tape::begin()
+{
+    if (capturing_tape != nullptr)
+    {
+        throw std::logic_error("A Tape is already capturing");
+    }
+    arena.reset();
+    nodes.clear();
+    forward_kernels.clear();
+    backward_kernels.clear();
+    node_arena.swap(arena);
+    capturing_tape = this;
+    first_node = all_nodes.size();
+}
+
+void Tape::end()
+{
+    if (capturing_tape != this)
+    {
+        throw std::logic_error("This Tape is not capturing");
+    }
+    nodes.assign(all_nodes.begin() + first_node, all_nodes.end());
+    all_nodes.resize(first_node);
+    node_arena.swap(arena);
+    capturing_tape = nullptr;
+    for (auto it = nodes.rbegin(); it != nodes.rend(); ++it)
+    {
+        if ((*it)->backward_op)
+        {
+            backward_kernels.push_back((*it)->backward_op);
+        }
+    }
+}
+
+void Tape::forward() const
+{
+    for (GraphNode *node : nodes)
+    {
+        node->zero_grad();
+    }
+    for (const ArenaFunction &kernel : forward_kernels)
+    {
+        kernel();
+    }
+}
+
+void Tape::backward() const
+{
+    for (const ArenaFunction &kernel : backward_kernels)
+    {
+        kernel();
+    }
+}
+
+void Tape::record(ArenaFunction kernel)
+{
+    forward_kernels.push_back(kernel);
+}
@@ -1,12 +1,207 @@
 #ifndef GLOBALS_H
 #define GLOBALS_H
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-class Node;
+// Bump allocator for the graph of one training step: an allocation moves a pointer forward in
+// the current block, and `reset` rewinds to the first block, so the memory of a step is given
+// back at once and the same blocks serve the next step (no malloc / free once they are there).
+// Objects made with `create` are destroyed by `reset`, in reverse order of creation, the other
+// allocations are just forgotten.
+class Arena
+{
+public:
+    explicit Arena(std::size_t block_size = std::size_t(1) << 20);
+    ~Arena();
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
 
-extern std::vector<Node *> all_nodes;
+    void *allocate(std::size_t bytes, std::size_t alignment = alignof(std::max_align_t));
 
-void push_node(Node *node);
+    template <class T, class... Args>
+    T *create(Args &&...args)
+    {
+        T *object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible<T>::value)
+        {
+            destructors.push_back({object, [](void *p) { static_cast<T *>(p)->~T(); }});
+        }
+        return object;
+    }
+
+    // Destroys the objects of `create`, then rewinds: O(1) besides those destructors.
+    void reset();
+
+    std::size_t bytesUsed() const;
+    std::size_t capacity() const;
+
+    // Exchanges the blocks and the objects of two arenas.
+    void swap(Arena &other);
+
+private:
+    struct Block
+    {
+        unsigned char *data;
+        std::size_t size;
+    };
+    struct Destructor
+    {
+        void *object;
+        void (*destroy)(void *);
+    };
+
+    std::size_t block_size;
+    std::vector<Block> blocks;
+    std::size_t current; // block being filled
+    std::size_t offset;  // first free byte of that block
+    std::vector<Destructor> destructors;
+};
+
+// Arena of the nodes of the current step: the nodes of the graph, their matrices (with the
+// shared_ptr control blocks) and their backward closures. Emptied by clear_nodes.
+extern Arena node_arena;
+
+// Standard allocator on top of node_arena (deallocate does nothing, reset frees everything),
+// e.g. for std::allocate_shared or the dependencies of a node.
+template <class T>
+struct ArenaAllocator
+{
+    typedef T value_type;
+
+    ArenaAllocator() noexcept {}
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U> &) noexcept {}
+
+    T *allocate(std::size_t n) { return static_cast<T *>(node_arena.allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *, std::size_t) noexcept {}
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T> &, const ArenaAllocator<U> &) { return true; }
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T> &, const ArenaAllocator<U> &) { return false; }
+
+// Callable moved into node_arena, called through a plain function pointer: copying it copies
+// two pointers and calling it is one indirect call, nothing is allocated (e.g. the backward
+// closures, or the kernels recorded by a Tape). Empty when default constructed.
+struct ArenaFunction
+{
+    void (*call)(void *) = nullptr;
+    void *object = nullptr;
+
+    explicit operator bool() const { return call != nullptr; }
+    void operator()() const { call(object); }
+};
+
+template <class F>
+ArenaFunction arena_function(F f)
+{
+    return ArenaFunction{[](void *object) { (*static_cast<F *>(object))(); }, node_arena.create<F>(std::move(f))};
+}
+
+// Base class of the nodes of every element type (BasicNode<T> in mlp_sgd.cpp), so that a
+// single list owns the nodes of the graph, whatever the precision they compute in.
+class GraphNode
+{
+public:
+    // Adds the gradient of this node to those of its dependencies (empty for the leaves).
+    ArenaFunction backward_op;
+
+    virtual ~GraphNode() {}
+
+    // Backward pass from this node: every node reachable through the dependencies runs its
+    // backward step exactly once, after all the nodes that use it have added their part to its
+    // gradient, so a node used several times (shared weights, reused activations) is not
+    // propagated again per path. Linear in the size of the graph, without recursion.
+    void backward();
+
+    // The nodes this node was computed from, which may be nodes of another kind (e.g. the
+    // shared weights of a BatchedNode, in mlp_sgd.cpp), once per use.
+    virtual int numDependencies() const = 0;
+    virtual GraphNode *dependency(int k) const = 0;
+    virtual void zero_grad() = 0;
+
+private:
+    // State of the last backward pass that reached this node: the number of its consumers that
+    // have not propagated their gradient yet.
+    unsigned backward_pass = 0;
+    int pending_consumers = 0;
+};
+
+// Tag of the constructors of the nodes that put their matrices in node_arena.
+struct InArena
+{
+};
+
+extern std::vector<GraphNode *> all_nodes;
+
+void push_node(GraphNode *node);
+// Ends the step: the nodes of the graph are destroyed and node_arena is reset. The matrices of
+// these nodes (values, grads) must not be used afterwards, copy them to keep them.
 void clear_nodes();
 
-#endif // GLOBALS_H
\ No newline at end of file
+// New node of the graph, in node_arena, and added to all_nodes: `make_node<Node>(m, n)` calls
+// the constructor Node(InArena(), m, n). It lives until the next clear_nodes.
+template <class N, class... Args>
+N *make_node(Args &&...args)
+{
+    N *node = node_arena.create<N>(InArena(), std::forward<Args>(args)...);
+    push_node(node);
+    return node;
+}
+
+// Capture of a training step, or of any graph built the same way over and over: the nodes made
+// between begin() and end() are kept by the tape, and each operation records a kernel that
+// recomputes the values of its node in place. forward() and backward() then run the graph again
+// on the current values of the leaves it was built from (inputs, targets, weights, which must
+// outlive the tape and keep their shapes): a walk over two flat lists of pre-bound kernels,
+// without making a node, allocating a buffer or checking the operands again.
+class Tape
+{
+public:
+    Tape();
+    ~Tape();
+    Tape(const Tape &) = delete;
+    Tape &operator=(const Tape &) = delete;
+
+    // Starts a capture, dropping the previous one. The nodes made until end() belong to the tape,
+    // clear_nodes does not destroy them (and must not be called before end()). They must not
+    // depend on nodes made in node_arena before begin(), which clear_nodes destroys.
+    void begin();
+    void end();
+    bool empty() const { return nodes.empty(); }
+
+    // Values of the nodes of the tape from those of the leaves; their gradients are zeroed.
+    void forward() const;
+    // backward_op of the nodes of the tape in reverse order of creation, which is a topological
+    // order: every node runs after all the nodes that use it.
+    void backward() const;
+
+    // Called by the operations on nodes while capturing: `kernel` computes the new node.
+    void record(ArenaFunction kernel);
+
+private:
+    Arena arena; // the nodes of the tape, swapped with node_arena during the capture
+    std::vector<GraphNode *> nodes;
+    std::vector<ArenaFunction> forward_kernels;
+    std::vector<ArenaFunction> backward_kernels;
+    std::size_t first_node; // in all_nodes, during the capture
+};
+
+// Tape capturing the nodes being made, if any.
+extern Tape *capturing_tape;
+
+// Records the kernel computing a new node while a Tape captures, does nothing otherwise.
+template <class F>
+void record_forward(F kernel)
+{
+    if (capturing_tape)
+    {
+        capturing_tape->record(arena_function(std::move(kernel)));
+    }
+}
+
+#endif // GLOBALS_H
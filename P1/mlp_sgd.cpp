@@ -2,47 +2,108 @@
 #include <memory>
 #include <vector>
 #include <random>
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <type_traits>
+#include <cmath>
+#include <stdexcept>
 
 #include "globals.hpp"
 #include "matrix.hpp"
+#include "fixed_matrix.hpp"
+#include "batched_matrix.hpp"
+#include "quantized_matrix.hpp"
+#include "sparse_matrix.hpp"
 
-class Node
+// Node of the computation graph, whose values and gradients are matrices of T: double (Node), or
+// float / bfloat16 to train in reduced precision (see basic_matrix.hpp).
+template <class T>
+class BasicNode : public GraphNode
 {
 public: // We made it public for simplicity. Students: ignore this, we are lazy :-)
+    typedef BasicMatrix<T> matrix_type;
+
     int rows, cols;
-    std::shared_ptr<Matrix> values;
-    std::shared_ptr<Matrix> grads;
-    std::function<void()> backward_op;
-    std::vector<Node *> dependencies;
+    std::shared_ptr<matrix_type> values;
+    std::shared_ptr<matrix_type> grads;
+    std::vector<BasicNode *, ArenaAllocator<BasicNode *>> dependencies; // only grows in the nodes of the graph
+    std::shared_ptr<const SparseMatrix> sparse; // set for a sparse input, whose `values` are then empty
 
 public:
-    Node(int m, int n) : rows(m), cols(n)
+    BasicNode(int m, int n) : rows(m), cols(n)
+    {
+        values = std::make_shared<matrix_type>(m, n);
+        grads = std::make_shared<matrix_type>(m, n);
+    }
+
+    BasicNode(const matrix_type &values) : rows(values.numRows()), cols(values.numCols())
     {
-        values = std::make_shared<Matrix>(m, n);
-        grads = std::make_shared<Matrix>(m, n);
+        this->values = std::make_shared<matrix_type>(values);
+        this->grads = std::make_shared<matrix_type>(values.numRows(), values.numCols());
     }
 
-    Node(const Matrix &values) : rows(values.numRows()), cols(values.numCols())
+    // Takes over the storage of a temporary result instead of copying it.
+    BasicNode(matrix_type &&values) : rows(values.numRows()), cols(values.numCols())
     {
-        this->values = std::make_shared<Matrix>(values);
-        this->grads = std::make_shared<Matrix>(values.numRows(), values.numCols());
+        this->values = std::make_shared<matrix_type>(std::move(values));
+        this->grads = std::make_shared<matrix_type>(rows, cols);
+    }
+
+    // Nodes of the graph (make_node in globals.hpp): the matrices and their control blocks are
+    // in the arena of the step, with the node (the elements themselves come from the memory pool).
+    BasicNode(InArena, int m, int n) : rows(m), cols(n)
+    {
+        values = std::allocate_shared<matrix_type>(ArenaAllocator<matrix_type>(), m, n);
+        grads = std::allocate_shared<matrix_type>(ArenaAllocator<matrix_type>(), m, n);
+    }
+
+    BasicNode(InArena, matrix_type &&values) : rows(values.numRows()), cols(values.numCols())
+    {
+        this->values = std::allocate_shared<matrix_type>(ArenaAllocator<matrix_type>(), std::move(values));
+        this->grads = std::allocate_shared<matrix_type>(ArenaAllocator<matrix_type>(), rows, cols);
+    }
+
+    // Sparse input (e.g. mostly zero features): only usable as the right operand of `*`, which then
+    // works on the non-zeros (see sparse_matrix.hpp). It receives no gradient.
+    BasicNode(const SparseMatrix &values) : rows(values.numRows()), cols(values.numCols())
+    {
+        this->values = std::make_shared<matrix_type>(0, 0);
+        this->grads = std::make_shared<matrix_type>(0, 0);
+        sparse = std::make_shared<const SparseMatrix>(values);
     }
 
     // Copy constructor
-    Node(const Node &other) : rows(other.rows), cols(other.cols),
+    BasicNode(const BasicNode &other) : GraphNode(other), rows(other.rows), cols(other.cols),
                               values(other.values), grads(other.grads),
-                              backward_op(other.backward_op),
-                              dependencies(other.dependencies) {}
+                              dependencies(other.dependencies), sparse(other.sparse) {}
+
+    // Copy of a node of another element type: the values go through the conversion kernels,
+    // the gradients start at zero (e.g. the weights of a model to train in reduced precision).
+    template <class U>
+    explicit BasicNode(const BasicNode<U> &other) : rows(other.rows), cols(other.cols)
+    {
+        values = std::make_shared<matrix_type>(*other.values);
+        grads = std::make_shared<matrix_type>(rows, cols);
+    }
 
-    Node *operator*(Node &other)
+    BasicNode *operator*(BasicNode &other)
     {
         if (cols != other.rows)
         {
             throw std::invalid_argument("Matrix dimensions do not match for multiplication");
         }
 
-        Node *result = new Node((*(this->values)) * (*other.values));
-        push_node(result);
+        if (other.sparse)
+        {
+            return multiply_sparse(other);
+        }
+
+        BasicNode *result = make_node<BasicNode>((*(this->values)) * (*other.values));
+        record_forward([a = values.get(), b = other.values.get(), c = result->values.get()]()
+        {
+            matrix_type::gemm(false, false, 1.0, *a, *b, 0.0, *c);
+        });
 
         // Store shared pointers
         auto this_values = this->values;
@@ -54,25 +115,61 @@ public:
         result->dependencies.push_back(this);
         result->dependencies.push_back(&other);
 
-        result->backward_op = [this_values, this_grads, other_values, other_grads, result_grads]()
+        result->backward_op = arena_function([this_values, this_grads, other_values, other_grads, result_grads]()
         {
-            // dL/dA = dL/dC * B^T
-            *this_grads = *this_grads + (*result_grads) * other_values->transpose();
-            // dL/dB = A^T * dL/dC
-            *other_grads = *other_grads + this_values->transpose() * (*result_grads);
-        };
+            // dL/dA += dL/dC * B^T
+            matrix_type::gemm(false, true, 1.0, *result_grads, *other_values, 1.0, *this_grads);
+            // dL/dB += A^T * dL/dC
+            matrix_type::gemm(true, false, 1.0, *this_values, *result_grads, 1.0, *other_grads);
+        });
 
         return result;
     }
 
-    Node *operator+(Node &other)
+    // this * a sparse input, in O(rows x non-zeros of the input): dL/dA += dL/dC * S^T.
+    // Only for Node (double), the sparse products work on views of double.
+    BasicNode *multiply_sparse(BasicNode &other)
+    {
+        if constexpr (!std::is_same<T, double>::value)
+        {
+            throw std::invalid_argument("Sparse inputs are only supported in double precision");
+        }
+        else
+        {
+            BasicNode *result = make_node<BasicNode>(rows, other.cols);
+            spmm(1.0, *values, false, *other.sparse, 0.0, *result->values);
+            record_forward([a = values.get(), s = other.sparse.get(), c = result->values.get()]()
+            {
+                spmm(1.0, *a, false, *s, 0.0, *c);
+            });
+
+            auto this_grads = this->grads;
+            auto other_sparse = other.sparse;
+            auto result_grads = result->grads;
+
+            result->dependencies.push_back(this);
+            result->dependencies.push_back(&other);
+
+            result->backward_op = arena_function([this_grads, other_sparse, result_grads]()
+            {
+                spmm(1.0, *result_grads, true, *other_sparse, 1.0, *this_grads);
+            });
+
+            return result;
+        }
+    }
+
+    BasicNode *operator+(BasicNode &other)
     {
         if (rows != other.rows || cols != other.cols)
         {
             throw std::invalid_argument("Matrix dimensions do not match for addition");
         }
-        Node *result = new Node((*(this->values)) + (*other.values));
-        push_node(result);
+        BasicNode *result = make_node<BasicNode>((*(this->values)) + (*other.values));
+        record_forward([a = values.get(), b = other.values.get(), c = result->values.get()]()
+        {
+            *c = *a + *b;
+        });
 
         // Store shared pointers
         auto this_grads = this->grads;
@@ -82,23 +179,68 @@ public:
         result->dependencies.push_back(this);
         result->dependencies.push_back(&other);
 
-        result->backward_op = [this_grads, other_grads, result_grads]()
+        result->backward_op = arena_function([this_grads, other_grads, result_grads]()
+        {
+            *this_grads += *result_grads;
+            *other_grads += *result_grads;
+        });
+
+        return result;
+    }
+
+    // this + bias, with the column `bias` (rows x 1) added to every column of this, e.g. the bias
+    // of a layer applied to a batch of samples (one per column). Both directions are products by
+    // a row of ones: the forward pass adds bias * ones^T (a rank-1 update of the copy of this),
+    // the gradient of the bias is result_grads * ones, the sum of the gradients of the columns.
+    BasicNode *add_bias(BasicNode &bias)
+    {
+        if (bias.rows != rows || bias.cols != 1)
+        {
+            throw std::invalid_argument("The bias must be a column with as many rows as the matrix");
+        }
+        if (cols == 1)
+        {
+            return *this + bias;
+        }
+
+        BasicNode *result = make_node<BasicNode>(rows, cols);
+        auto ones = std::allocate_shared<matrix_type>(ArenaAllocator<matrix_type>(), 1, cols);
+        ones->fill(1.0);
+        auto forward = [a = values.get(), b = bias.values.get(), c = result->values.get(), o = ones.get()]()
         {
-            *this_grads = *this_grads + *result_grads;
-            *other_grads = *other_grads + *result_grads;
+            *c = *a;
+            matrix_type::gemm(false, false, 1.0, *b, *o, 1.0, *c);
         };
+        forward();
+        record_forward(forward);
+
+        auto this_grads = this->grads;
+        auto bias_grads = bias.grads;
+        auto result_grads = result->grads;
+
+        result->dependencies.push_back(this);
+        result->dependencies.push_back(&bias);
+
+        result->backward_op = arena_function([this_grads, bias_grads, result_grads, ones]()
+        {
+            *this_grads += *result_grads;
+            matrix_type::gemm(false, true, 1.0, *result_grads, *ones, 1.0, *bias_grads);
+        });
 
         return result;
     }
 
-    Node *operator-(Node &other)
+    BasicNode *operator-(BasicNode &other)
     {
         if (rows != other.rows || cols != other.cols)
         {
             throw std::invalid_argument("Matrix dimensions do not match for subtraction");
         }
-        Node *result = new Node((*(this->values)) - (*other.values));
-        push_node(result);
+        BasicNode *result = make_node<BasicNode>((*(this->values)) - (*other.values));
+        record_forward([a = values.get(), b = other.values.get(), c = result->values.get()]()
+        {
+            *c = *a - *b;
+        });
 
         // Store shared pointers
         auto this_grads = this->grads;
@@ -108,84 +250,126 @@ public:
         result->dependencies.push_back(this);
         result->dependencies.push_back(&other);
 
-        result->backward_op = [this_grads, other_grads, result_grads]()
+        result->backward_op = arena_function([this_grads, other_grads, result_grads]()
         {
-            *this_grads = *this_grads + *result_grads;
-            *other_grads = *other_grads + *result_grads;
-        };
+            *this_grads += *result_grads;
+            *other_grads -= *result_grads;
+        });
 
         return result;
     }
 
     // Rest of the class implementation (apply, transpose, backward, etc.) remains the same...
-    Node *apply(std::function<double(double)> func, std::function<double(double)> func_derivative = nullptr)
+    // `func` and `func_derivative` may be any callables (lambda, functor, function pointer, std::function),
+    // they are inlined in the Matrix loops. Without a derivative, no gradient flows back through this node.
+    // With a built-in pair of activations.hpp (e.g. `apply(Tanh(), TanhDerivative())`), the forward
+    // pass runs the vectorised kernels and the backward pass reuses the saved output (see apply_from_output),
+    // or for GELU, whose derivative needs the input, runs the vectorised derivative kernel.
+    template <class F, class DF = std::nullptr_t>
+    BasicNode *apply(F func, DF func_derivative = nullptr)
     {
-        Node *result = new Node((*(this->values)).apply(func));
-        push_node(result);
+        if constexpr (has_output_derivative<DF>::value)
+        {
+            return apply_from_output(func, [](double y) { return DF::from_output(y); });
+        }
+
+        BasicNode *result = make_node<BasicNode>((*(this->values)).apply(func));
+        record_forward([a = values.get(), c = result->values.get(), func]()
+        {
+            a->apply_into(func, *c);
+        });
 
         result->dependencies.push_back(this);
 
         auto this_values = this->values;
         auto this_grads = this->grads;
-        auto result_values = result->values;
         auto result_grads = result->grads;
 
-        if (func_derivative)
+        if constexpr (is_builtin_activation<DF>::value)
         {
-            result->backward_op = [this_values, this_grads, result_grads, func_derivative,
-                                   rows = this->rows, cols = this->cols]()
+            result->backward_op = arena_function([this_values, this_grads, result_grads, mode = func_derivative.mode]()
             {
-                for (int i = 0; i < rows; ++i)
-                {
-                    for (int j = 0; j < cols; ++j)
-                    {
-                        double curr_grad = this_grads->get(i, j) +
-                                           result_grads->get(i, j) * func_derivative(this_values->get(i, j));
-                        this_grads->set(i, j, curr_grad);
-                    }
-                }
-            };
+                this_grads->activation_backward(DF::activation, *this_values, *result_grads, mode);
+            });
+        }
+        else if constexpr (!std::is_same<DF, std::nullptr_t>::value)
+        {
+            // this_grads += result_grads * func_derivative(this_values), in one pass
+            result->backward_op = arena_function([this_values, this_grads, result_grads, func_derivative]()
+            {
+                *this_grads += hadamard(*result_grads, cwise(func_derivative, *this_values));
+            });
         }
 
         return result;
     }
 
-    Node *transpose()
+    // Element-wise function whose derivative is given in terms of the output y = func(x),
+    // e.g. `apply_from_output(sigmoid, [](double s) { return s * (1 - s); })`.
+    // The backward pass reads the output saved by the forward pass instead of evaluating
+    // the derivative at the input, so for the sigmoid it does not evaluate exp at all.
+    template <class F, class DY>
+    BasicNode *apply_from_output(F func, DY output_derivative)
     {
-        Node *result = new Node((*(this->values)).transpose());
-        push_node(result);
+        BasicNode *result = make_node<BasicNode>((*(this->values)).apply(func));
+        record_forward([a = values.get(), c = result->values.get(), func]()
+        {
+            a->apply_into(func, *c);
+        });
+
+        result->dependencies.push_back(this);
 
         auto this_grads = this->grads;
+        auto result_values = result->values;
         auto result_grads = result->grads;
 
-        result->dependencies.push_back(this);
-
-        result->backward_op = [this_grads, result_grads]()
+        // this_grads += result_grads * output_derivative(result_values), in one pass
+        result->backward_op = arena_function([this_grads, result_values, result_grads, output_derivative]()
         {
-            *this_grads = (*this_grads).transpose();
-        };
+            *this_grads += hadamard(*result_grads, cwise(output_derivative, *result_values));
+        });
 
         return result;
     }
 
-    void backward()
+    BasicNode *sigmoid(MathMode mode = MathMode::Precise)
+    {
+        return apply(Sigmoid{mode}, SigmoidDerivative{mode});
+    }
+
+    BasicNode *transpose()
     {
-        if (backward_op)
-            backward_op();
-        for (const auto &dep : dependencies)
+        BasicNode *result = make_node<BasicNode>((*(this->values)).transpose());
+        record_forward([a = values.get(), c = result->values.get()]()
         {
-            dep->backward();
-        }
+            transpose_into(a->view(), c->view());
+        });
+
+        auto this_grads = this->grads;
+        auto result_grads = result->grads;
+
+        result->dependencies.push_back(this);
+
+        // dL/dA = (dL/dC)^T, read through the lazy transposed view (no transposed copy, in every precision)
+        result->backward_op = arena_function([this_grads, result_grads]()
+        {
+            *this_grads += result_grads->view().transpose();
+        });
+
+        return result;
     }
 
-    void zero_grad()
+    int numDependencies() const override { return static_cast<int>(dependencies.size()); }
+    GraphNode *dependency(int k) const override { return dependencies[k]; }
+
+    void zero_grad() override
     {
         grads->fill(0.);
     }
 
     double get(int i, int j) const
     {
-        return values->get(i, j);
+        return sparse ? sparse->get(i, j) : values->get(i, j);
     }
 
     void set(int i, int j, double value)
@@ -210,45 +394,167 @@ public:
     }
 };
 
-inline Node *binary_cross_entropy(Node &predictions, Node &targets)
+typedef BasicNode<double> Node;
+
+// Node whose values are a batch of small matrices, one per sample (see batched_matrix.hpp): the
+// products of all the samples are then a single node of the graph and a single batched_gemm,
+// instead of one node and one tiny Matrix product per sample. In double only.
+class BatchedNode : public GraphNode
 {
-    if (predictions.rows != targets.rows || predictions.cols != targets.cols)
+public:
+    int count, rows, cols;
+    std::shared_ptr<BatchedMatrix> values;
+    std::shared_ptr<BatchedMatrix> grads;
+    std::vector<GraphNode *, ArenaAllocator<GraphNode *>> dependencies;
+
+    BatchedNode(int count, int m, int n) : count(count), rows(m), cols(n)
     {
-        throw std::invalid_argument("Predictions and targets must have the same dimensions.");
+        values = std::make_shared<BatchedMatrix>(count, m, n);
+        grads = std::make_shared<BatchedMatrix>(count, m, n);
     }
 
-    Node *loss = new Node(1, 1); // BCE loss is a scalar
-    push_node(loss);
+    BatchedNode(InArena, int count, int m, int n) : count(count), rows(m), cols(n)
+    {
+        values = std::allocate_shared<BatchedMatrix>(ArenaAllocator<BatchedMatrix>(), count, m, n);
+        grads = std::allocate_shared<BatchedMatrix>(ArenaAllocator<BatchedMatrix>(), count, m, n);
+    }
 
-    loss->dependencies.push_back(&predictions);
+    BatchedNode(const BatchedMatrix &values) : BatchedNode(BatchedMatrix(values)) {}
+
+    BatchedNode(BatchedMatrix &&values) : count(values.batchSize()), rows(values.numRows()), cols(values.numCols())
+    {
+        this->values = std::make_shared<BatchedMatrix>(std::move(values));
+        this->grads = std::make_shared<BatchedMatrix>(count, rows, cols);
+    }
 
-    double total_loss = 0.0;
-    for (int i = 0; i < predictions.rows; ++i)
+    // this_b * other_b for every sample b
+    BatchedNode *operator*(BatchedNode &other)
     {
-        for (int j = 0; j < predictions.cols; ++j)
+        if (cols != other.rows || count != other.count)
         {
-            double pred = predictions.values->get(i, j);
-            double target = targets.values->get(i, j);
-            total_loss += -target * std::log(pred + 1e-12) - (1 - target) * std::log(1 - pred + 1e-12);
+            throw std::invalid_argument("Matrix dimensions do not match for multiplication");
         }
+        BatchedNode *result = make_node<BatchedNode>(count, rows, other.cols);
+        batched_gemm(false, false, 1.0, *values, *other.values, 0.0, *result->values);
+        record_forward([a = values.get(), b = other.values.get(), c = result->values.get()]()
+        {
+            batched_gemm(false, false, 1.0, *a, *b, 0.0, *c);
+        });
+
+        auto this_values = this->values;
+        auto this_grads = this->grads;
+        auto other_values = other.values;
+        auto other_grads = other.grads;
+        auto result_grads = result->grads;
+
+        result->dependencies.push_back(this);
+        result->dependencies.push_back(&other);
+
+        result->backward_op = arena_function([this_values, this_grads, other_values, other_grads, result_grads]()
+        {
+            // dL/dA_b += dL/dC_b * B_b^T and dL/dB_b += A_b^T * dL/dC_b
+            batched_gemm(false, true, 1.0, *result_grads, *other_values, 1.0, *this_grads);
+            batched_gemm(true, false, 1.0, *this_values, *result_grads, 1.0, *other_grads);
+        });
+
+        return result;
     }
 
-    loss->values->set(0, 0, total_loss / (predictions.rows * predictions.cols));
+    int numDependencies() const override { return static_cast<int>(dependencies.size()); }
+    GraphNode *dependency(int k) const override { return dependencies[k]; }
 
-    // Set up backward operation to modify the original predictions
-    loss->backward_op = [&predictions, &targets]()
+    void zero_grad() override
+    {
+        grads->fill(0.);
+    }
+
+    double get(int b, int i, int j) const
     {
+        return values->get(b, i, j);
+    }
+
+    int getBatchSize() const { return count; }
+    int getRows() const { return rows; }
+    int getCols() const { return cols; }
+};
+
+// weights * x_b for every sample b of x, e.g. a layer applied to each sample. The weights are
+// shared by the batch: their gradient is the sum of those of the samples.
+inline BatchedNode *operator*(Node &weights, BatchedNode &x)
+{
+    if (weights.cols != x.rows)
+    {
+        throw std::invalid_argument("Matrix dimensions do not match for multiplication");
+    }
+    BatchedNode *result = make_node<BatchedNode>(x.count, weights.rows, x.cols);
+    batched_gemm(false, false, 1.0, weights.values->view(), *x.values, 0.0, *result->values);
+    record_forward([w = weights.values.get(), b = x.values.get(), c = result->values.get()]()
+    {
+        batched_gemm(false, false, 1.0, w->view(), *b, 0.0, *c);
+    });
+
+    auto weights_values = weights.values;
+    auto weights_grads = weights.grads;
+    auto x_values = x.values;
+    auto x_grads = x.grads;
+    auto result_grads = result->grads;
+
+    result->dependencies.push_back(&weights);
+    result->dependencies.push_back(&x);
+
+    result->backward_op = arena_function([weights_values, weights_grads, x_values, x_grads, result_grads]()
+    {
+        // dL/dW += sum_b dL/dC_b * x_b^T (summed into the single matrix) and dL/dx_b += W^T * dL/dC_b
+        batched_gemm(false, true, 1.0, *result_grads, *x_values, 1.0, weights_grads->view());
+        batched_gemm(true, false, 1.0, weights_values->view(), *result_grads, 1.0, *x_grads);
+    });
+
+    return result;
+}
+
+template <class T>
+inline BasicNode<T> *binary_cross_entropy(BasicNode<T> &predictions, BasicNode<T> &targets)
+{
+    if (predictions.rows != targets.rows || predictions.cols != targets.cols)
+    {
+        throw std::invalid_argument("Predictions and targets must have the same dimensions.");
+    }
+
+    BasicNode<T> *loss = make_node<BasicNode<T>>(1, 1); // BCE loss is a scalar
+
+    loss->dependencies.push_back(&predictions);
+
+    auto compute_loss = [&predictions, &targets, loss_values = loss->values.get()]()
+    {
+        double total_loss = 0.0;
         for (int i = 0; i < predictions.rows; ++i)
         {
             for (int j = 0; j < predictions.cols; ++j)
             {
                 double pred = predictions.values->get(i, j);
                 double target = targets.values->get(i, j);
-                double grad = (-target / (pred + 1e-12) + (1 - target) / (1 - pred + 1e-12)) / (predictions.rows * predictions.cols);
-                predictions.grads->set(i, j, predictions.grads->get(i, j) + grad);
+                total_loss += -target * std::log(pred + 1e-12) - (1 - target) * std::log(1 - pred + 1e-12);
             }
         }
+
+        loss_values->set(0, 0, total_loss / (predictions.rows * predictions.cols));
     };
+    compute_loss();
+    record_forward(compute_loss);
+
+    // Set up backward operation to modify the original predictions
+    // (scaled by the gradient of the loss itself: 1, or the loss scale of mixed-precision training)
+    auto loss_grads = loss->grads;
+    loss->backward_op = arena_function([&predictions, &targets, loss_grads]()
+    {
+        double scale = loss_grads->get(0, 0);
+        int n = predictions.rows * predictions.cols;
+        // Added to the gradient of the predictions in the same pass
+        *predictions.grads += cwise([scale, n](double pred, double target)
+        {
+            return scale * (-target / (pred + 1e-12) + (1 - target) / (1 - pred + 1e-12)) / n;
+        }, *predictions.values, *targets.values);
+    });
 
     return loss;
 }
@@ -268,24 +574,151 @@ inline double sigmoid_derivative(double x)
 // Dataset already split in batches.
 // `x` contains a vector of batches of data, each column containing one input.
 // `y` contains the corresponding outputs.
-struct Dataset
+template <class T>
+struct BasicDataset
 {
-    std::vector<Node> X;
-    std::vector<Node> Y;
+    std::vector<BasicNode<T>> X;
+    std::vector<BasicNode<T>> Y;
 };
 
-// MLP implementation
-class MLP
+typedef BasicDataset<double> Dataset;
+
+// Dataset for mini-batch training: the inputs are the columns of X (features x samples) and the
+// outputs those of Y (outputs x samples). An epoch goes through the samples by batches of
+// `batch_size` columns (the last one may be smaller), in the order drawn by `shuffle`: only a
+// permutation of the indices is shuffled, `batch` gathers the columns of a batch from it.
+template <class T>
+class BasicMiniBatchDataset
 {
+public:
+    typedef BasicMatrix<T> matrix_type;
+
+    BasicMiniBatchDataset(matrix_type X, matrix_type Y, int batch_size)
+        : X(std::move(X)), Y(std::move(Y)), order(this->X.numCols())
+    {
+        if (this->X.numCols() != this->Y.numCols())
+        {
+            throw std::invalid_argument("The inputs and the outputs must have the same number of samples (columns)");
+        }
+        setBatchSize(batch_size);
+        std::iota(order.begin(), order.end(), 0);
+    }
+
+    int numSamples() const { return X.numCols(); }
+    int numFeatures() const { return X.numRows(); }
+    int numOutputs() const { return Y.numRows(); }
+
+    int batchSize() const { return batch_size; }
+    void setBatchSize(int size)
+    {
+        if (size < 1)
+        {
+            throw std::invalid_argument("The batch size must be positive");
+        }
+        batch_size = size;
+    }
+
+    int numBatches() const { return (numSamples() + batch_size - 1) / batch_size; }
+    // Number of samples of batch b (the batch size, except for the last batch)
+    int batchColumns(int b) const { return std::min(batch_size, numSamples() - b * batch_size); }
+
+    // New random order of the samples, e.g. at the start of every epoch
+    template <class URNG>
+    void shuffle(URNG &gen)
+    {
+        std::shuffle(order.begin(), order.end(), gen);
+    }
+
+    // Inputs and outputs of batch b, copied into x (features x batchColumns(b)) and y
+    // (outputs x batchColumns(b)), which are not reallocated.
+    void batch(int b, matrix_type &x, matrix_type &y) const
+    {
+        if (b < 0 || b >= numBatches())
+        {
+            throw std::out_of_range("Batch index out of range");
+        }
+        const int n = batchColumns(b);
+        if (x.numRows() != X.numRows() || x.numCols() != n || y.numRows() != Y.numRows() || y.numCols() != n)
+        {
+            throw std::invalid_argument("Matrix dimensions do not match the batch");
+        }
+        gather(X, b * batch_size, n, x);
+        gather(Y, b * batch_size, n, y);
+    }
+
 private:
+    void gather(const matrix_type &from, int first, int n, matrix_type &to) const
+    {
+        auto src = from.view();
+        auto dst = to.view();
+        for (int i = 0; i < src.numRows(); ++i)
+        {
+            const T *row = src.data() + static_cast<long>(i) * src.stride();
+            T *out = dst.data() + static_cast<long>(i) * dst.stride();
+            for (int k = 0; k < n; ++k)
+            {
+                out[k] = row[order[first + k]];
+            }
+        }
+    }
+
+    matrix_type X, Y;
+    std::vector<int> order; // samples of the epoch, in order
+    int batch_size;
+};
+
+typedef BasicMiniBatchDataset<double> MiniBatchDataset;
+
+// Mixed-precision training (see BasicMLP::train): precision of the forward and backward passes.
+enum class Precision
+{
+    Model,   // that of the model, no copy of the weights
+    Float,
+    BFloat16
+};
+
+struct MixedPrecision
+{
+    Precision compute = Precision::Model;
+    // The gradient of the loss is `loss_scale` instead of 1 and the weight gradients are divided
+    // by it before the update, so that tiny gradients are not lost in the rounding of the
+    // reduced precision (the range of float and bfloat16 is that of float, so the default of 1
+    // is usually fine).
+    double loss_scale = 1.0;
+    // Dynamic loss scaling: a step whose gradients overflow (inf or NaN) is skipped and halves
+    // the scale, which doubles again after LOSS_SCALE_GROWTH_INTERVAL steps without overflow.
+    // With a static scale such a step is an error (std::runtime_error), the scale is too large.
+    bool dynamic_loss_scale = false;
+};
+
+const int LOSS_SCALE_GROWTH_INTERVAL = 1000;
+
+// MLP implementation, on matrices of T (MLP is the one in double): BasicMLP<float> and
+// BasicMLP<bfloat16> train the same model in reduced precision, and a model converts to
+// another element type with all its weights, e.g. `BasicMLP<float> model32(model);`.
+template <class T>
+class BasicMLP
+{
+private:
+    typedef BasicNode<T> Node;
+    typedef BasicDataset<T> Dataset;
+    typedef BasicMiniBatchDataset<T> MiniBatchDataset;
+
     Node W1, b1, W2, b2;
     double learning_rate;
+    MathMode math_mode;    // accuracy of the vectorised activations (see activations.hpp)
+    BasicMatrix<T> hidden; // hidden activations of `predict`, allocated once
+    QuantizedMatrix W1_int8, W2_int8; // weights of `forward_quantized` (empty until `quantize`)
+    bool capture_graph = true;        // see setGraphCapture
+
+    template <class>
+    friend class BasicMLP;
 
 public:
-    MLP(int input_size, int hidden_size, int output_size, double lr)
+    BasicMLP(int input_size, int hidden_size, int output_size, double lr, MathMode mode = MathMode::Precise)
         : W1(hidden_size, input_size), b1(hidden_size, 1),
           W2(output_size, hidden_size), b2(output_size, 1),
-          learning_rate(lr)
+          learning_rate(lr), math_mode(mode), hidden(hidden_size, 1)
     {
         // The bias `b1` and `b2` are initialized to zero by the constructor
         // which is appropriate. For the weight matrices, we want some
@@ -294,6 +727,14 @@ public:
         initialize(W2);
     }
 
+    // Same model with its weights converted to T.
+    template <class U>
+    explicit BasicMLP(const BasicMLP<U> &other)
+        : W1(other.W1), b1(other.b1), W2(other.W2), b2(other.b2),
+          learning_rate(other.learning_rate), math_mode(other.math_mode), hidden(other.hidden.numRows(), 1)
+    {
+    }
+
     static void initialize(Node &matrix)
     {
         std::random_device rd;
@@ -313,14 +754,86 @@ public:
 
     Node *forward(Node &input)
     {
-        Node *z1 = *(W1 * input) + b1;
-        Node *a1 = z1->apply(sigmoid, sigmoid_derivative);
-        Node *z2 = *(W2 * *a1) + b2;
-        return z2->apply(sigmoid, sigmoid_derivative);
+        Node *z1 = (W1 * input)->add_bias(b1);
+        Node *a1 = z1->sigmoid(math_mode);
+        Node *z2 = (W2 * *a1)->add_bias(b2);
+        return z2->sigmoid(math_mode);
     }
 
-    void train(const Dataset &data, int epochs)
+    // Inference on a single sample, without building the graph: the input and the output are
+    // FixedMatrix (no heap allocation) and the hidden layer reuses `hidden`.
+    // Same result as `forward`, up to the rounding of the activations (scalar libm here).
+    // Only for the MLP in double, as the views of FixedMatrix.
+    // The output size is given explicitly, e.g. `model.predict<1>(FixedMatrix<2, 1>{x0, x1})`.
+    template <int O, int I>
+    FixedMatrix<O, 1> predict(const FixedMatrix<I, 1> &input)
     {
+        if (I != W1.getCols() || O != W2.getRows())
+        {
+            throw std::invalid_argument("Input or output size does not match the MLP.");
+        }
+        BasicMatrix<T>::gemm(false, false, 1.0, *W1.values, input.view(), 0.0, hidden);
+        hidden = cwise(Sigmoid(), hidden + *b1.values);
+        FixedMatrix<O, 1> output;
+        BasicMatrix<T>::gemm(false, false, 1.0, *W2.values, hidden, 0.0, output.view());
+        output += FixedMatrix<O, 1>(*b2.values);
+        return output.apply(Sigmoid());
+    }
+
+    // Post-training quantisation: W1 and W2 in int8 with one scale per row (see
+    // quantized_matrix.hpp), for `forward_quantized`. It is a snapshot of the weights, to
+    // take again if the model is trained further.
+    void quantize()
+    {
+        W1_int8 = QuantizedMatrix(W1.values->view());
+        W2_int8 = QuantizedMatrix(W2.values->view());
+    }
+
+    // Inference with the quantised weights, on a batch of samples (one per column of `input`),
+    // without building the graph. The products are int8, the biases and activations in double.
+    Matrix forward_quantized(const Matrix &input) const
+    {
+        if (W1_int8.numRows() == 0)
+        {
+            throw std::runtime_error("forward_quantized needs the weights quantised by quantize() first.");
+        }
+        Matrix z1(W1_int8.numRows(), input.numCols());
+        W1_int8.multiply(input, z1);
+        add_bias(z1, *b1.values);
+        Matrix z2(W2_int8.numRows(), input.numCols());
+        W2_int8.multiply(z1.sigmoid(math_mode), z2);
+        add_bias(z2, *b2.values);
+        return z2.sigmoid(math_mode);
+    }
+
+    // By default, `train` builds the graph of a step once and replays it for every sample (see
+    // Tape in globals.hpp) when all the samples have the same shape, instead of making its nodes
+    // again each time. The result is the same, this only turns it off (e.g. to compare).
+    void setGraphCapture(bool enabled)
+    {
+        capture_graph = enabled;
+    }
+
+    // With a reduced `precision.compute`, the weights of the model are the master weights: the
+    // forward and backward passes run on a copy of them in that precision (and so do the
+    // activations and gradients of the graph, half or a quarter of the memory), the gradients
+    // are converted back to T for the update, which is applied to the master weights, and the
+    // copy is refreshed from them. Updates smaller than the precision of the copy thus still
+    // accumulate in the model.
+    void train(const Dataset &data, int epochs, const MixedPrecision &precision = MixedPrecision())
+    {
+        if (precision.compute == Precision::Float)
+        {
+            return train_mixed<float>(data, epochs, precision);
+        }
+        if (precision.compute == Precision::BFloat16)
+        {
+            return train_mixed<bfloat16>(data, epochs, precision);
+        }
+        if (capture_graph && same_shapes(data))
+        {
+            return train_captured(data, epochs);
+        }
         for (int epoch = 0; epoch < epochs; ++epoch)
         {
             for (size_t i = 0; i < data.X.size(); ++i)
@@ -339,21 +852,242 @@ public:
                 // Backward pass
                 error->backward();
 
-                // Update weights and biases using learning_rate
-                W2.values->sub_mul(learning_rate, *W2.grads);
-                b2.values->sub_mul(learning_rate, *b2.grads);
-                W1.values->sub_mul(learning_rate, *W1.grads);
-                b1.values->sub_mul(learning_rate, *b1.grads);
-
-                // Reset gradients for the next iteration
-                W1.zero_grad();
-                b1.zero_grad();
-                W2.zero_grad();
-                b2.zero_grad();
+                update_weights();
 
                 clear_nodes();
             }
             // std::cout << "Epoch " << epoch + 1 << " completed." << std::endl;
         }
     }
+
+    // Mini-batch training: each step runs the network on data.batchSize() samples, one per
+    // column, so that the products are GEMM instead of a matrix-vector product per sample. The
+    // biases are broadcast over the columns and the gradients are those of the mean loss of the
+    // batch. The samples are drawn in a new random order every epoch unless `shuffle` is false.
+    // The graph of a full batch is captured once (see setGraphCapture), a smaller last batch is
+    // built as usual.
+    void train(MiniBatchDataset &data, int epochs, bool shuffle = true)
+    {
+        if (data.numFeatures() != W1.getCols() || data.numOutputs() != W2.getRows())
+        {
+            throw std::invalid_argument("Input or output size does not match the MLP.");
+        }
+        if (data.numSamples() == 0)
+        {
+            return;
+        }
+        std::mt19937 gen(std::random_device{}());
+        const int full = data.batchColumns(0);
+        Node input(data.numFeatures(), full);
+        Node target(data.numOutputs(), full);
+        Tape tape;
+        Node *error = nullptr;
+        if (capture_graph)
+        {
+            tape.begin();
+            error = binary_cross_entropy(*forward(input), target);
+            tape.end();
+        }
+
+        for (int epoch = 0; epoch < epochs; ++epoch)
+        {
+            if (shuffle)
+            {
+                data.shuffle(gen);
+            }
+            for (int b = 0; b < data.numBatches(); ++b)
+            {
+                if (capture_graph && data.batchColumns(b) == full)
+                {
+                    data.batch(b, *input.values, *target.values);
+                    tape.forward();
+                    error->grads->set(0, 0, 1.);
+                    tape.backward();
+                }
+                else
+                {
+                    Node x(data.numFeatures(), data.batchColumns(b));
+                    Node y(data.numOutputs(), data.batchColumns(b));
+                    data.batch(b, *x.values, *y.values);
+                    Node *batch_error = binary_cross_entropy(*forward(x), y);
+                    batch_error->grads->set(0, 0, 1.);
+                    batch_error->backward();
+                    clear_nodes();
+                }
+
+                update_weights();
+            }
+        }
+    }
+
+private:
+    // Update weights and biases using learning_rate, and reset gradients for the next iteration
+    void update_weights()
+    {
+        W2.values->sub_mul(learning_rate, *W2.grads);
+        b2.values->sub_mul(learning_rate, *b2.grads);
+        W1.values->sub_mul(learning_rate, *W1.grads);
+        b1.values->sub_mul(learning_rate, *b1.grads);
+
+        W1.zero_grad();
+        b1.zero_grad();
+        W2.zero_grad();
+        b2.zero_grad();
+    }
+
+    // Dense samples, all of the shape of the first one (and targets likewise).
+    static bool same_shapes(const Dataset &data)
+    {
+        if (data.X.empty() || data.Y.size() != data.X.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < data.X.size(); ++i)
+        {
+            if (data.X[i].sparse || data.X[i].rows != data.X[0].rows || data.X[i].cols != data.X[0].cols ||
+                data.Y[i].rows != data.Y[0].rows || data.Y[i].cols != data.Y[0].cols)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // `train` on the graph of a step captured once: the samples are copied into the leaves
+    // `input` and `target` it was built from, then the tape recomputes the values and the
+    // gradients of its nodes in place.
+    void train_captured(const Dataset &data, int epochs)
+    {
+        Node input(data.X[0].rows, data.X[0].cols);
+        Node target(data.Y[0].rows, data.Y[0].cols);
+        Tape tape;
+        tape.begin();
+        Node *error = binary_cross_entropy(*forward(input), target);
+        tape.end();
+
+        for (int epoch = 0; epoch < epochs; ++epoch)
+        {
+            for (size_t i = 0; i < data.X.size(); ++i)
+            {
+                *input.values = *data.X[i].values;
+                *target.values = *data.Y[i].values;
+
+                tape.forward();
+                error->grads->set(0, 0, 1.);
+                tape.backward();
+
+                update_weights();
+            }
+        }
+    }
+
+    // `train` with the forward and backward passes in U.
+    template <class U>
+    void train_mixed(const Dataset &data, int epochs, const MixedPrecision &precision)
+    {
+        if (!(precision.loss_scale > 0) || !std::isfinite(precision.loss_scale))
+        {
+            throw std::invalid_argument("The loss scale must be positive and finite");
+        }
+        BasicMLP<U> low(*this);
+        BasicDataset<U> low_data;
+        for (size_t i = 0; i < data.X.size(); ++i)
+        {
+            low_data.X.push_back(BasicNode<U>(data.X[i]));
+            low_data.Y.push_back(BasicNode<U>(data.Y[i]));
+        }
+        Node *master[] = {&W1, &b1, &W2, &b2};
+        BasicNode<U> *copy[] = {&low.W1, &low.b1, &low.W2, &low.b2};
+
+        double scale = precision.loss_scale;
+        int steps_without_overflow = 0;
+        for (int epoch = 0; epoch < epochs; ++epoch)
+        {
+            for (size_t i = 0; i < low_data.X.size(); ++i)
+            {
+                BasicNode<U> input = low_data.X[i];
+                BasicNode<U> target = low_data.Y[i];
+
+                BasicNode<U> *output = low.forward(input);
+                BasicNode<U> *error = binary_cross_entropy(*output, target);
+                error->grads->set(0, 0, scale);
+                error->backward();
+
+                // Gradients in T, in the (otherwise unused) gradients of the master weights
+                bool finite = true;
+                for (int k = 0; k < 4; ++k)
+                {
+                    convert(*copy[k]->grads, *master[k]->grads);
+                    copy[k]->zero_grad();
+                    finite = finite && all_finite(*master[k]->grads);
+                }
+                if (finite)
+                {
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        master[k]->values->sub_mul(learning_rate / scale, *master[k]->grads);
+                        convert(*master[k]->values, *copy[k]->values);
+                    }
+                }
+                if (!finite && !precision.dynamic_loss_scale)
+                {
+                    clear_nodes();
+                    for (Node *node : master)
+                    {
+                        node->zero_grad();
+                    }
+                    throw std::runtime_error("Non-finite gradients with a static loss scale: lower it or enable dynamic_loss_scale");
+                }
+                if (precision.dynamic_loss_scale)
+                {
+                    if (!finite)
+                    {
+                        scale /= 2;
+                        steps_without_overflow = 0;
+                    }
+                    else if (++steps_without_overflow == LOSS_SCALE_GROWTH_INTERVAL)
+                    {
+                        scale *= 2;
+                        steps_without_overflow = 0;
+                    }
+                }
+
+                clear_nodes();
+            }
+        }
+        for (Node *node : master)
+        {
+            node->zero_grad();
+        }
+    }
+
+    // z(i, j) += bias(i, 0) for every sample j.
+    static void add_bias(Matrix &z, const BasicMatrix<T> &bias)
+    {
+        for (int i = 0; i < z.numRows(); ++i)
+        {
+            const double b = bias.get(i, 0);
+            for (int j = 0; j < z.numCols(); ++j)
+            {
+                z.set(i, j, z.get(i, j) + b);
+            }
+        }
+    }
+
+    static bool all_finite(const BasicMatrix<T> &m)
+    {
+        for (int i = 0; i < m.numRows(); ++i)
+        {
+            for (int j = 0; j < m.numCols(); ++j)
+            {
+                if (!std::isfinite(m.get(i, j)))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
 };
+
+typedef BasicMLP<double> MLP;
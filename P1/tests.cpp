@@ -1,8 +1,13 @@
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <random>
 
 #include "matrix.hpp"
+#include "gemm.hpp"
+#include "simd.hpp"
 #include "mlp_sgd.cpp"
 // A helper function to compare floating–point values.
 bool almostEqual(double a, double b, double epsilon = 1e-6)
@@ -10,6 +15,21 @@ bool almostEqual(double a, double b, double epsilon = 1e-6)
     return std::fabs(a - b) < epsilon;
 }
 
+// A rows x cols matrix of elements drawn uniformly in [-1, 1) from `gen`.
+Matrix randomMatrix(int rows, int cols, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<double> dis(-1.0, 1.0);
+    Matrix m(rows, cols);
+    for (int i = 0; i < rows; ++i)
+    {
+        for (int j = 0; j < cols; ++j)
+        {
+            m.set(i, j, dis(gen));
+        }
+    }
+    return m;
+}
+
 void test_mlp_training()
 {
     Dataset data;
@@ -53,6 +73,10 @@ void test_mlp_training()
         std::cout << "Input: " << data.X[i].get(0, 0) << ", " << data.X[i].get(1, 0);
         std::cout << " | Predicted: " << output->get(0, 0);
         std::cout << " | Target: " << data.Y[i].get(0, 0) << "\n";
+
+        // The allocation free inference gives the same prediction.
+        FixedMatrix<1, 1> predicted = model.predict<1>(FixedMatrix<2, 1>{data.X[i].get(0, 0), data.X[i].get(1, 0)});
+        assert(almostEqual(predicted.get(0, 0), output->get(0, 0), 1e-12));
     }
 
     std::cout << "MLP training test completed.\n";
@@ -293,6 +317,1628 @@ int main()
         assert(almostEqual(a.get(1, 1), -3));
     }
 
+    // --------------------------------------------------
+    // Test 7: sigmoid and sigmoid_backward
+    // --------------------------------------------------
+    {
+        // Use an odd number of elements so that the vectorised kernels also go through their tail.
+        Matrix x(3, 7);
+        for (int i = 0; i < x.numRows(); ++i)
+        {
+            for (int j = 0; j < x.numCols(); ++j)
+            {
+                x.set(i, j, 4.0 * (i - 1) + 0.7 * (j - 3));
+            }
+        }
+
+        Matrix g(3, 7);
+        g.fill(2.0);
+        Matrix acc(3, 7);
+        acc.fill(1.0);
+
+        Matrix s = x.sigmoid();
+        acc.sigmoid_backward(x, g);
+        for (int i = 0; i < x.numRows(); ++i)
+        {
+            for (int j = 0; j < x.numCols(); ++j)
+            {
+                double expected = 1.0 / (1.0 + std::exp(-x.get(i, j)));
+                assert(almostEqual(s.get(i, j), expected, 1e-14));
+                assert(almostEqual(acc.get(i, j), 1.0 + 2.0 * expected * (1 - expected), 1e-14));
+            }
+        }
+    }
+
+    // --------------------------------------------------
+    // Test 8: Large matrices (split over the thread pool)
+    // --------------------------------------------------
+    {
+        // Sizes above the parallel thresholds and not multiples of the register tiles.
+        const int m = 301, k = 203, n = 157;
+        Matrix a(m, k), b(k, n);
+        for (int i = 0; i < m; ++i)
+            for (int j = 0; j < k; ++j)
+                a.set(i, j, std::sin(0.1 * i + 0.3 * j));
+        for (int i = 0; i < k; ++i)
+            for (int j = 0; j < n; ++j)
+                b.set(i, j, std::cos(0.2 * i - 0.1 * j));
+
+        Matrix c = a * b;
+        for (int i = 0; i < m; ++i)
+        {
+            for (int j = 0; j < n; ++j)
+            {
+                double expected = 0.0;
+                for (int p = 0; p < k; ++p)
+                    expected += a.get(i, p) * b.get(p, j);
+                assert(almostEqual(c.get(i, j), expected, 1e-10));
+            }
+        }
+
+        Matrix aT = a.transpose();
+        Matrix sq = a.apply([](double x) { return x * x; });
+        Matrix sum = a + sq;
+        Matrix acc(a);
+        acc.sub_mul(0.5, sq);
+        for (int i = 0; i < m; ++i)
+        {
+            for (int j = 0; j < k; ++j)
+            {
+                double x = a.get(i, j);
+                assert(aT.get(j, i) == x);
+                assert(almostEqual(sq.get(i, j), x * x));
+                assert(almostEqual(sum.get(i, j), x + x * x));
+                assert(almostEqual(acc.get(i, j), x - 0.5 * x * x));
+            }
+        }
+    }
+
+    // --------------------------------------------------
+    // Test 9: gemm with transposed operands and accumulation
+    // --------------------------------------------------
+    {
+        for (int size : {3, 70})
+        {
+            // A is k x m and B is n x k, so that C += 2 * A^T * B^T is m x n.
+            const int m = size, n = size + 5, k = size + 2;
+            Matrix a(k, m), b(n, k), c(m, n);
+            for (int i = 0; i < k; ++i)
+                for (int j = 0; j < m; ++j)
+                    a.set(i, j, std::sin(i + 2.0 * j));
+            for (int i = 0; i < n; ++i)
+                for (int j = 0; j < k; ++j)
+                    b.set(i, j, std::cos(3.0 * i - j));
+            c.fill(1.0);
+
+            Matrix::gemm(true, true, 2.0, a, b, 1.0, c);
+            Matrix expected = a.transpose() * b.transpose();
+            for (int i = 0; i < m; ++i)
+                for (int j = 0; j < n; ++j)
+                    assert(almostEqual(c.get(i, j), 1.0 + 2.0 * expected.get(i, j), 1e-10));
+
+            // A^T * A (k x m)^T * (k x m) and A * A^T, overwriting C (beta = 0).
+            Matrix ata(m, m), aat(k, k);
+            ata.fill(42.0);
+            Matrix::gemm(true, false, 1.0, a, a, 0.0, ata);
+            Matrix::gemm(false, true, 1.0, a, a, 0.0, aat);
+            Matrix ata_expected = a.transpose() * a;
+            Matrix aat_expected = a * a.transpose();
+            for (int i = 0; i < m; ++i)
+                for (int j = 0; j < m; ++j)
+                    assert(almostEqual(ata.get(i, j), ata_expected.get(i, j), 1e-10));
+            for (int i = 0; i < k; ++i)
+                for (int j = 0; j < k; ++j)
+                    assert(almostEqual(aat.get(i, j), aat_expected.get(i, j), 1e-10));
+        }
+
+        // Mismatching dimensions are rejected.
+        Matrix a(2, 3), b(2, 3), c(2, 2);
+        bool thrown = false;
+        try
+        {
+            Matrix::gemm(false, false, 1.0, a, b, 0.0, c);
+        }
+        catch (const std::invalid_argument &)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    // --------------------------------------------------
+    // Test 10: Composite element-wise expressions
+    // --------------------------------------------------
+    {
+        Matrix a(2, 3), b(2, 3), c(2, 3);
+        for (int i = 0; i < 2; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                a.set(i, j, i + j);
+                b.set(i, j, 10.0 * i - j);
+                c.set(i, j, 0.5 * j);
+            }
+        }
+
+        Matrix d = a + b - c * 2.0;
+        Matrix e = -a + 3.0 * (b - c);
+        for (int i = 0; i < 2; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                assert(almostEqual(d.get(i, j), a.get(i, j) + b.get(i, j) - 2.0 * c.get(i, j)));
+                assert(almostEqual(e.get(i, j), -a.get(i, j) + 3.0 * (b.get(i, j) - c.get(i, j))));
+            }
+        }
+
+        // The destination may appear in the expression (SGD update).
+        Matrix w(a);
+        w = w - b * 0.1;
+        for (int i = 0; i < 2; ++i)
+            for (int j = 0; j < 3; ++j)
+                assert(almostEqual(w.get(i, j), a.get(i, j) - 0.1 * b.get(i, j)));
+
+        // An expression that reads other elements of the destination, or views it with another
+        // shape, is evaluated before the destination is overwritten or resized.
+        Matrix sq(4, 4);
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                sq.set(i, j, 4.0 * i + j);
+        Matrix sq0 = sq;
+        sq = sq.transpose() + sq;
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                assert(sq.get(i, j) == sq0.get(j, i) + sq0.get(i, j));
+        Matrix ns(a);
+        ns = ns.transpose() * 2.0;
+        assert(ns.numRows() == 3 && ns.numCols() == 2);
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 2; ++j)
+                assert(ns.get(i, j) == 2.0 * a.get(j, i));
+        Matrix wide(a);
+        wide = wide.colRange(1, 2) * 1.0;
+        assert(wide.numRows() == 2 && wide.numCols() == 2);
+        for (int i = 0; i < 2; ++i)
+            for (int j = 0; j < 2; ++j)
+                assert(wide.get(i, j) == a.get(i, j + 1));
+
+        // Assigning to a matrix of another shape resizes it.
+        Matrix f(1, 1);
+        f = a + b;
+        assert(f.numRows() == 2 && f.numCols() == 3);
+        assert(almostEqual(f.get(1, 2), a.get(1, 2) + b.get(1, 2)));
+
+        Matrix g(3, 2);
+        bool thrown = false;
+        try
+        {
+            Matrix h = a + g;
+        }
+        catch (const std::invalid_argument &)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    // --------------------------------------------------
+    // Test 11: Move semantics and in-place operators
+    // --------------------------------------------------
+    {
+        Matrix a(2, 2), b(2, 2);
+        a.set(0, 0, 1);
+        a.set(0, 1, 2);
+        a.set(1, 0, 3);
+        a.set(1, 1, 4);
+        b.fill(10);
+
+        // ((a + b) * 0.5 - a) + 2 * b = 2.5 * b - 0.5 * a
+        Matrix c(a);
+        c += b;
+        c *= 0.5;
+        c -= a;
+        c.axpy(2.0, b);
+        assert(almostEqual(c.get(0, 0), 24.5));
+        assert(almostEqual(c.get(0, 1), 24.0));
+        assert(almostEqual(c.get(1, 0), 23.5));
+        assert(almostEqual(c.get(1, 1), 23.0));
+
+        // Moving takes over the storage and leaves the source empty.
+        Matrix moved(std::move(c));
+        assert(moved.numRows() == 2 && moved.numCols() == 2);
+        assert(c.numRows() == 0 && c.numCols() == 0);
+        assert(almostEqual(moved.get(1, 1), 23.0));
+
+        Matrix target(5, 5);
+        target = std::move(moved);
+        assert(target.numRows() == 2 && target.numCols() == 2);
+        assert(almostEqual(target.get(0, 0), 24.5));
+    }
+
+    // --------------------------------------------------
+    // Test 12: Templated apply and built-in activations
+    // --------------------------------------------------
+    {
+        // Any callable: lambda, function pointer, functor, std::function.
+        Matrix a(2, 3);
+        for (int i = 0; i < 2; ++i)
+            for (int j = 0; j < 3; ++j)
+                a.set(i, j, i - j);
+        std::function<double(double)> cube = [](double x) { return x * x * x; };
+        Matrix a1 = a.apply([](double x) { return 2.0 * x; });
+        Matrix a2 = a.apply(sigmoid_derivative);
+        Matrix a3 = a.apply(cube);
+        for (int i = 0; i < 2; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                assert(almostEqual(a1.get(i, j), 2.0 * (i - j)));
+                assert(almostEqual(a2.get(i, j), sigmoid_derivative(i - j)));
+                assert(almostEqual(a3.get(i, j), (i - j) * (i - j) * (i - j)));
+            }
+        }
+
+        // The vectorised kernels agree with the scalar reference (operator()) of each functor,
+        // including in their tail (odd size), for large inputs and around 0.
+        Matrix x(5, 11);
+        for (int i = 0; i < x.numRows(); ++i)
+            for (int j = 0; j < x.numCols(); ++j)
+                x.set(i, j, (i - 2) * (j - 5) * std::pow(10.0, j - 8) + 0.3 * (j - 5));
+        x.set(0, 0, 0.0);
+        x.set(4, 10, -800.0);
+        x.set(3, 10, 800.0);
+
+        auto check = [&x](auto f, auto df)
+        {
+            Matrix y = x.apply(f);
+            Matrix dy = x.apply(df);
+            Matrix g(x.numRows(), x.numCols());
+            g.fill(-0.5);
+            Matrix acc(x.numRows(), x.numCols());
+            acc.fill(1.0);
+            acc.activation_backward(decltype(f)::activation, x, g);
+            for (int i = 0; i < x.numRows(); ++i)
+            {
+                for (int j = 0; j < x.numCols(); ++j)
+                {
+                    double v = x.get(i, j);
+                    assert(std::fabs(y.get(i, j) - f(v)) <= 1e-15 * std::max(1.0, std::fabs(f(v))));
+                    assert(std::fabs(dy.get(i, j) - df(v)) <= 1e-14 * std::max(1.0, std::fabs(df(v))));
+                    assert(almostEqual(acc.get(i, j), 1.0 - 0.5 * df(v), 1e-14));
+                }
+            }
+        };
+        check(Sigmoid(), SigmoidDerivative());
+        check(Tanh(), TanhDerivative());
+        check(ReLU(), ReLUDerivative());
+        check(GELU(), GELUDerivative());
+
+        // tanh stays accurate relative to its (small) value near 0.
+        Matrix small(1, 3);
+        small.set(0, 0, 1e-10);
+        small.set(0, 1, -3e-5);
+        small.set(0, 2, 1e-3);
+        Matrix t = small.apply(Tanh());
+        for (int j = 0; j < 3; ++j)
+            assert(std::fabs(t.get(0, j) - std::tanh(small.get(0, j))) <= 1e-15 * std::fabs(std::tanh(small.get(0, j))));
+
+        // Node::apply: a built-in pair and an arbitrary derivative give the same gradients.
+        Node in(x);
+        Node *fast = in.apply(Tanh(), TanhDerivative());
+        Node *generic = in.apply([](double v) { return std::tanh(v); },
+                                 [](double v) { return 1.0 / (std::cosh(v) * std::cosh(v)); });
+        fast->grads->fill(1.0);
+        generic->grads->fill(-1.0);
+        fast->backward_op();
+        generic->backward_op();
+        for (int i = 0; i < x.numRows(); ++i)
+            for (int j = 0; j < x.numCols(); ++j)
+                assert(almostEqual(in.grads->get(i, j), 0.0, 1e-14));
+        clear_nodes();
+    }
+
+    // --------------------------------------------------
+    // Test 13: Accuracy of the vectorised exp and sigmoid in both MathMode
+    // --------------------------------------------------
+    {
+        // Error in units in the last place of the libm result.
+        auto ulp_error = [](double y, double ref)
+        {
+            if (y == ref)
+                return 0.0;
+            double a = std::fabs(ref);
+            return std::fabs(y - ref) / (std::nextafter(a, INFINITY) - a);
+        };
+
+        const int n = 100003;
+        std::mt19937 gen(7);
+        std::uniform_real_distribution<double> wide(-708.0, 709.0), narrow(-20.0, 20.0);
+        std::vector<double> x(n), y(n);
+        for (int i = 0; i < n; ++i)
+            x[i] = i % 2 == 0 ? wide(gen) : narrow(gen);
+        x[0] = 0.0;
+        x[1] = -1e-300;
+
+        const double max_ulp[MATH_MODE_COUNT] = {1.0, 1.5e4};
+        for (int mode = 0; mode < MATH_MODE_COUNT; ++mode)
+        {
+            simd().exp[mode](n, x.data(), y.data());
+            for (int i = 0; i < n; ++i)
+                assert(ulp_error(y[i], std::exp(x[i])) <= max_ulp[mode]);
+        }
+
+        Matrix z(317, 315);
+        for (int i = 0; i < z.numRows(); ++i)
+            for (int j = 0; j < z.numCols(); ++j)
+                z.set(i, j, narrow(gen));
+        Matrix precise = z.apply(Sigmoid());
+        Matrix fast = z.apply(Sigmoid{MathMode::Fast});
+        for (int i = 0; i < z.numRows(); ++i)
+        {
+            for (int j = 0; j < z.numCols(); ++j)
+            {
+                double expected = Sigmoid()(z.get(i, j));
+                assert(ulp_error(precise.get(i, j), expected) <= 2.0);
+                assert(ulp_error(fast.get(i, j), expected) <= 1.5e4);
+            }
+        }
+
+        // NaN propagates (through full registers and the padded tail) instead of being clamped
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        Matrix with_nan(3, 5);
+        with_nan.fill(0.5);
+        with_nan.set(0, 1, nan);
+        with_nan.set(2, 4, nan);
+        for (int mode = 0; mode < MATH_MODE_COUNT; ++mode)
+        {
+            MathMode m = static_cast<MathMode>(mode);
+            Matrix s = with_nan.apply(Sigmoid{m});
+            Matrix t = with_nan.apply(Tanh{m});
+            for (int i = 0; i < 3; ++i)
+            {
+                for (int j = 0; j < 5; ++j)
+                {
+                    bool is_nan = std::isnan(with_nan.get(i, j));
+                    assert(std::isnan(s.get(i, j)) == is_nan);
+                    assert(std::isnan(t.get(i, j)) == is_nan);
+                }
+            }
+            simd().exp[mode](1, &nan, y.data());
+            assert(std::isnan(y[0]));
+        }
+    }
+
+    // --------------------------------------------------
+    // Test 14: Activation backward from the saved output
+    // --------------------------------------------------
+    {
+        Matrix x(4, 9);
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 9; ++j)
+                x.set(i, j, 0.5 * (i - 2) + 0.3 * (j - 4));
+        Matrix g(4, 9);
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 9; ++j)
+                g.set(i, j, 1.0 + 0.1 * (i * 9 + j));
+
+        // Built-in pairs with a `from_output` (sigmoid, tanh, ReLU) and an explicit output derivative
+        // give the same gradient as the derivative evaluated at the input.
+        Node in(x);
+        Node *s = in.sigmoid();
+        Node *t = in.apply(Tanh(), TanhDerivative());
+        Node *r = in.apply(ReLU(), ReLUDerivative());
+        Node *c = in.apply_from_output([](double v) { return v * v * v; },
+                                       [](double y) { return 3.0 * std::cbrt(y) * std::cbrt(y); });
+        for (Node *node : {s, t, r, c})
+        {
+            *node->grads = g;
+            node->backward_op();
+        }
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 9; ++j)
+            {
+                double v = x.get(i, j);
+                double expected = SigmoidDerivative()(v) + TanhDerivative()(v) + ReLUDerivative()(v) + 3.0 * v * v;
+                assert(almostEqual(in.grads->get(i, j), g.get(i, j) * expected, 1e-12));
+            }
+        }
+        clear_nodes();
+    }
+
+    // --------------------------------------------------
+    // Test 15: Pooled, aligned storage
+    // --------------------------------------------------
+    {
+        // Every block is aligned on a cache line, and a freed block is reused by the
+        // next allocation of the same size class.
+        for (size_t bytes : {1, 8, 64, 100, 1000, 4096 * 8, 1000000})
+        {
+            void *p = pool_allocate(bytes);
+            assert(reinterpret_cast<uintptr_t>(p) % POOL_ALIGNMENT == 0);
+            pool_deallocate(p, bytes);
+            void *q = pool_allocate(bytes);
+            assert(q == p);
+            pool_deallocate(q, bytes);
+        }
+
+        // Once warmed up, the temporaries of a loop of matrix operations all come from the free lists.
+        Matrix a(64, 48), b(48, 32), w(64, 32);
+        a.fill(0.5);
+        b.fill(0.25);
+        for (int it = 0; it < 3; ++it)
+        {
+            Matrix c = a * b;
+            w = w - c.apply(Sigmoid()) * 0.1;
+        }
+        PoolStats before = pool_stats();
+        for (int it = 0; it < 10; ++it)
+        {
+            Matrix c = a * b;
+            w = w - c.apply(Sigmoid()) * 0.1;
+        }
+        PoolStats after = pool_stats();
+        assert(after.allocations > before.allocations);
+        assert(after.allocations - before.allocations == after.reused - before.reused);
+    }
+
+    // --------------------------------------------------
+    // Test 16: Non-owning views
+    // --------------------------------------------------
+    {
+        Matrix m(6, 8);
+        for (int i = 0; i < 6; ++i)
+            for (int j = 0; j < 8; ++j)
+                m.set(i, j, 10.0 * i + j);
+
+        // A block refers to the elements of the matrix, without copying them.
+        MatrixView blk = m.block(1, 2, 3, 4);
+        assert(blk.numRows() == 3 && blk.numCols() == 4 && blk.stride() == 8);
+        assert(!blk.isContiguous() && m.rowRange(2, 3).isContiguous());
+        assert(blk.get(0, 0) == 12.0 && blk.get(2, 3) == 35.0);
+        assert(blk.block(1, 1, 2, 2).get(0, 0) == 23.0);
+        blk.set(0, 0, -1.0);
+        assert(m.get(1, 2) == -1.0);
+
+        // Views mix with matrices in expressions, and assigning to a view writes into the matrix.
+        Matrix copy = m.colRange(2, 4);
+        Matrix sum = blk + copy.rowRange(1, 3) * 2.0;
+        assert(sum.numRows() == 3 && sum.numCols() == 4);
+        assert(sum.get(1, 1) == 23.0 + 2.0 * 23.0);
+        Matrix before = m;
+        blk += Matrix(3, 4) - blk;
+        for (int i = 0; i < 6; ++i)
+            for (int j = 0; j < 8; ++j)
+            {
+                bool inside = i >= 1 && i < 4 && j >= 2 && j < 6;
+                assert(m.get(i, j) == (inside ? 0.0 : before.get(i, j)));
+            }
+        m.colRange(7, 1).fill(3.0);
+        assert(m.get(5, 7) == 3.0 && m.get(5, 6) == 56.0);
+
+        // GEMM reads and writes sub-blocks in place, with any combination of transpositions.
+        Matrix a(9, 7), b(11, 10), c(12, 13);
+        for (int i = 0; i < 9; ++i)
+            for (int j = 0; j < 7; ++j)
+                a.set(i, j, std::sin(i + 2.0 * j));
+        for (int i = 0; i < 11; ++i)
+            for (int j = 0; j < 10; ++j)
+                b.set(i, j, std::cos(3.0 * i - j));
+        c.fill(1.0);
+        ConstMatrixView av = a.block(1, 2, 4, 5); // op(A) = av^T is 5 x 4
+        ConstMatrixView bv = b.block(2, 1, 6, 4); // op(B) = bv^T is 4 x 6
+        Matrix::gemm(true, true, 2.0, av, bv, 1.0, c.block(3, 4, 5, 6));
+        Matrix expected = Matrix(av).transpose() * Matrix(bv).transpose();
+        for (int i = 0; i < 12; ++i)
+            for (int j = 0; j < 13; ++j)
+            {
+                bool inside = i >= 3 && i < 8 && j >= 4 && j < 10;
+                assert(almostEqual(c.get(i, j), inside ? 1.0 + 2.0 * expected.get(i - 3, j - 4) : 1.0, 1e-12));
+            }
+        Matrix prod = a.block(0, 0, 3, 7) * a.block(2, 1, 7, 4);
+        Matrix prod_expected = Matrix(a.block(0, 0, 3, 7)) * Matrix(a.block(2, 1, 7, 4));
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j)
+                assert(almostEqual(prod.get(i, j), prod_expected.get(i, j), 1e-12));
+
+        // The output of gemm must not overlap its operands.
+        bool thrown = false;
+        try
+        {
+            Matrix::gemm(false, false, 1.0, a.block(0, 0, 2, 2), a.block(0, 0, 2, 2), 0.0, a.block(1, 1, 2, 2));
+        }
+        catch (const std::invalid_argument &)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+
+        // Disjoint blocks of the same matrix may be used together, even when their rows interleave.
+        Matrix ab(4, 6);
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 6; ++j)
+                ab.set(i, j, j < 2 ? (i == j ? 2.0 : 0.0) : 1.0 + i * 6 + j);
+        // columns 4 and 5 = (columns 2 and 3) * (2 I), from the first two columns
+        Matrix::gemm(false, false, 1.0, ab.block(0, 2, 4, 2), ab.block(0, 0, 2, 2), 0.0, ab.colRange(4, 2));
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 2; ++j)
+                assert(ab.get(i, 4 + j) == 2.0 * (3.0 + i * 6 + j));
+        assert(!views_overlap(ab.colRange(0, 3), ab.colRange(3, 3)));
+        assert(views_overlap(ab.block(1, 2, 2, 2), ab.colRange(3, 3)));
+        assert(!views_overlap(ab.block(0, 0, 1, 6), ab.block(1, 0, 3, 6)));
+        // A row of a view may continue past the end of a row of the matrix (raw pointer views).
+        MatrixView wrapped(ab.view().data() + 4, 2, 4, 6); // elements (0, 4) to (1, 1), then (1, 4) to (2, 1)
+        assert(views_overlap(wrapped, ab.block(2, 1, 1, 1)));
+        assert(!views_overlap(wrapped, ab.block(1, 2, 1, 2)));
+        assert(views_overlap(ab.block(1, 0, 1, 1), wrapped));
+        assert(views_overlap(wrapped, MatrixView(ab.view().data(), 2, 3, 3))); // different strides
+
+        // apply works on views, with the vectorised kernels for the built-in activations.
+        ConstMatrixView cols = a.colRange(1, 5);
+        Matrix s = cols.apply(Sigmoid());
+        Matrix ds = cols.apply(SigmoidDerivative());
+        Matrix sq = cols.apply([](double x) { return x * x; });
+        for (int i = 0; i < 9; ++i)
+            for (int j = 0; j < 5; ++j)
+            {
+                double x = a.get(i, j + 1);
+                assert(almostEqual(s.get(i, j), Sigmoid()(x), 1e-15));
+                assert(almostEqual(ds.get(i, j), SigmoidDerivative()(x), 1e-15));
+                assert(sq.get(i, j) == x * x);
+            }
+
+        // Out of range blocks are rejected.
+        thrown = false;
+        try
+        {
+            m.block(4, 0, 3, 2);
+        }
+        catch (const std::out_of_range &)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    // --------------------------------------------------
+    // Test 17: Lazy transpose
+    // --------------------------------------------------
+    {
+        Matrix a(5, 3), b(5, 4);
+        for (int i = 0; i < 5; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+                a.set(i, j, i - 2.0 * j);
+            for (int j = 0; j < 4; ++j)
+                b.set(i, j, 0.5 * i * j + 1.0);
+        }
+
+        // transpose() copies nothing: it is a view of the same elements.
+        long allocations = pool_stats().allocations;
+        TransposedView at = a.transpose();
+        assert(pool_stats().allocations == allocations);
+        assert(at.numRows() == 3 && at.numCols() == 5);
+        assert(at.get(2, 4) == a.get(4, 2));
+        assert(at.transpose().data() == a.view().data());
+
+        // Products read it in place, and agree with the transposed copy.
+        Matrix at_copy = a.transpose();
+        Matrix bt_copy = b.transpose();
+        Matrix p1 = a.transpose() * b;                   // 3 x 4
+        Matrix p2 = b.transpose() * a;                   // 4 x 3
+        Matrix p3 = a * a.transpose();                   // 5 x 5
+        Matrix p4 = a.transpose() * bt_copy.transpose(); // 3 x 4
+        Matrix e1 = at_copy * b, e2 = bt_copy * a, e3 = a * at_copy;
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j)
+            {
+                assert(almostEqual(p1.get(i, j), e1.get(i, j), 1e-12));
+                assert(almostEqual(p2.get(j, i), e2.get(j, i), 1e-12));
+                assert(almostEqual(p4.get(i, j), e1.get(i, j), 1e-12));
+            }
+        for (int i = 0; i < 5; ++i)
+            for (int j = 0; j < 5; ++j)
+                assert(almostEqual(p3.get(i, j), e3.get(i, j), 1e-12));
+
+        // In element-wise expressions, and transposing a matrix into itself.
+        Matrix s = at_copy + a.transpose() * 2.0;
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 5; ++j)
+                assert(s.get(i, j) == 3.0 * a.get(j, i));
+        Matrix c = a;
+        c = c.transpose();
+        assert(c.numRows() == 3 && c.numCols() == 5);
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 5; ++j)
+                assert(c.get(i, j) == a.get(j, i));
+
+        // Gradient through Node::transpose: for Z = A^T * W, dL/dA = (dL/dZ * W^T)^T = W * (dL/dZ)^T.
+        Node x(a), w(5, 2);
+        w.values->fill(0.25);
+        Node *y = x.transpose();
+        Node *z = *y * w;
+        z->grads->fill(1.0);
+        z->backward();
+        Matrix expected = *w.values * z->grads->transpose();
+        for (int i = 0; i < 5; ++i)
+            for (int j = 0; j < 3; ++j)
+                assert(almostEqual(x.grads->get(i, j), expected.get(i, j), 1e-12));
+        clear_nodes();
+    }
+
+    // --------------------------------------------------
+    // Test 18: Tiled transpose
+    // --------------------------------------------------
+    {
+        // Sizes around the SIMD width and the tile size, so that every edge case is covered.
+        for (int rows : {1, 3, 8, 63, 64, 130})
+        {
+            for (int cols : {1, 5, 16, 65, 200})
+            {
+                Matrix a(rows, cols);
+                for (int i = 0; i < rows; ++i)
+                    for (int j = 0; j < cols; ++j)
+                        a.set(i, j, i * 1000.0 + j);
+                Matrix t = a.transpose();
+                assert(t.numRows() == cols && t.numCols() == rows);
+                for (int i = 0; i < rows; ++i)
+                    for (int j = 0; j < cols; ++j)
+                        assert(t.get(j, i) == a.get(i, j));
+            }
+        }
+
+        // Between blocks of larger matrices, the rest of the output is left untouched.
+        Matrix a(70, 90), out(100, 80);
+        for (int i = 0; i < 70; ++i)
+            for (int j = 0; j < 90; ++j)
+                a.set(i, j, i - 0.5 * j);
+        out.fill(-1.0);
+        transpose_into(a.block(3, 7, 66, 75), out.block(10, 4, 75, 66));
+        for (int i = 0; i < 100; ++i)
+            for (int j = 0; j < 80; ++j)
+            {
+                bool inside = i >= 10 && i < 85 && j >= 4 && j < 70;
+                assert(out.get(i, j) == (inside ? a.get(j - 4 + 3, i - 10 + 7) : -1.0));
+            }
+    }
+
+    // --------------------------------------------------
+    // Test 19: Fixed-size matrices
+    // --------------------------------------------------
+    {
+        // Everything is constexpr, and the sizes are checked at compile time.
+        constexpr FixedMatrix<2, 2> a{1, 2, 3, 4};
+        constexpr FixedMatrix<2, 3> b{1, 0, -1, 2, 1, 0};
+        constexpr FixedMatrix<2, 3> ab = a * b;
+        static_assert(ab.get(0, 0) == 5 && ab.get(0, 2) == -1 && ab.get(1, 1) == 4, "FixedMatrix product");
+        static_assert((a + a * 2.0).get(1, 0) == 9 && (a - a).get(0, 1) == 0, "FixedMatrix element-wise");
+        static_assert(b.transpose().get(2, 0) == -1 && b.transpose().numRows() == 3, "FixedMatrix transpose");
+
+        FixedMatrix<2, 2> c = a;
+        c += a;
+        c *= 0.5;
+        c.axpy(-1.0, a);
+        for (int i = 0; i < 2; ++i)
+            for (int j = 0; j < 2; ++j)
+                assert(c.get(i, j) == 0.0);
+        FixedMatrix<1, 2> s = FixedMatrix<1, 2>{0.0, 1.0}.apply(Sigmoid());
+        assert(s.get(0, 0) == 0.5 && almostEqual(s.get(0, 1), Sigmoid()(1.0), 1e-15));
+
+        // No allocation from the pool.
+        long allocations = pool_stats().allocations;
+        FixedMatrix<4, 4> m;
+        for (int i = 0; i < 4; ++i)
+            m.set(i, i, i + 1.0);
+        FixedMatrix<4, 1> v{1, 1, 1, 1};
+        FixedMatrix<4, 1> mv = m * v + v;
+        assert(pool_stats().allocations == allocations);
+        assert(mv.get(3, 0) == 5.0);
+
+        // Interoperation with Matrix: GEMM on views, expressions and conversions.
+        Matrix w(3, 4);
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j)
+                w.set(i, j, i + 0.25 * j);
+        FixedMatrix<3, 1> y;
+        Matrix::gemm(false, false, 1.0, w, mv.view(), 0.0, y.view());
+        Matrix y_expected = w * mv.view();
+        Matrix y_sum = Matrix(y.view()) + y.view();
+        for (int i = 0; i < 3; ++i)
+        {
+            assert(almostEqual(y.get(i, 0), y_expected.get(i, 0), 1e-12));
+            assert(y_sum.get(i, 0) == 2.0 * y.get(i, 0));
+        }
+        FixedMatrix<3, 4> wf(w);
+        assert(wf.get(2, 3) == w.get(2, 3));
+        bool thrown = false;
+        try
+        {
+            FixedMatrix<4, 3> wrong(w);
+        }
+        catch (const std::invalid_argument &)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    // --------------------------------------------------
+    // Test 20: Reduced precision matrices
+    // --------------------------------------------------
+    {
+        // bfloat16 rounds to nearest, ties to even, with the range of float.
+        assert(float(bfloat16(1.0f + 0x1p-8f)) == 1.0f);
+        assert(float(bfloat16(1.0f + 0x1p-7f + 0x1p-8f)) == 1.0f + 0x1p-6f);
+        assert(float(bfloat16(-3.0f)) == -3.0f && float(bfloat16(1e30f)) > 9.9e29f);
+        assert(std::isinf(float(bfloat16(std::numeric_limits<float>::max()))));
+        assert(std::isnan(float(bfloat16(std::numeric_limits<float>::quiet_NaN()))));
+
+        std::mt19937 gen(7);
+        std::uniform_real_distribution<double> dis(-1.0, 1.0);
+        Matrix a(37, 29), b(29, 41);
+        for (int i = 0; i < a.numRows(); ++i)
+            for (int j = 0; j < a.numCols(); ++j)
+                a.set(i, j, dis(gen));
+        for (int i = 0; i < b.numRows(); ++i)
+            for (int j = 0; j < b.numCols(); ++j)
+                b.set(i, j, dis(gen));
+
+        // Conversions: float then bfloat16 keep 24 and 8 significant bits.
+        FloatMatrix a32(a);
+        BF16Matrix a16(a32);
+        Matrix back32(a32), back16(a16);
+        for (int i = 0; i < a.numRows(); ++i)
+            for (int j = 0; j < a.numCols(); ++j)
+            {
+                assert(back32.get(i, j) == static_cast<float>(a.get(i, j)));
+                assert(std::fabs(back16.get(i, j) - a.get(i, j)) <= 0x1p-8 * std::fabs(a.get(i, j)));
+                assert(a16.get(i, j) == float(bfloat16(a32.view().data()[i * a.numCols() + j])));
+            }
+        convert(a16, a32); // reuses the storage of a32
+        assert(a32.get(3, 4) == a16.get(3, 4));
+        convert(a, a32);
+
+        // Products (accumulated in float), with and without transposed operands.
+        FloatMatrix b32(b);
+        BF16Matrix b16(b);
+        Matrix c = a * b;
+        FloatMatrix c32 = a32 * b32;
+        BF16Matrix c16 = a16 * b16;
+        FloatMatrix ct32(b.numCols(), a.numRows());
+        FloatMatrix::gemm(true, true, 1.0, b32, a32, 0.0, ct32);
+        for (int i = 0; i < c.numRows(); ++i)
+            for (int j = 0; j < c.numCols(); ++j)
+            {
+                assert(almostEqual(c32.get(i, j), c.get(i, j), 1e-5));
+                assert(ct32.get(j, i) == c32.get(i, j));
+                assert(almostEqual(c16.get(i, j), c.get(i, j), 0.1));
+            }
+        bool thrown = false;
+        try
+        {
+            FloatMatrix::gemm(false, false, 1.0, a32.block(0, 0, 29, 29), a32.colRange(0, 29), 0.0, a32.block(0, 0, 29, 29));
+        }
+        catch (const std::invalid_argument &)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+
+        // Element-wise expressions, activations and transpose.
+        FloatMatrix d32 = a32 * 2.0 - a32;
+        d32 += hadamard(a32, a32);
+        FloatMatrix s32 = a32.apply(Sigmoid());
+        FloatMatrix g32(a32.numRows(), a32.numCols());
+        g32.activation_backward(Activation::Tanh, a32, d32);
+        FloatMatrix at32 = a32.transpose();
+        Matrix s = a.apply(Sigmoid());
+        for (int i = 0; i < a.numRows(); ++i)
+            for (int j = 0; j < a.numCols(); ++j)
+            {
+                double x = a32.get(i, j);
+                assert(d32.get(i, j) == static_cast<float>(x + x * x));
+                assert(almostEqual(s32.get(i, j), s.get(i, j), 1e-6));
+                assert(almostEqual(g32.get(i, j), d32.get(i, j) * TanhDerivative()(x), 1e-6));
+                assert(at32.get(j, i) == a32.get(i, j));
+            }
+
+        // The float GEMM over several blocks of depth (k > 256), accumulating into a block, and
+        // bfloat16 operands converted by its packing.
+        Matrix p(70, 300), q(45, 300);
+        for (int i = 0; i < p.numRows(); ++i)
+            for (int j = 0; j < p.numCols(); ++j)
+                p.set(i, j, dis(gen));
+        for (int i = 0; i < q.numRows(); ++i)
+            for (int j = 0; j < q.numCols(); ++j)
+                q.set(i, j, dis(gen));
+        Matrix pq = p * q.transpose();
+        FloatMatrix p32(p), q32(q), acc32(72, 50);
+        acc32.fill(1.0);
+        FloatMatrix::gemm(false, true, 2.0, p32, q32, 0.5, acc32.block(1, 2, 70, 45));
+        BF16Matrix p16(p), q16(q), pq16(70, 45);
+        BF16Matrix::gemm(false, true, 1.0, p16, q16, 0.0, pq16);
+        for (int i = 0; i < 72; ++i)
+            for (int j = 0; j < 50; ++j)
+            {
+                bool inside = i >= 1 && i < 71 && j >= 2 && j < 47;
+                double expected = inside ? 0.5 + 2.0 * pq.get(i - 1, j - 2) : 1.0;
+                assert(std::fabs(acc32.get(i, j) - expected) < 1e-4);
+                if (inside)
+                    assert(std::fabs(pq16.get(i - 1, j - 2) - pq.get(i - 1, j - 2)) < 0.05 * std::sqrt(300.0));
+            }
+
+        // sub_mul and the activations of bfloat16 go through float.
+        BF16Matrix w16(a16), s16 = a16.apply(Sigmoid());
+        w16.sub_mul(0.5, a16);
+        for (int i = 0; i < a.numRows(); ++i)
+            for (int j = 0; j < a.numCols(); ++j)
+            {
+                double x = a16.get(i, j);
+                assert(w16.get(i, j) == double(float(bfloat16(static_cast<float>(0.5 * x)))));
+                assert(std::fabs(s16.get(i, j) - Sigmoid()(x)) <= 0x1p-8);
+            }
+
+        // Expressions reading the destination transposed go through a temporary, as for Matrix.
+        FloatMatrix sq32(4, 4), ns32(2, 3);
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                sq32.set(i, j, 4.0 * i + j);
+        for (int i = 0; i < 2; ++i)
+            for (int j = 0; j < 3; ++j)
+                ns32.set(i, j, 3.0 * i + j);
+        sq32 = sq32.view().transpose() + sq32;
+        ns32 = ns32.view().transpose() * 2.0;
+        assert(ns32.numRows() == 3 && ns32.numCols() == 2);
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                assert(sq32.get(i, j) == 4.0 * (i + j) + i + j);
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 2; ++j)
+                assert(ns32.get(i, j) == 2.0 * (3.0 * j + i));
+
+        // Float exp: within 1 ulp of expf in Precise mode, NaN propagates.
+        std::vector<float> xf(1000), yf(1000);
+        for (int i = 0; i < 1000; ++i)
+            xf[i] = -87.0f + 0.175f * i;
+        xf[999] = std::numeric_limits<float>::quiet_NaN();
+        simd().exp_f32[static_cast<int>(MathMode::Precise)](1000, xf.data(), yf.data());
+        for (int i = 0; i < 999; ++i)
+        {
+            float ref = std::exp(xf[i]);
+            assert(std::fabs(yf[i] - ref) <= std::nextafter(ref, INFINITY) - ref);
+        }
+        assert(std::isnan(yf[999]));
+
+        // The MLP in float computes the same function as the one it was converted from, and trains.
+        MLP model(2, 16, 1, 1.0);
+        BasicMLP<float> model32(model);
+        BasicDataset<float> xor32;
+        for (int k = 0; k < 4; ++k)
+        {
+            xor32.X.push_back(BasicNode<float>(2, 1));
+            xor32.X.back().set(0, 0, k / 2);
+            xor32.X.back().set(1, 0, k % 2);
+            xor32.Y.push_back(BasicNode<float>(1, 1));
+            xor32.Y.back().set(0, 0, (k / 2) ^ (k % 2));
+        }
+        for (size_t k = 0; k < xor32.X.size(); ++k)
+        {
+            Node x(Matrix(*xor32.X[k].values));
+            assert(almostEqual(model32.forward(xor32.X[k])->get(0, 0), model.forward(x)->get(0, 0), 1e-5));
+        }
+        auto loss = [&]()
+        {
+            double total = 0.0;
+            for (size_t k = 0; k < xor32.X.size(); ++k)
+                total += binary_cross_entropy(*model32.forward(xor32.X[k]), xor32.Y[k])->get(0, 0);
+            clear_nodes();
+            return total;
+        };
+        double before = loss();
+        model32.train(xor32, 200);
+        assert(loss() < before);
+    }
+
+    // --------------------------------------------------
+    // Test 21: Mixed-precision training
+    // --------------------------------------------------
+    {
+        Dataset xor_data;
+        for (int k = 0; k < 4; ++k)
+        {
+            xor_data.X.push_back(Node(2, 1));
+            xor_data.X.back().set(0, 0, k / 2);
+            xor_data.X.back().set(1, 0, k % 2);
+            xor_data.Y.push_back(Node(1, 1));
+            xor_data.Y.back().set(0, 0, (k / 2) ^ (k % 2));
+        }
+        auto outputs = [&](MLP &model)
+        {
+            std::vector<double> y;
+            for (Node &x : xor_data.X)
+                y.push_back(model.forward(x)->get(0, 0));
+            clear_nodes();
+            return y;
+        };
+
+        // Scaling the loss by a power of two does not change anything, the scale is exact.
+        BasicMLP<float> init(MLP(2, 16, 1, 0.5));
+        MLP unscaled(init), scaled(init), skipped(init), dynamic(init);
+        std::vector<double> y0 = outputs(unscaled);
+        unscaled.train(xor_data, 20, MixedPrecision{Precision::Float, 1.0, false});
+        scaled.train(xor_data, 20, MixedPrecision{Precision::Float, 1024.0, false});
+        assert(outputs(scaled) == outputs(unscaled));
+
+        // Gradients that overflow (2^140 is past the range of float) are an error with a static
+        // scale, before any update, unless the dynamic loss scale brings the scale back in range.
+        bool thrown = false;
+        try
+        {
+            skipped.train(xor_data, 20, MixedPrecision{Precision::Float, std::ldexp(1.0, 140), false});
+        }
+        catch (const std::runtime_error &)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+        assert(outputs(skipped) == y0);
+        for (double bad : {0.0, -1.0, std::numeric_limits<double>::infinity()})
+        {
+            thrown = false;
+            try
+            {
+                skipped.train(xor_data, 1, MixedPrecision{Precision::Float, bad, true});
+            }
+            catch (const std::invalid_argument &)
+            {
+                thrown = true;
+            }
+            assert(thrown);
+        }
+        dynamic.train(xor_data, 20, MixedPrecision{Precision::Float, std::ldexp(1.0, 140), true});
+        std::vector<double> y_dynamic = outputs(dynamic);
+        assert(y_dynamic != y0);
+        for (double y : y_dynamic)
+            assert(std::isfinite(y));
+
+        // XOR converges with the forward and backward passes in bfloat16.
+        MLP model(2, 128, 1, 0.2);
+        model.train(xor_data, 1000, MixedPrecision{Precision::BFloat16, 1024.0, true});
+        std::vector<double> y = outputs(model);
+        for (int k = 0; k < 4; ++k)
+            assert(std::fabs(y[k] - xor_data.Y[k].get(0, 0)) < 0.2);
+    }
+
+    // --------------------------------------------------
+    // Test 22: Int8 quantisation
+    // --------------------------------------------------
+    {
+        // gemm_s8 against a plain loop, with a depth that is not a multiple of any register.
+        std::mt19937 gen(22);
+        std::uniform_int_distribution<int> byte(-127, 127);
+        const int m = 3, n = 5, k = 100;
+        std::vector<std::int8_t> a(m * k), b(n * k);
+        for (std::int8_t &x : a)
+            x = static_cast<std::int8_t>(byte(gen));
+        for (std::int8_t &x : b)
+            x = static_cast<std::int8_t>(byte(gen));
+        a[0] = b[0] = 127;
+        a[1] = b[1] = -127;
+        std::vector<std::int32_t> c(m * n);
+        simd().gemm_s8(m, n, k, a.data(), k, b.data(), k, c.data(), n);
+        for (int i = 0; i < m; ++i)
+            for (int j = 0; j < n; ++j)
+            {
+                std::int32_t expected = 0;
+                for (int p = 0; p < k; ++p)
+                    expected += a[i * k + p] * b[j * k + p];
+                assert(c[i * n + j] == expected);
+            }
+
+        // One scale per row, the largest element of a row maps to +-127.
+        std::uniform_real_distribution<double> dis(-1.0, 1.0);
+        Matrix W(37, 100), x(100, 3);
+        for (int i = 0; i < 37; ++i)
+            for (int j = 0; j < 100; ++j)
+                W.set(i, j, dis(gen) * (i + 1));
+        for (int j = 0; j < 100; ++j)
+            W.set(36, j, 0.0);
+        for (int i = 0; i < 100; ++i)
+            for (int j = 0; j < 3; ++j)
+                x.set(i, j, dis(gen));
+        QuantizedMatrix Wq(W.view());
+        assert(Wq.numRows() == 37 && Wq.numCols() == 100);
+        assert(Wq.bytes() == 37 * 100 + 37 * sizeof(float));
+        assert(Wq.scale(36) == 0.0f && Wq.get(36, 0) == 0.0);
+        for (int i = 0; i < 36; ++i)
+        {
+            int max_q = 0;
+            for (int j = 0; j < 100; ++j)
+            {
+                max_q = std::max(max_q, std::abs(static_cast<int>(Wq.quantized(i, j))));
+                assert(std::fabs(Wq.get(i, j) - W.get(i, j)) <= 0.5001 * Wq.scale(i));
+            }
+            assert(max_q == 127);
+        }
+
+        // y = W x within the rounding of W and x (see quantized_matrix.hpp).
+        Matrix y(37, 3), y_ref = W * x;
+        Wq.multiply(x, y);
+        for (int i = 0; i < 37; ++i)
+            for (int j = 0; j < 3; ++j)
+            {
+                double w_norm = 0.0, x_norm = 0.0, x_max = 0.0;
+                for (int p = 0; p < 100; ++p)
+                {
+                    w_norm += std::fabs(W.get(i, p));
+                    x_norm += std::fabs(x.get(p, j));
+                    x_max = std::max(x_max, std::fabs(x.get(p, j)));
+                }
+                double bound = 0.5 * (w_norm * x_max / 127 + x_norm * Wq.scale(i)) * 1.01 + 1e-12;
+                assert(std::fabs(y.get(i, j) - y_ref.get(i, j)) <= bound);
+            }
+        bool thrown = false;
+        try
+        {
+            Matrix bad(99, 1), z(37, 1);
+            Wq.multiply(bad, z);
+        }
+        catch (const std::invalid_argument &)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+
+        // The quantised MLP gives the outputs of the MLP up to about 1%, on a batch of samples.
+        MLP model(2, 64, 1, 0.5);
+        Matrix batch(2, 4);
+        for (int k = 0; k < 4; ++k)
+        {
+            batch.set(0, k, k / 2);
+            batch.set(1, k, k % 2);
+        }
+        thrown = false;
+        try
+        {
+            model.forward_quantized(batch);
+        }
+        catch (const std::runtime_error &)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+        model.quantize();
+        Matrix out = model.forward_quantized(batch);
+        assert(out.numRows() == 1 && out.numCols() == 4);
+        for (int k = 0; k < 4; ++k)
+        {
+            Node input(batch.colRange(k, 1));
+            assert(std::fabs(out.get(0, k) - model.forward(input)->get(0, 0)) < 0.01);
+        }
+        clear_nodes();
+    }
+
+    // --------------------------------------------------
+    // Test 23: Sparse matrices
+    // --------------------------------------------------
+    {
+        // A 40 x 30 matrix with about 5% of non-zeros, in both formats.
+        std::mt19937 gen(23);
+        std::uniform_real_distribution<double> dis(-1.0, 1.0), unit(0.0, 1.0);
+        Matrix dense(40, 30);
+        for (int i = 0; i < 40; ++i)
+            for (int j = 0; j < 30; ++j)
+                if (unit(gen) < 0.05)
+                    dense.set(i, j, dis(gen));
+        dense.set(39, 29, 2.0);
+        SparseMatrix csr(dense), csc(dense, SparseMatrix::Format::CSC);
+        assert(csr.nonZeros() == csc.nonZeros() && csr.nonZeros() < 120);
+        assert(csr.getOffsets().size() == 41 && csc.getOffsets().size() == 31);
+        for (int i = 0; i < 40; ++i)
+            for (int j = 0; j < 30; ++j)
+                assert(csr.get(i, j) == dense.get(i, j) && csc.get(i, j) == dense.get(i, j));
+        SparseMatrix converted = csr.toFormat(SparseMatrix::Format::CSC);
+        assert(converted.getIndices() == csc.getIndices() && converted.getValues() == csc.getValues());
+        AbstractMatrix &abstract = csc;
+        assert(abstract.numRows() == 40 && abstract.get(39, 29) == 2.0);
+
+        // Entries are summed at the same position, `set` inserts and overwrites.
+        SparseMatrix entries(3, 3, {{2, 1, 1.0}, {0, 2, 2.0}, {2, 1, 0.5}, {0, 0, -1.0}});
+        assert(entries.nonZeros() == 3 && entries.get(2, 1) == 1.5 && entries.get(0, 0) == -1.0);
+        entries.set(1, 1, 4.0);
+        entries.set(0, 2, 3.0);
+        assert(entries.nonZeros() == 4 && entries.get(1, 1) == 4.0 && entries.get(0, 2) == 3.0);
+        Matrix back(3, 3);
+        entries.toDense(back);
+        assert(back.get(2, 1) == 1.5 && back.get(1, 1) == 4.0 && back.get(1, 0) == 0.0);
+
+        // Every product against the dense one, in both formats, with alpha and beta.
+        Matrix left(7, 40), right(30, 9), left_t(7, 30), right_t(40, 9);
+        for (Matrix *m : {&left, &right, &left_t, &right_t})
+            for (int i = 0; i < m->numRows(); ++i)
+                for (int j = 0; j < m->numCols(); ++j)
+                    m->set(i, j, dis(gen));
+        auto close = [](const Matrix &a, const Matrix &b)
+        {
+            for (int i = 0; i < a.numRows(); ++i)
+                for (int j = 0; j < a.numCols(); ++j)
+                    if (std::fabs(a.get(i, j) - b.get(i, j)) > 1e-12)
+                        return false;
+            return true;
+        };
+        for (const SparseMatrix *S : {&csr, &csc})
+        {
+            Matrix c(40, 9), c_ref(40, 9);
+            c.fill(1.0);
+            c_ref.fill(1.0);
+            spmm(false, 2.0, *S, right, 0.5, c);
+            Matrix::gemm(false, false, 2.0, dense, right, 0.5, c_ref);
+            assert(close(c, c_ref));
+
+            Matrix ct(30, 9), ct_ref(30, 9);
+            spmm(true, 1.0, *S, right_t, 0.0, ct);
+            Matrix::gemm(true, false, 1.0, dense, right_t, 0.0, ct_ref);
+            assert(close(ct, ct_ref));
+
+            Matrix d(7, 30), d_ref(7, 30);
+            d.fill(1.0);
+            d_ref.fill(1.0);
+            spmm(-1.0, left, false, *S, 1.0, d);
+            Matrix::gemm(false, false, -1.0, left, dense, 1.0, d_ref);
+            assert(close(d, d_ref));
+
+            Matrix dt(7, 40), dt_ref(7, 40);
+            spmm(1.0, left_t, true, *S, 0.0, dt);
+            Matrix::gemm(false, true, 1.0, left_t, dense, 0.0, dt_ref);
+            assert(close(dt, dt_ref));
+        }
+        bool thrown = false;
+        try
+        {
+            Matrix wrong(8, 9);
+            spmm(false, 1.0, csr, right, 0.0, wrong);
+        }
+        catch (const std::invalid_argument &)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+
+        // W * sparse input: same values and weight gradient as with the dense input.
+        Node W(5, 40);
+        for (int i = 0; i < 5; ++i)
+            for (int j = 0; j < 40; ++j)
+                W.set(i, j, dis(gen));
+        Matrix input = dense.colRange(0, 6);
+        Node x_dense(input), x_sparse(SparseMatrix(input, SparseMatrix::Format::CSC));
+        assert(x_sparse.get(39, 0) == input.get(39, 0));
+        Node *y_dense = W * x_dense;
+        Node *y_sparse = W * x_sparse;
+        assert(close(*y_sparse->values, *y_dense->values));
+        y_dense->grads->fill(1.0);
+        y_dense->backward();
+        Matrix grad_dense = *W.grads;
+        W.zero_grad();
+        y_sparse->grads->fill(1.0);
+        y_sparse->backward();
+        assert(close(*W.grads, grad_dense));
+        clear_nodes();
+    }
+
+    // --------------------------------------------------
+    // Test 24: Strassen-Winograd products
+    // --------------------------------------------------
+    {
+        std::mt19937 gen(24);
+        auto max_diff = [](const Matrix &a, const Matrix &b)
+        {
+            assert(a.numRows() == b.numRows() && a.numCols() == b.numCols());
+            double err = 0.0;
+            for (int i = 0; i < a.numRows(); ++i)
+                for (int j = 0; j < a.numCols(); ++j)
+                    err = std::max(err, std::fabs(a.get(i, j) - b.get(i, j)));
+            return err;
+        };
+        const int previous = strassen_crossover();
+
+        // Odd sizes at several levels of the recursion, plain and transposed operands.
+        Matrix a = randomMatrix(83, 70, gen), b = randomMatrix(70, 97, gen);
+        Matrix at = randomMatrix(70, 83, gen), bt = randomMatrix(97, 70, gen);
+        set_strassen_crossover(0);
+        Matrix c_ref = a * b, ct_ref = at.transpose() * bt.transpose(), cb_ref = a * b.colRange(3, 40);
+        set_strassen_crossover(8);
+        assert(max_diff(a * b, c_ref) < 1e-12);
+        assert(max_diff(at.transpose() * bt.transpose(), ct_ref) < 1e-12);
+        assert(max_diff(a * b.colRange(3, 40), cb_ref) < 1e-12);
+
+        // Below the crossover the product is the blocked GEMM, bit for bit.
+        set_strassen_crossover(71);
+        Matrix small = a * b;
+        for (int i = 0; i < small.numRows(); ++i)
+            for (int j = 0; j < small.numCols(); ++j)
+                assert(small.get(i, j) == c_ref.get(i, j));
+
+        // Directly into a block of a larger matrix (leading dimension != number of columns).
+        Matrix big(100, 120);
+        big.fill(5.0);
+        dgemm_strassen(false, false, 83, 97, 70, a.view().data(), 70, b.view().data(), 97,
+                       big.block(10, 20, 83, 97).data(), 120, 16);
+        assert(max_diff(Matrix(big.block(10, 20, 83, 97)), c_ref) < 1e-12);
+        assert(big.get(9, 20) == 5.0 && big.get(10, 19) == 5.0 && big.get(93, 117) == 5.0);
+
+        set_strassen_crossover(-3);
+        assert(strassen_crossover() == 0);
+        set_strassen_crossover(previous);
+    }
+
+    // --------------------------------------------------
+    // Test 25: Batched products
+    // --------------------------------------------------
+    {
+        std::mt19937 gen(25);
+        std::uniform_real_distribution<double> dis(-1.0, 1.0);
+        auto close = [](double x, double y) { return std::fabs(x - y) <= 1e-12 * (1.0 + std::fabs(y)); };
+
+        // Against Matrix::gemm sample by sample, with an odd batch (the last lanes are not a full
+        // register), transposed operands, a broadcast operand and alpha / beta.
+        const int batch = 37;
+        std::vector<Matrix> a, at, b, c;
+        std::vector<ConstMatrixView> a_views, at_views, b_views, c_views;
+        for (int s = 0; s < batch; ++s)
+        {
+            a.push_back(randomMatrix(5, 3, gen));
+            at.push_back(randomMatrix(3, 5, gen));
+            b.push_back(randomMatrix(3, 4, gen));
+            c.push_back(randomMatrix(5, 4, gen));
+        }
+        for (int s = 0; s < batch; ++s)
+        {
+            a_views.push_back(a[s]);
+            at_views.push_back(at[s]);
+            b_views.push_back(b[s]);
+            c_views.push_back(c[s]);
+        }
+        BatchedMatrix A(a_views), At(at_views), B(b_views), C(c_views), Ct(c_views);
+        Matrix shared = randomMatrix(5, 3, gen);
+        BatchedMatrix Cs(batch, 5, 4);
+        batched_gemm(false, false, 2.0, A, B, 0.5, C);
+        batched_gemm(true, false, 1.0, At, B, 0.0, Ct);
+        batched_gemm(false, false, 1.0, shared.view(), B, 0.0, Cs);
+        for (int s = 0; s < batch; ++s)
+        {
+            Matrix ref = c[s], ref_t(5, 4), ref_s(5, 4), out(5, 4);
+            Matrix::gemm(false, false, 2.0, a[s], b[s], 0.5, ref);
+            Matrix::gemm(true, false, 1.0, at[s], b[s], 0.0, ref_t);
+            Matrix::gemm(false, false, 1.0, shared, b[s], 0.0, ref_s);
+            C.extract(s, out);
+            for (int i = 0; i < 5; ++i)
+                for (int j = 0; j < 4; ++j)
+                    assert(close(out.get(i, j), ref.get(i, j)) && close(Ct.get(s, i, j), ref_t.get(i, j)) &&
+                           close(Cs.get(s, i, j), ref_s.get(i, j)));
+        }
+
+        // Into a single matrix: the sum over a batch of several chunks of lanes.
+        const int big = 600;
+        BatchedMatrix X(big, 3, 1), G(big, 5, 1);
+        Matrix sum(5, 3), sum_ref(5, 3);
+        sum.fill(1.0);
+        sum_ref.fill(1.0);
+        for (int s = 0; s < big; ++s)
+            for (int i = 0; i < 5; ++i)
+            {
+                G.set(s, i, 0, dis(gen));
+                if (i < 3)
+                    X.set(s, i, 0, dis(gen));
+            }
+        batched_gemm(false, true, 1.0, G, X, 1.0, sum.view());
+        for (int s = 0; s < big; ++s)
+            for (int i = 0; i < 5; ++i)
+                for (int j = 0; j < 3; ++j)
+                    sum_ref.set(i, j, sum_ref.get(i, j) + G.get(s, i, 0) * X.get(s, j, 0));
+        for (int i = 0; i < 5; ++i)
+            for (int j = 0; j < 3; ++j)
+                assert(std::fabs(sum.get(i, j) - sum_ref.get(i, j)) < 1e-10);
+
+        bool thrown = false;
+        try
+        {
+            BatchedMatrix wrong(batch + 1, 5, 4);
+            batched_gemm(false, false, 1.0, A, B, 0.0, wrong);
+        }
+        catch (const std::invalid_argument &)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+
+        // Autograd: z_b = v_b * (W * x_b) on a batch, against one graph per sample.
+        const int samples = 50;
+        Node W(6, 2);
+        for (int i = 0; i < 6; ++i)
+            for (int j = 0; j < 2; ++j)
+                W.set(i, j, dis(gen));
+        BatchedNode x(samples, 2, 1), v(samples, 1, 6);
+        for (int s = 0; s < samples; ++s)
+        {
+            for (int j = 0; j < 2; ++j)
+                x.values->set(s, j, 0, dis(gen));
+            for (int j = 0; j < 6; ++j)
+                v.values->set(s, 0, j, dis(gen));
+        }
+        BatchedNode *h = W * x;
+        BatchedNode *z = v * *h;
+        z->grads->fill(1.0);
+        z->backward();
+        Matrix W_grads = *W.grads;
+        W.zero_grad();
+        for (int s = 0; s < samples; ++s)
+        {
+            Node xs(2, 1), vs(1, 6);
+            for (int j = 0; j < 2; ++j)
+                xs.set(j, 0, x.get(s, j, 0));
+            for (int j = 0; j < 6; ++j)
+                vs.set(0, j, v.get(s, 0, j));
+            Node *hs = W * xs;
+            Node *zs = vs * *hs;
+            assert(close(z->get(s, 0, 0), zs->get(0, 0)));
+            zs->grads->fill(1.0);
+            zs->backward();
+            for (int j = 0; j < 2; ++j)
+                assert(close(x.grads->get(s, j, 0), xs.grads->get(j, 0)));
+            for (int j = 0; j < 6; ++j)
+                assert(close(v.grads->get(s, 0, j), vs.grads->get(0, j)));
+        }
+        for (int i = 0; i < 6; ++i)
+            for (int j = 0; j < 2; ++j)
+                assert(std::fabs(W_grads.get(i, j) - W.grads->get(i, j)) < 1e-12);
+        clear_nodes();
+    }
+
+    // --------------------------------------------------
+    // Test 26: Arena of the graph
+    // --------------------------------------------------
+    {
+        // Objects are destroyed by reset, last created first, and the blocks are reused.
+        Arena arena(256);
+        std::vector<int> destroyed;
+        struct Tracked
+        {
+            std::vector<int> *log;
+            int id;
+            ~Tracked() { log->push_back(id); }
+        };
+        for (int id = 0; id < 3; ++id)
+            arena.create<Tracked>(Tracked{&destroyed, id});
+        destroyed.clear(); // the temporaries passed to create
+        double *big = static_cast<double *>(arena.allocate(1000 * sizeof(double), 64));
+        assert(reinterpret_cast<std::uintptr_t>(big) % 64 == 0);
+        big[999] = 1.0;
+        const size_t capacity = arena.capacity();
+        assert(arena.bytesUsed() > 1000 * sizeof(double));
+        arena.reset();
+        assert(destroyed.size() == 3 && destroyed[0] == 2 && destroyed[2] == 0);
+        assert(arena.bytesUsed() == 0);
+        arena.allocate(1000 * sizeof(double), 64);
+        assert(arena.capacity() == capacity);
+
+        // Training steps: after the first one, the graph no longer allocates arena blocks.
+        MLP model(2, 16, 1, 0.1);
+        model.setGraphCapture(false);
+        Dataset data;
+        Matrix x(2, 1), y(1, 1);
+        x.set(0, 0, 1.0);
+        y.set(0, 0, 1.0);
+        data.X.push_back(Node(x));
+        data.Y.push_back(Node(y));
+        model.train(data, 1);
+        const size_t step_capacity = node_arena.capacity();
+        assert(all_nodes.empty() && node_arena.bytesUsed() == 0);
+        model.train(data, 10);
+        assert(node_arena.capacity() == step_capacity);
+
+        // The weights outlive the graph that used them.
+        Node W(1, 2);
+        W.set(0, 0, 2.0);
+        Node input(x);
+        Node *out = W * input;
+        assert(out->get(0, 0) == 2.0);
+        out->grads->fill(1.0);
+        out->backward();
+        clear_nodes();
+        assert(W.grads->get(0, 0) == 1.0 && W.values->get(0, 0) == 2.0);
+    }
+
+    // --------------------------------------------------
+    // Test 27: Backward pass through shared nodes
+    // --------------------------------------------------
+    {
+        // y = x * x, z = y + y: dz/dx = 4x, each backward_op running once.
+        Node x(1, 1);
+        x.set(0, 0, 3.0);
+        Node *y = x * x;
+        Node *z = *y + *y;
+        z->grads->fill(1.0);
+        z->backward();
+        assert(y->grads->get(0, 0) == 2.0);
+        assert(x.grads->get(0, 0) == 12.0);
+        clear_nodes();
+
+        // 60 doublings w = w + w: 2^60 paths from the last node to x, but 60 backward steps.
+        Node leaf(1, 1);
+        leaf.set(0, 0, 1.0);
+        Node *w = &leaf;
+        for (int k = 0; k < 60; ++k)
+        {
+            w = *w + *w;
+        }
+        assert(w->get(0, 0) == std::ldexp(1.0, 60));
+        w->grads->fill(1.0);
+        w->backward();
+        assert(leaf.grads->get(0, 0) == std::ldexp(1.0, 60));
+        clear_nodes();
+    }
+
+    // --------------------------------------------------
+    // Test 28: Capture and replay of a graph
+    // --------------------------------------------------
+    {
+        Node W(3, 2), b(3, 1), x(2, 1), t(3, 1);
+        for (int i = 0; i < 3; ++i)
+        {
+            W.set(i, 0, 0.5 - 0.3 * i);
+            W.set(i, 1, 0.2 * i - 0.1);
+            b.set(i, 0, 0.1 * i);
+            t.set(i, 0, i % 2);
+        }
+        auto build = [&]()
+        {
+            return binary_cross_entropy(*(*(W * x) + b)->sigmoid(), t);
+        };
+
+        Tape tape;
+        tape.begin();
+        Node *loss = build();
+        tape.end();
+        assert(all_nodes.empty() && !tape.empty());
+
+        // Replaying on new inputs gives the values and gradients of a graph built on them.
+        for (int step = 0; step < 3; ++step)
+        {
+            x.set(0, 0, 1.0 + step);
+            x.set(1, 0, -0.5 * step);
+
+            tape.forward();
+            loss->grads->set(0, 0, 1.0);
+            tape.backward();
+            const double replayed = loss->get(0, 0);
+            Matrix replayed_grads = *W.grads;
+            W.zero_grad();
+            b.zero_grad();
+
+            Node *expected = build();
+            expected->grads->set(0, 0, 1.0);
+            expected->backward();
+            assert(almostEqual(replayed, expected->get(0, 0), 1e-14));
+            for (int i = 0; i < 3; ++i)
+                for (int j = 0; j < 2; ++j)
+                    assert(almostEqual(replayed_grads.get(i, j), W.grads->get(i, j), 1e-14));
+            W.zero_grad();
+            b.zero_grad();
+            clear_nodes();
+        }
+
+        // The replay writes into the buffers of the nodes: once the first replay has made the
+        // packing buffers of the products, no step allocates from the pool, with user-defined and
+        // built-in activations and transposes, in double and in float.
+        auto steady = [](auto &W2, auto &x2, auto &t2)
+        {
+            Tape tape2;
+            tape2.begin();
+            auto *h = (W2 * x2)->apply([](double v) { return 0.5 * v; }, [](double) { return 0.5; });
+            auto *y = h->transpose()->apply(Tanh(), TanhDerivative())->transpose()->sigmoid();
+            auto *l = binary_cross_entropy(*y, t2);
+            tape2.end();
+            tape2.forward();
+            l->grads->set(0, 0, 1.0);
+            tape2.backward();
+            long allocations = pool_stats().allocations;
+            for (int step = 0; step < 3; ++step)
+            {
+                tape2.forward();
+                l->grads->set(0, 0, 1.0);
+                tape2.backward();
+                W2.zero_grad();
+            }
+            assert(pool_stats().allocations == allocations);
+        };
+        steady(W, x, t);
+        BasicNode<float> W32(*W.values), x32(*x.values), t32(*t.values);
+        steady(W32, x32, t32);
+    }
+
+    // --------------------------------------------------
+    // Test 29: Gradients of the sum and the difference, accumulated in place
+    // --------------------------------------------------
+    {
+        Node a(2, 2), b(2, 2);
+        a.grads->fill(0.5);
+        Node *sum = a + b;
+        Node *difference = a - b;
+        sum->grads->fill(1.0);
+        difference->grads->fill(2.0);
+        sum->backward();
+        difference->backward();
+        for (int i = 0; i < 2; ++i)
+        {
+            for (int j = 0; j < 2; ++j)
+            {
+                assert(a.grads->get(i, j) == 3.5);
+                assert(b.grads->get(i, j) == -1.0);
+            }
+        }
+        clear_nodes();
+    }
+
+    // --------------------------------------------------
+    // Test 30: Mini-batches of a column dataset
+    // --------------------------------------------------
+    {
+        // 10 samples of 2 features, the output of sample j is j.
+        Matrix X(2, 10), Y(1, 10);
+        for (int j = 0; j < 10; ++j)
+        {
+            X.set(0, j, j);
+            X.set(1, j, -j);
+            Y.set(0, j, j);
+        }
+        MiniBatchDataset data(X, Y, 4);
+        assert(data.numBatches() == 3 && data.batchColumns(0) == 4 && data.batchColumns(2) == 2);
+
+        // A shuffled epoch still gives every sample once, its input with its output.
+        std::mt19937 gen(42);
+        data.shuffle(gen);
+        std::vector<int> seen(10, 0);
+        for (int b = 0; b < data.numBatches(); ++b)
+        {
+            Matrix x(2, data.batchColumns(b)), y(1, data.batchColumns(b));
+            data.batch(b, x, y);
+            for (int k = 0; k < x.numCols(); ++k)
+            {
+                assert(x.get(1, k) == -x.get(0, k) && y.get(0, k) == x.get(0, k));
+                ++seen[static_cast<int>(y.get(0, k))];
+            }
+        }
+        assert(std::count(seen.begin(), seen.end(), 1) == 10);
+
+        // Broadcast bias: added to every column, its gradient is the sum of those of the columns.
+        Node z(X), bias(2, 1);
+        bias.set(0, 0, 0.5);
+        bias.set(1, 0, -1.0);
+        Node *out = z.add_bias(bias);
+        assert(out->get(0, 3) == 3.5 && out->get(1, 3) == -4.0);
+        out->grads->fill(1.0);
+        out->backward();
+        assert(bias.grads->get(0, 0) == 10.0 && bias.grads->get(1, 0) == 10.0 && z.grads->get(1, 7) == 1.0);
+        clear_nodes();
+
+        // XOR by mini-batches of 2 samples.
+        Matrix xor_x(2, 4), xor_y(1, 4);
+        for (int j = 0; j < 4; ++j)
+        {
+            xor_x.set(0, j, j / 2);
+            xor_x.set(1, j, j % 2);
+            xor_y.set(0, j, (j / 2) != (j % 2));
+        }
+        MiniBatchDataset xor_data(xor_x, xor_y, 2);
+        MLP model(2, 32, 1, 1.0);
+        model.train(xor_data, 3000);
+        Node input(xor_x);
+        Node *predicted = model.forward(input);
+        for (int j = 0; j < 4; ++j)
+            assert(std::fabs(predicted->get(0, j) - xor_y.get(0, j)) < 0.2);
+        clear_nodes();
+    }
+
     std::cout << "Matrix tests passed." << std::endl;
 
     test_mlp_training();
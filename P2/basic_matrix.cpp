@@ -0,0 +1,221 @@
+#include "basic_matrix.hpp"
+#include "gemm.hpp"
+#include "simd.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+// Reduced precision matrices (float and bfloat16), see basic_matrix.hpp.
+// Matrix (BasicMatrix<double>) is in matrix.cpp.
+
+namespace {
+
+// Sequential conversion of n elements, element by element in loops the compiler vectorises.
+template <class From, class To>
+void convert_block(const From *src, To *dst, int n) {
+    for (int k = 0; k < n; ++k) {
+        dst[k] = static_cast<To>(src[k]);
+    }
+}
+
+// float <-> bfloat16 through the vectorised kernels of simd.hpp.
+static_assert(sizeof(bfloat16) == sizeof(std::uint16_t), "bfloat16 is stored as its 16 bits");
+
+void convert_block(const float *src, bfloat16 *dst, int n) {
+    simd().float_to_bf16(n, src, reinterpret_cast<std::uint16_t *>(dst));
+}
+
+void convert_block(const bfloat16 *src, float *dst, int n) {
+    simd().bf16_to_float(n, reinterpret_cast<const std::uint16_t *>(src), dst);
+}
+
+// double -> bfloat16 rounds to float first (by blocks on the stack): rounding twice can only
+// differ from a direct rounding when the double lies within 2^-24 relative of the middle of two
+// bfloat16, which does not matter for training.
+void convert_block(const double *src, bfloat16 *dst, int n) {
+    float x[256];
+    for (int k = 0; k < n; k += 256) {
+        int len = std::min(256, n - k);
+        convert_block(src + k, x, len);
+        convert_block(x, dst + k, len);
+    }
+}
+
+template <class From, class To>
+void convert_parallel(const From *src, To *dst, int n) {
+    parallel_for(n, ELEMENTWISE_GRAIN, [&](int begin, int end) { convert_block(src + begin, dst + begin, end - begin); });
+}
+
+// Elements of bfloat16 converted to float per call of the activation kernels (on the stack).
+const int ACTIVATION_BLOCK = 256;
+
+// Runs a float kernel of simd.hpp on `n` elements of type T: directly on float, through blocks
+// of ACTIVATION_BLOCK elements converted on the stack for bfloat16. `in` holds the inputs of the
+// kernel, `out` its output (also read when `out_is_input`, as the accumulator of
+// activation_backward), and `call(len, inputs..., output)` runs it on float pointers.
+template <class T, int N, class Call>
+void float_blocks(int n, const T *const (&in)[N], T *out, bool out_is_input, Call call) {
+    parallel_for(n, ELEMENTWISE_GRAIN, [&](int begin, int end) {
+        if constexpr (std::is_same<T, float>::value) {
+            const float *x[N];
+            for (int a = 0; a < N; ++a) {
+                x[a] = in[a] + begin;
+            }
+            call(end - begin, x, out + begin);
+        } else {
+            float x[N][ACTIVATION_BLOCK], y[ACTIVATION_BLOCK];
+            for (int k = begin; k < end; k += ACTIVATION_BLOCK) {
+                int len = std::min(ACTIVATION_BLOCK, end - k);
+                const float *xp[N];
+                for (int a = 0; a < N; ++a) {
+                    convert_block(in[a] + k, x[a], len);
+                    xp[a] = x[a];
+                }
+                if (out_is_input) {
+                    convert_block(out + k, y, len);
+                }
+                call(len, xp, y);
+                convert_block(y, out + k, len);
+            }
+        }
+    });
+}
+
+} // namespace
+
+void convert(const double *src, float *dst, int n) { convert_parallel(src, dst, n); }
+void convert(const float *src, double *dst, int n) { convert_parallel(src, dst, n); }
+void convert(const double *src, bfloat16 *dst, int n) { convert_parallel(src, dst, n); }
+void convert(const bfloat16 *src, double *dst, int n) { convert_parallel(src, dst, n); }
+void convert(const float *src, bfloat16 *dst, int n) { convert_parallel(src, dst, n); }
+void convert(const bfloat16 *src, float *dst, int n) { convert_parallel(src, dst, n); }
+
+template <class T>
+BasicMatrix<T> BasicMatrix<T>::operator*(const BasicMatrix &other) const {
+    if (cols != other.rows) {
+        throw std::invalid_argument("Matrix dimensions do not match for multiplication");
+    }
+    BasicMatrix m(rows, other.cols);
+    gemm(false, false, 1.0, *this, other, 0.0, m);
+    return m;
+}
+
+// The blocked product of gemm.cpp, computed in float (sgemm).
+template <class T>
+void BasicMatrix<T>::gemm(bool transA, bool transB, double alpha, const_view_type A, const_view_type B,
+                          double beta, view_type C) {
+    const int m = transA ? A.numCols() : A.numRows();
+    const int k = transA ? A.numRows() : A.numCols();
+    const int n = transB ? B.numRows() : B.numCols();
+    if ((transB ? B.numCols() : B.numRows()) != k || C.numRows() != m || C.numCols() != n) {
+        throw std::invalid_argument("Matrix dimensions do not match for gemm");
+    }
+    if (views_overlap(C, A) || views_overlap(C, B)) {
+        throw std::invalid_argument("The output of gemm must not alias its operands");
+    }
+    sgemm(m, n, k, static_cast<float>(alpha), A.data(), transA ? 1 : A.stride(), transA ? A.stride() : 1, B.data(),
+          transB ? 1 : B.stride(), transB ? B.stride() : 1, static_cast<float>(beta), C.data(), C.stride());
+}
+
+template <class T>
+void BasicMatrix<T>::axpy(double alpha, const BasicMatrix &other) {
+    if (rows != other.rows || cols != other.cols) {
+        throw std::invalid_argument("Matrix dimensions do not match for axpy");
+    }
+    void (*kernel)(int, float, const float *, float *) = simd().axpy_f32;
+    const float a = static_cast<float>(alpha);
+    const T *in[1] = {other.data.data()};
+    float_blocks(rows * cols, in, data.data(), true,
+                 [&](int len, const float *const *x, float *y) { kernel(len, a, x[0], y); });
+}
+
+namespace {
+
+// By tiles of 64 x 64, as transpose_into for Matrix (without the SIMD kernel).
+template <class T>
+void transpose_tiles(BasicMatrixView<const T> a, BasicMatrixView<T> out) {
+    if (out.numRows() != a.numCols() || out.numCols() != a.numRows()) {
+        throw std::invalid_argument("Matrix dimensions do not match for transpose");
+    }
+    if (views_overlap(out, a)) {
+        throw std::invalid_argument("The output of transpose must not alias its input");
+    }
+    const int tile = 64;
+    const int rows = a.numRows(), cols = a.numCols();
+    const T *src = a.data();
+    T *dst = out.data();
+    const long lda = a.stride(), ldo = out.stride();
+    const int row_tiles = (rows + tile - 1) / tile;
+    parallel_for(row_tiles, std::max(1, elementwise_row_grain(cols) / tile), [&](int t0, int t1) {
+        for (int i0 = t0 * tile; i0 < std::min(rows, t1 * tile); i0 += tile) {
+            for (int j0 = 0; j0 < cols; j0 += tile) {
+                for (int i = i0; i < std::min(rows, i0 + tile); ++i) {
+                    for (int j = j0; j < std::min(cols, j0 + tile); ++j) {
+                        dst[j * ldo + i] = src[i * lda + j];
+                    }
+                }
+            }
+        }
+    });
+}
+
+} // namespace
+
+void transpose_into(BasicMatrixView<const float> a, BasicMatrixView<float> out) { transpose_tiles(a, out); }
+void transpose_into(BasicMatrixView<const bfloat16> a, BasicMatrixView<bfloat16> out) { transpose_tiles(a, out); }
+
+template <class T>
+BasicMatrix<T> BasicMatrix<T>::transpose() const {
+    BasicMatrix t(cols, rows);
+    transpose_into(view(), t.view());
+    return t;
+}
+
+// The float kernels of simd.hpp (float_blocks above).
+template <class T>
+BasicMatrix<T> BasicMatrix<T>::activation(Activation f, MathMode mode) const {
+    BasicMatrix m(rows, cols);
+    activation_into(f, mode, false, m);
+    return m;
+}
+
+template <class T>
+BasicMatrix<T> BasicMatrix<T>::activation_derivative(Activation f, MathMode mode) const {
+    BasicMatrix m(rows, cols);
+    activation_into(f, mode, true, m);
+    return m;
+}
+
+template <class T>
+void BasicMatrix<T>::activation_into(Activation f, MathMode mode, bool derivative, BasicMatrix &out) const {
+    if (out.rows != rows || out.cols != cols) {
+        throw std::invalid_argument("Matrix dimensions do not match for activation_into");
+    }
+    const SimdKernels &kernels = simd();
+    void (*kernel)(int, const float *, float *) =
+        derivative ? kernels.activation_derivative_f32[static_cast<int>(mode)][static_cast<int>(f)]
+                   : kernels.activation_f32[static_cast<int>(mode)][static_cast<int>(f)];
+    const T *in[1] = {data.data()};
+    float_blocks(rows * cols, in, out.data.data(), false,
+                 [&](int len, const float *const *x, float *y) { kernel(len, x[0], y); });
+}
+
+template <class T>
+void BasicMatrix<T>::activation_backward(Activation f, const BasicMatrix &input_values,
+                                         const BasicMatrix &output_gradient, MathMode mode) {
+    if (rows != input_values.rows || cols != input_values.cols || rows != output_gradient.rows ||
+        cols != output_gradient.cols) {
+        throw std::invalid_argument("Matrix dimensions do not match for activation_backward");
+    }
+    void (*kernel)(int, const float *, const float *, float *) =
+        simd().activation_backward_f32[static_cast<int>(mode)][static_cast<int>(f)];
+    const T *in[2] = {input_values.data.data(), output_gradient.data.data()};
+    float_blocks(rows * cols, in, data.data(), true,
+                 [&](int len, const float *const *x, float *acc) { kernel(len, x[0], x[1], acc); });
+}
+
+template class BasicMatrix<float>;
+template class BasicMatrix<bfloat16>;
@@ -0,0 +1,251 @@
+#ifndef BASIC_MATRIX_H
+#define BASIC_MATRIX_H
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "activations.hpp"
+#include "bfloat16.hpp"
+#include "matrix_expr.hpp"
+#include "matrix_view.hpp"
+#include "pool_allocator.hpp"
+
+// Matrices are templated on the type of their elements: BasicMatrix<T> for T = double, float
+// or bfloat16 (bfloat16.hpp).
+//
+// BasicMatrix<double> is Matrix (matrix.hpp), with the hand-vectorised kernels of simd.hpp and
+// gemm.cpp. The reduced precision matrices below have the same interface (get / set in double,
+// element-wise expressions, views, gemm, transpose, apply and the built-in activations), so code
+// written for one element type, such as the Node of the MLP, works for the others. They store
+// half (float) or a quarter (bfloat16) of the bytes of a Matrix, which is what bounds the
+// element-wise passes, and compute as follows:
+//      - element-wise expressions are evaluated in double and rounded once when stored,
+//      - gemm, axpy / sub_mul and the built-in activations compute in float (compute_type<T>)
+//        with the float kernels of simd.hpp, which do twice as many elements per instruction
+//        as those of Matrix: gemm is the blocked product of gemm.cpp (sgemm), whose packing
+//        converts bfloat16 to float, and the other kernels convert blocks of bfloat16 on the stack.
+//
+// Conversions between element types go through the conversion kernels below, e.g. with the
+// converting constructors `FloatMatrix w32(w);` then `Matrix w64(w32);`, or `convert(w, w32);`
+// which reuses the storage of w32. Narrowing conversions round to nearest.
+template <class T>
+class BasicMatrix;
+
+typedef BasicMatrix<float> FloatMatrix;
+typedef BasicMatrix<bfloat16> BF16Matrix;
+
+// Matrices are referenced (not copied) by the expressions that use them.
+template <class T>
+struct expr_nested<BasicMatrix<T>> {
+    typedef const BasicMatrix<T> &type;
+};
+
+// Conversion kernels: dst[k] = src[k] for 0 <= k < n, rounded to nearest (ties to even) when
+// the destination is narrower. Vectorised by the compiler and split over the thread pool.
+void convert(const double *src, float *dst, int n);
+void convert(const float *src, double *dst, int n);
+void convert(const double *src, bfloat16 *dst, int n);
+void convert(const bfloat16 *src, double *dst, int n);
+void convert(const float *src, bfloat16 *dst, int n);
+void convert(const bfloat16 *src, float *dst, int n);
+template <class T>
+void convert(const T *src, T *dst, int n) {
+    std::copy(src, src + n, dst);
+}
+
+// evaluate (matrix_expr.hpp) into bfloat16: the elements of a row are computed in double by
+// blocks on the stack, which are then rounded by the conversion kernels (a loop that rounds
+// element by element does not vectorise on the baseline instruction set).
+template <class E>
+void evaluate(const E &expr, bfloat16 *out, long ld) {
+    const int cols = expr.numCols();
+    parallel_for(expr.numRows(), elementwise_row_grain(cols), [&](int i0, int i1) {
+        double block[256];
+        for (int i = i0; i < i1; ++i) {
+            for (int j0 = 0; j0 < cols; j0 += 256) {
+                const int len = std::min(256, cols - j0);
+                for (int j = 0; j < len; ++j) {
+                    block[j] = expr.coeff(i, j0 + j);
+                }
+                convert(block, out + i * ld + j0, len);
+            }
+        }
+    });
+}
+
+// dst = src converted to the element type of dst, which is resized if needed.
+template <class T, class U>
+void convert(const BasicMatrix<U> &src, BasicMatrix<T> &dst) {
+    if (dst.numRows() != src.numRows() || dst.numCols() != src.numCols()) {
+        dst = BasicMatrix<T>(src.numRows(), src.numCols());
+    }
+    convert(src.view().data(), dst.view().data(), src.numRows() * src.numCols());
+}
+
+template <class T>
+class BasicMatrix : public MatrixExpr<BasicMatrix<T>> {
+private:
+    int rows, cols;
+    std::vector<T, PoolAllocator<T>> data; // 64-byte aligned, from the pool of pool_allocator.hpp
+
+public:
+    typedef T value_type;
+    typedef BasicMatrixView<T> view_type;
+    typedef BasicMatrixView<const T> const_view_type;
+
+    // Constructors (zero matrix)
+    BasicMatrix(int rows, int cols) : rows(rows), cols(cols), data(static_cast<size_t>(rows) * cols) {}
+    BasicMatrix(const BasicMatrix &other) = default;
+    // Move constructor: takes over the storage of `other`, which is left empty (0 x 0).
+    BasicMatrix(BasicMatrix &&other) noexcept : rows(other.rows), cols(other.cols), data(std::move(other.data)) {
+        other.rows = 0;
+        other.cols = 0;
+        other.data.clear();
+    }
+    // Evaluates an element-wise expression (see matrix_expr.hpp).
+    template <class E>
+    BasicMatrix(const MatrixExpr<E> &expr)
+        : rows(expr.self().numRows()), cols(expr.self().numCols()), data(static_cast<size_t>(rows) * cols) {
+        evaluate(expr.self(), data.data());
+    }
+    // Copy of a matrix of another element type, through the conversion kernels.
+    template <class U>
+    explicit BasicMatrix(const BasicMatrix<U> &other)
+        : rows(other.numRows()), cols(other.numCols()), data(static_cast<size_t>(rows) * cols) {
+        convert(other.view().data(), data.data(), rows * cols);
+    }
+
+    // Basic access, in double as for Matrix (the value is rounded to T by set).
+    double get(int i, int j) const { return data[i * cols + j]; }
+    void set(int i, int j, double value) { data[i * cols + j] = static_cast<T>(value); }
+
+    int numRows() const { return rows; }
+    int numCols() const { return cols; }
+    // See matrix_expr.hpp.
+    template <class V>
+    bool aliases(const V &dst) const { return view().aliases(dst); }
+
+    void fill(double value) { std::fill(data.begin(), data.end(), static_cast<T>(value)); }
+
+    // Element access for the expression templates (no bounds check)
+    double coeff(int i, int j) const { return data[i * cols + j]; }
+
+    // Non-owning views of the elements (see matrix_view.hpp)
+    view_type view() { return view_type(data.data(), rows, cols, cols); }
+    const_view_type view() const { return const_view_type(data.data(), rows, cols, cols); }
+    view_type block(int i, int j, int n_rows, int n_cols) { return view().block(i, j, n_rows, n_cols); }
+    const_view_type block(int i, int j, int n_rows, int n_cols) const { return view().block(i, j, n_rows, n_cols); }
+    view_type rowRange(int i, int n_rows) { return view().rowRange(i, n_rows); }
+    const_view_type rowRange(int i, int n_rows) const { return view().rowRange(i, n_rows); }
+    view_type colRange(int j, int n_cols) { return view().colRange(j, n_cols); }
+    const_view_type colRange(int j, int n_cols) const { return view().colRange(j, n_cols); }
+
+    // Matrix product, accumulated in float.
+    BasicMatrix operator*(const BasicMatrix &other) const;
+
+    // C = alpha * op(A) * op(B) + beta * C, as Matrix::gemm: op(X) is X or X^T, the operands
+    // are matrices or views read through their stride, C must already have the shape of the
+    // product and must not share an element with A or B. The products are accumulated in float.
+    static void gemm(bool transA, bool transB, double alpha, const_view_type A, const_view_type B,
+                     double beta, view_type C);
+
+    // Transposed copy (there is no lazy transpose for the reduced precision matrices: use
+    // gemm with transA / transB to multiply by a transpose without copying it).
+    BasicMatrix transpose() const;
+
+    // Apply a function element-wise, as Matrix::apply (built-in activations included).
+    template <class F>
+    BasicMatrix apply(F func) const {
+        if constexpr (is_builtin_activation<F>::value) {
+            return F::derivative ? activation_derivative(F::activation, func.mode) : activation(F::activation, func.mode);
+        } else {
+            return BasicMatrix(cwise(func, *this));
+        }
+    }
+    // Same into `out`, which must have the shape of this matrix (storage reused, no allocation).
+    template <class F>
+    void apply_into(F func, BasicMatrix &out) const {
+        if (out.rows != rows || out.cols != cols) {
+            throw std::invalid_argument("Matrix dimensions do not match for apply_into");
+        }
+        if constexpr (is_builtin_activation<F>::value) {
+            activation_into(F::activation, func.mode, F::derivative, out);
+        } else {
+            out = cwise(func, *this);
+        }
+    }
+
+    // "this = this - scalar * other" and "this = this + alpha * other", in place, computed in
+    // float by the vectorised kernel of simd.hpp (the weight update of SGD).
+    void sub_mul(double scalar, const BasicMatrix &other) { axpy(-scalar, other); }
+    void axpy(double alpha, const BasicMatrix &other);
+    template <class E>
+    BasicMatrix &operator+=(const MatrixExpr<E> &expr) { return *this = *this + expr; }
+    template <class E>
+    BasicMatrix &operator-=(const MatrixExpr<E> &expr) { return *this = *this - expr; }
+    BasicMatrix &operator*=(double scalar) { return *this = *this * scalar; }
+
+    // Built-in activations, as for Matrix: f(this), f'(this) and
+    // "this = this + output_gradient * f'(input_values)".
+    BasicMatrix activation(Activation f, MathMode mode = MathMode::Precise) const;
+    BasicMatrix activation_derivative(Activation f, MathMode mode = MathMode::Precise) const;
+    // f(this), or f'(this) when `derivative` is true, into `out` of the same shape (may be 'this').
+    void activation_into(Activation f, MathMode mode, bool derivative, BasicMatrix &out) const;
+    void activation_backward(Activation f, const BasicMatrix &input_values, const BasicMatrix &output_gradient,
+                             MathMode mode = MathMode::Precise);
+
+    BasicMatrix sigmoid(MathMode mode = MathMode::Precise) const { return activation(Activation::Sigmoid, mode); }
+    void sigmoid_backward(const BasicMatrix &input_values, const BasicMatrix &output_gradient,
+                          MathMode mode = MathMode::Precise) {
+        activation_backward(Activation::Sigmoid, input_values, output_gradient, mode);
+    }
+
+    BasicMatrix &operator=(const BasicMatrix &other) = default;
+
+    // Move assignment: takes over the storage of `other`, which is left empty (0 x 0).
+    BasicMatrix &operator=(BasicMatrix &&other) noexcept {
+        if (this != &other) {
+            rows = other.rows;
+            cols = other.cols;
+            data = std::move(other.data);
+            other.rows = 0;
+            other.cols = 0;
+            other.data.clear();
+        }
+        return *this;
+    }
+
+    // Evaluates an element-wise expression in place, the storage is only reallocated if the
+    // shape changes. `this` may appear in the expression, as for Matrix: through a temporary when
+    // the expression reads other elements of `this` than the one it computes (e.g. its transpose).
+    template <class E>
+    BasicMatrix &operator=(const MatrixExpr<E> &expr) {
+        const E &e = expr.self();
+        if (e.aliases(view())) {
+            return *this = BasicMatrix(e);
+        }
+        if (e.numRows() != rows || e.numCols() != cols) {
+            rows = e.numRows();
+            cols = e.numCols();
+            data.resize(static_cast<size_t>(rows) * cols);
+        }
+        evaluate(e, data.data());
+        return *this;
+    }
+};
+
+template <class T>
+BasicMatrixView<T>::BasicMatrixView(matrix_type &m) : BasicMatrixView(m.view()) {}
+
+// out = a^T, as transpose_into for Matrix (matrix.hpp): `out` must be a.numCols() x a.numRows()
+// and must not overlap `a`.
+void transpose_into(BasicMatrixView<const float> a, BasicMatrixView<float> out);
+void transpose_into(BasicMatrixView<const bfloat16> a, BasicMatrixView<bfloat16> out);
+
+// Defined in basic_matrix.cpp for float and bfloat16.
+extern template class BasicMatrix<float>;
+extern template class BasicMatrix<bfloat16>;
+
+#endif // BASIC_MATRIX_H
@@ -0,0 +1,146 @@
+#include "batched_matrix.hpp"
+#include "simd.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+
+namespace {
+
+// Batches with fewer flops than this stay on the calling thread.
+const long PARALLEL_MIN_FLOPS = 64 * 64 * 64;
+
+// Lanes of the temporary products of a summed batch, per chunk.
+const int REDUCE_LANES = 256;
+
+// Same test as for Matrix::gemm: the ranges [first element, last element] of the two views.
+bool overlaps(ConstBatchedView a, ConstBatchedView b) {
+    if (a.numRows() == 0 || a.numCols() == 0 || b.numRows() == 0 || b.numCols() == 0) {
+        return false;
+    }
+    const double *a_end = a.lanes(a.numRows() - 1, a.numCols() - 1) + a.batchSize();
+    const double *b_end = b.lanes(b.numRows() - 1, b.numCols() - 1) + b.batchSize();
+    return a.data() < b_end && b.data() < a_end;
+}
+
+// Strides of the elements of op(X): (i, j) is at i * rs + j * cs (plus the lane).
+struct Strides {
+    long rs, cs;
+};
+
+Strides op_strides(bool trans, ConstBatchedView X) {
+    return trans ? Strides{X.batchSize(), X.stride()} : Strides{X.stride(), X.batchSize()};
+}
+
+} // namespace
+
+BatchedMatrix::BatchedMatrix(int count, int rows, int cols)
+    : count(count), rows(rows), cols(cols), data(static_cast<size_t>(count) * rows * cols) {
+    if (count < 1 || rows < 0 || cols < 0) {
+        throw std::invalid_argument("Invalid BatchedMatrix dimensions");
+    }
+}
+
+BatchedMatrix::BatchedMatrix(const std::vector<ConstMatrixView> &matrices)
+    : BatchedMatrix(static_cast<int>(matrices.size()), matrices.empty() ? 0 : matrices[0].numRows(),
+                    matrices.empty() ? 0 : matrices[0].numCols()) {
+    for (int b = 0; b < count; ++b) {
+        const ConstMatrixView &m = matrices[b];
+        if (m.numRows() != rows || m.numCols() != cols) {
+            throw std::invalid_argument("The matrices of a batch must have the same dimensions");
+        }
+        for (int i = 0; i < rows; ++i) {
+            for (int j = 0; j < cols; ++j) {
+                set(b, i, j, m.coeff(i, j));
+            }
+        }
+    }
+}
+
+void BatchedMatrix::fill(double value) {
+    std::fill(data.begin(), data.end(), value);
+}
+
+void BatchedMatrix::extract(int b, MatrixView out) const {
+    if (b < 0 || b >= count) {
+        throw std::out_of_range("BatchedMatrix index out of range");
+    }
+    if (out.numRows() != rows || out.numCols() != cols) {
+        throw std::invalid_argument("Matrix dimensions do not match for BatchedMatrix::extract");
+    }
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j < cols; ++j) {
+            out.set(i, j, get(b, i, j));
+        }
+    }
+}
+
+// Every chunk of lanes is one call of the kernel of simd.hpp. A summed batch goes through
+// temporary products of REDUCE_LANES lanes per chunk, whose sums are added in chunk order, so
+// the result does not depend on the number of threads.
+void batched_gemm(bool transA, bool transB, double alpha, ConstBatchedView A, ConstBatchedView B,
+                  double beta, BatchedView C) {
+    const int m = transA ? A.numCols() : A.numRows();
+    const int k = transA ? A.numRows() : A.numCols();
+    const int n = transB ? B.numRows() : B.numCols();
+    if ((transB ? B.numCols() : B.numRows()) != k || C.numRows() != m || C.numCols() != n) {
+        throw std::invalid_argument("Matrix dimensions do not match for batched_gemm");
+    }
+    const int batch = std::max(A.batchSize(), std::max(B.batchSize(), C.batchSize()));
+    for (int count : {A.batchSize(), B.batchSize(), C.batchSize()}) {
+        if (count != 1 && count != batch) {
+            throw std::invalid_argument("Batch sizes do not match for batched_gemm");
+        }
+    }
+    if (overlaps(C, A) || overlaps(C, B)) {
+        throw std::invalid_argument("The output of batched_gemm must not alias its operands");
+    }
+    if (m == 0 || n == 0) {
+        return;
+    }
+
+    const SimdKernels &kernels = simd();
+    const Strides a = op_strides(transA, A), b = op_strides(transB, B);
+    const bool a_lanes = A.batchSize() > 1, b_lanes = B.batchSize() > 1;
+    const long lane_flops = std::max(1L, 2L * m * n * k);
+
+    if (C.batchSize() == batch) {
+        const int grain = static_cast<int>(std::max(1L, PARALLEL_MIN_FLOPS / lane_flops));
+        parallel_for(batch, grain, [&](int l0, int l1) {
+            kernels.batched_gemm(l1 - l0, m, n, k, alpha, A.data() + (a_lanes ? l0 : 0), a.rs, a.cs, a_lanes,
+                                 B.data() + (b_lanes ? l0 : 0), b.rs, b.cs, b_lanes, beta, C.data() + l0,
+                                 C.stride(), C.batchSize());
+        });
+        return;
+    }
+
+    const int chunks = (batch + REDUCE_LANES - 1) / REDUCE_LANES;
+    const size_t mn = static_cast<size_t>(m) * n;
+    pooled_vector partial(chunks * mn);
+    const int grain = static_cast<int>(std::max(1L, PARALLEL_MIN_FLOPS / (lane_flops * REDUCE_LANES)));
+    parallel_for(chunks, grain, [&](int c0, int c1) {
+        pooled_vector products(mn * REDUCE_LANES);
+        for (int c = c0; c < c1; ++c) {
+            const int l0 = c * REDUCE_LANES, lanes = std::min(REDUCE_LANES, batch - l0);
+            kernels.batched_gemm(lanes, m, n, k, 1.0, A.data() + (a_lanes ? l0 : 0), a.rs, a.cs, a_lanes,
+                                 B.data() + (b_lanes ? l0 : 0), b.rs, b.cs, b_lanes, 0.0, products.data(),
+                                 static_cast<long>(n) * lanes, lanes);
+            for (size_t e = 0; e < mn; ++e) {
+                double sum = 0.0;
+                for (int l = 0; l < lanes; ++l) {
+                    sum += products[e * lanes + l];
+                }
+                partial[c * mn + e] = sum;
+            }
+        }
+    });
+    for (int i = 0; i < m; ++i) {
+        for (int j = 0; j < n; ++j) {
+            double sum = 0.0;
+            for (int c = 0; c < chunks; ++c) {
+                sum += partial[c * mn + static_cast<size_t>(i) * n + j];
+            }
+            double *out = C.lanes(i, j);
+            *out = beta == 0.0 ? alpha * sum : alpha * sum + beta * *out;
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef BATCHED_MATRIX_H
+#define BATCHED_MATRIX_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "matrix_view.hpp"
+#include "pool_allocator.hpp"
+
+// Batch of small matrices of the same shape, for the many independent tiny products of a
+// per-sample workload (e.g. the 128 x 2 times 2 x 1 product of the first layer of the MLP, once
+// per sample), which cost far more in calls and loop overhead than in flops when done one Matrix
+// at a time.
+// The matrices are stored interleaved (structure of arrays): element (i, j) of the `count`
+// matrices is `count` contiguous doubles, so the kernels run their SIMD lanes across the batch
+// and every instruction works on width samples, whatever the (tiny) shape of the matrices.
+// (Only views in the interface: this file is shared with P1, whose Matrix is declared differently.)
+//
+// A batched view is a pointer, the size of the batch, the shape and the distance between two
+// rows: element (i, j) of matrix b is data[i * stride + j * count + b]. A view of a single
+// matrix (count = 1) is a row-major matrix with leading dimension `stride`, so the view of a
+// Matrix converts to a batched view of one matrix, e.g. `W.view()` for weights shared by the batch.
+template <class T>
+class BasicBatchedView {
+private:
+    T *ptr;
+    int count, rows, cols, ld;
+
+public:
+    BasicBatchedView(T *data, int count, int rows, int cols, int ld)
+        : ptr(data), count(count), rows(rows), cols(cols), ld(ld) {
+        if (count < 1 || rows < 0 || cols < 0 || ld < cols * count) {
+            throw std::invalid_argument("Invalid BatchedView dimensions");
+        }
+    }
+
+    // A single matrix (e.g. `W.view()`), the same for every sample of a batch.
+    template <class U, class = typename std::enable_if<std::is_same<U, T>::value ||
+                                                       std::is_same<const U, T>::value>::type>
+    BasicBatchedView(const BasicMatrixView<U> &m)
+        : BasicBatchedView(m.data(), 1, m.numRows(), m.numCols(), m.stride()) {}
+
+    // A mutable view converts to a read-only one.
+    template <class U, class = typename std::enable_if<std::is_same<const U, T>::value &&
+                                                       !std::is_same<U, T>::value>::type>
+    BasicBatchedView(const BasicBatchedView<U> &other)
+        : ptr(other.data()), count(other.batchSize()), rows(other.numRows()), cols(other.numCols()),
+          ld(other.stride()) {}
+
+    int batchSize() const { return count; }
+    int numRows() const { return rows; }
+    int numCols() const { return cols; }
+    int stride() const { return ld; }
+    T *data() const { return ptr; }
+
+    // The `count` contiguous values of element (i, j).
+    T *lanes(int i, int j) const { return ptr + static_cast<long>(i) * ld + static_cast<long>(j) * count; }
+    double get(int b, int i, int j) const { return lanes(i, j)[b]; }
+};
+
+typedef BasicBatchedView<double> BatchedView;
+typedef BasicBatchedView<const double> ConstBatchedView;
+
+// `count` matrices of rows x cols, interleaved as above (stride = cols * count).
+class BatchedMatrix {
+private:
+    int count, rows, cols;
+    pooled_vector data;
+
+public:
+    // Batch of `count` zero matrices
+    BatchedMatrix(int count, int rows, int cols);
+    // Interleaved copy of the matrices, which must all have the same shape, e.g.
+    // `BatchedMatrix({x0, x1, x2})` for three matrices (or views) of the same shape.
+    explicit BatchedMatrix(const std::vector<ConstMatrixView> &matrices);
+
+    int batchSize() const { return count; }
+    int numRows() const { return rows; }
+    int numCols() const { return cols; }
+
+    double get(int b, int i, int j) const { return data[(static_cast<size_t>(i) * cols + j) * count + b]; }
+    void set(int b, int i, int j, double value) { data[(static_cast<size_t>(i) * cols + j) * count + b] = value; }
+    void fill(double value);
+
+    BatchedView view() { return BatchedView(data.data(), count, rows, cols, cols * count); }
+    ConstBatchedView view() const { return ConstBatchedView(data.data(), count, rows, cols, cols * count); }
+    operator BatchedView() { return view(); }
+    operator ConstBatchedView() const { return view(); }
+
+    // Copy of matrix b of the batch into `out` (rows x cols).
+    void extract(int b, MatrixView out) const;
+};
+
+// Batched GEMM: for every matrix b of the batch
+//      C_b = alpha * op(A_b) * op(B_b) + beta * C_b
+// with op(X) = X or X^T as for Matrix::gemm, op(A_b) m x k, op(B_b) k x n and C_b m x n.
+// A and B hold either one matrix per sample or a single matrix (count = 1) used for the whole
+// batch, such as shared weights. When C is a single matrix for a batch of several products, they
+// are summed into it instead: C = alpha * sum_b op(A_b) * op(B_b) + beta * C, e.g. the gradient
+// of shared weights. C is not read when beta == 0 and must not share memory with A or B.
+// The lanes of the batch are split over the thread pool.
+void batched_gemm(bool transA, bool transB, double alpha, ConstBatchedView A, ConstBatchedView B,
+                  double beta, BatchedView C);
+
+#endif // BATCHED_MATRIX_H
@@ -0,0 +1,56 @@
+#ifndef BFLOAT16_H
+#define BFLOAT16_H
+
+#include <cstdint>
+#include <cstring>
+
+// Software bfloat16: the upper 16 bits of an IEEE float (1 sign bit, the 8 exponent bits of
+// float and 7 mantissa bits), so it has the range of float with about 3 significant digits.
+//
+// It is only a storage format: half the bytes of float and a quarter of those of double, for
+// the bandwidth-bound parts of training (element-wise passes, reading weights and
+// activations). Every arithmetic operation converts to float first (`float(x)` is a shift),
+// and the matrix kernels accumulate in float (see `compute_type` below).
+// float -> bfloat16 rounds to nearest, ties to even, and keeps NaNs quiet.
+struct bfloat16 {
+    std::uint16_t bits;
+
+    bfloat16() : bits(0) {}
+    explicit bfloat16(float x) : bits(round(x)) {}
+
+    operator float() const {
+        std::uint32_t u = static_cast<std::uint32_t>(bits) << 16;
+        float x;
+        std::memcpy(&x, &u, sizeof(x));
+        return x;
+    }
+
+    static bfloat16 from_bits(std::uint16_t b) {
+        bfloat16 x;
+        x.bits = b;
+        return x;
+    }
+
+    // Written as a select rather than a branch, so that the loops that convert arrays vectorise.
+    static std::uint16_t round(float x) {
+        std::uint32_t u;
+        std::memcpy(&u, &x, sizeof(u));
+        // Adds 0x7fff, plus 1 when the kept part is odd, then truncates.
+        std::uint16_t rounded = static_cast<std::uint16_t>((u + 0x7fffu + ((u >> 16) & 1u)) >> 16);
+        std::uint16_t nan = static_cast<std::uint16_t>((u >> 16) | 0x0040u); // quiet NaN
+        return (u & 0x7fffffffu) > 0x7f800000u ? nan : rounded;
+    }
+};
+
+// Type in which the kernels compute on elements stored as T: float for float and bfloat16.
+template <class T>
+struct compute_type {
+    typedef T type;
+};
+
+template <>
+struct compute_type<bfloat16> {
+    typedef float type;
+};
+
+#endif // BFLOAT16_H
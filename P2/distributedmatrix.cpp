@@ -1,4 +1,6 @@
 #include "distributedmatrix.hpp"
+#include <stdexcept>
+#include <utility>
 
 DistributedMatrix::DistributedMatrix(const Matrix& matrix, int numProc){
     globalRows = matrix.numRows();
@@ -9,23 +11,18 @@ DistributedMatrix::DistributedMatrix(const Matrix& matrix, int numProc){
 
     if (rank >= numProc - globalCols % numProc) {
         localCols = globalCols / numProc + 1;
-        startCol = globalCols - (numProc - rank - 1) * localCols - 1;
+        startCol = globalCols - (numProc - rank) * localCols;
     } else {
         localCols = globalCols / numProc;
         startCol = rank * localCols;
     }
 
-    localData = Matrix(globalRows, localCols);
-
-    for (int i = 0; i < globalRows; ++i) {
-        for (int j = 0; j < localCols; ++j) {
-            localData.get(i, j, matrix.get(i, startCol + j));
-        }
-    }
+    // The local columns are copied straight from a view of the full matrix.
+    localData = matrix.block(0, startCol, globalRows, localCols);
 }
 
 
-DistributedMatrix::DistributedMatrix(int globalR, int globalC, int localC, int startC, const Matrix& localDat){
+DistributedMatrix::DistributedMatrix(int globalR, int globalC, int localC, int startC, Matrix localDat){
     globalRows = globalR;
     globalCols = globalC;
     localCols = localC;
@@ -34,7 +31,7 @@ DistributedMatrix::DistributedMatrix(int globalR, int globalC, int localC, int s
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &numProcesses);
 
-    localData = localDat;
+    localData = std::move(localDat);
 }
 
 
@@ -84,24 +81,33 @@ const Matrix& DistributedMatrix::getLocalData() const {
     return localData;
 }
 
-DistributedMatrix DistributedMatrix::apply(const std::function<double(double)> &func) const {
-    Matrix result(globalRows, localCols);
-    for (int i = 0; i < globalRows; ++i) {
-        for (int j = 0; j < localCols; ++j) {
-            result.set(i, j, func(get(i, j)));
-        }
+// The in-place operations work on the local columns only, so both operands must be split the same way.
+static void checkSamePartitioning(const DistributedMatrix& a, const DistributedMatrix& b) {
+    if (a.numRows() != b.numRows() || a.numCols() != b.numCols() || a.globalColIndex(0) != b.globalColIndex(0)) {
+        throw std::invalid_argument("DistributedMatrix partitionings do not match");
     }
-    return DistributedMatrix(globalRows, globalCols, localCols, startCol, result);
 }
 
-DistributedMatrix DistributedMatrix::applyBinary(const DistributedMatrix& a,const DistributedMatrix& b,const std::function<double(double, double)> &func) {
-    Matrix result(a.globalRows, a.localCols);
-    for (int i = 0; i < a.globalRows; ++i) {
-        for (int j = 0; j < a.localCols; ++j) {
-            result.set(i, j, func(a.get(i, j), b.get(i, j)));
-        }
-    }
-    return DistributedMatrix(a.globalRows, a.globalCols, a.localCols, a.startCol, result);
+DistributedMatrix& DistributedMatrix::operator+=(const DistributedMatrix& other) {
+    checkSamePartitioning(*this, other);
+    localData += other.localData;
+    return *this;
+}
+
+DistributedMatrix& DistributedMatrix::operator-=(const DistributedMatrix& other) {
+    checkSamePartitioning(*this, other);
+    localData -= other.localData;
+    return *this;
+}
+
+DistributedMatrix& DistributedMatrix::operator*=(double scalar) {
+    localData *= scalar;
+    return *this;
+}
+
+void DistributedMatrix::axpy(double alpha, const DistributedMatrix& other) {
+    checkSamePartitioning(*this, other);
+    localData.axpy(alpha, other.localData);
 }
 
 
@@ -132,7 +138,29 @@ DistributedMatrix multiply(const Matrix& left, const DistributedMatrix& right) {
     int startCol = right.startCol;
 
     Matrix result = left * right.getLocalData();
-    return DistributedMatrix(globalRows, globalCols, localCols, startCol, result);
+    return DistributedMatrix(globalRows, globalCols, localCols, startCol, std::move(result));
+}
+
+DistributedMatrix multiply(const TransposedView& left, const DistributedMatrix& right) {
+    Matrix result = left * right.getLocalData();
+    return DistributedMatrix(left.numRows(), right.numCols(), right.localCols, right.startCol, std::move(result));
+}
+
+// The local columns of the product are those of `right`: beta = 1 accumulates into them in place.
+static void checkProductPartitioning(int leftRows, const DistributedMatrix& right, const DistributedMatrix& acc) {
+    if (acc.numRows() != leftRows || acc.numCols() != right.numCols() || acc.globalColIndex(0) != right.globalColIndex(0)) {
+        throw std::invalid_argument("DistributedMatrix partitionings do not match");
+    }
+}
+
+void multiply_add(const Matrix& left, const DistributedMatrix& right, DistributedMatrix& acc) {
+    checkProductPartitioning(left.numRows(), right, acc);
+    Matrix::gemm(false, false, 1.0, left, right.localData, 1.0, acc.localData);
+}
+
+void multiply_add(const TransposedView& left, const DistributedMatrix& right, DistributedMatrix& acc) {
+    checkProductPartitioning(left.numRows(), right, acc);
+    Matrix::gemm(true, false, 1.0, left.transpose(), right.localData, 1.0, acc.localData);
 }
 
 Matrix DistributedMatrix::multiplyTransposed(const DistributedMatrix& other) const {
@@ -29,7 +29,8 @@ public:
     //      Extract the columns that should be handled by this process in localData
     DistributedMatrix(const Matrix& matrix, int numProcesses);
 
-    DistributedMatrix(int globalRows, int globalCols, int localCols, int startCol, const Matrix& localData);
+    // (localData is taken by value so that a temporary local matrix is moved in rather than copied)
+    DistributedMatrix(int globalRows, int globalCols, int localCols, int startCol, Matrix localData);
 
     
     // Copy constructor
@@ -37,6 +38,10 @@ public:
 
     // Assignement operator (not necessary to implement)
     DistributedMatrix& operator=(const DistributedMatrix& other) = default;
+
+    // Move constructor and assignment: take over the local data instead of copying it
+    DistributedMatrix(DistributedMatrix&& other) noexcept = default;
+    DistributedMatrix& operator=(DistributedMatrix&& other) noexcept = default;
     
     // Implementation of AbstractMatrix interface
     int numRows() const override;
@@ -57,16 +62,40 @@ public:
     const Matrix& getLocalData() const;
     
     // Apply a function element-wise on the local data, returning the result as a new DistributedMatrix with the same partitioning of the columns across processes
-    DistributedMatrix apply(const std::function<double(double)> &func) const;
+    //      `func` may be any callable, it is inlined in the loop (see Matrix::apply)
+    template <class F>
+    DistributedMatrix apply(F func) const {
+        return DistributedMatrix(globalRows, globalCols, localCols, startCol, localData.apply(func));
+    }
     
     // Apply a binary function to two distributed matrices with the same columns' partitioning across processes (and keeps this partioning for the result)
+    template <class F>
     static DistributedMatrix applyBinary(
         const DistributedMatrix& a,
         const DistributedMatrix& b,
-        const std::function<double(double, double)> &func);
+        F func) {
+        return DistributedMatrix(a.globalRows, a.globalCols, a.localCols, a.startCol, Matrix(cwise(func, a.localData, b.localData)));
+    }
+    
+    // In-place operations on the local data (no communication, no temporary)
+    //      `other` must have the same columns' partitioning across processes
+    DistributedMatrix& operator+=(const DistributedMatrix& other);
+    DistributedMatrix& operator-=(const DistributedMatrix& other);
+    DistributedMatrix& operator*=(double scalar);
+    // this = this + alpha * other
+    void axpy(double alpha, const DistributedMatrix& other);
+    // this = this + func(a, b) element-wise, in one pass without any temporary (e.g. to accumulate a gradient)
+    template <class F>
+    void addBinary(const DistributedMatrix& a, const DistributedMatrix& b, F func) {
+        localData += cwise(func, a.localData, b.localData);
+    }
     
     // Matrix multiplication: Matrix * DistributedMatrix (friend declaration) (no implementation here)
     friend DistributedMatrix multiply(const Matrix& left, const DistributedMatrix& right);
+    friend DistributedMatrix multiply(const TransposedView& left, const DistributedMatrix& right);
+    // Accumulating products, see below
+    friend void multiply_add(const Matrix& left, const DistributedMatrix& right, DistributedMatrix& acc);
+    friend void multiply_add(const TransposedView& left, const DistributedMatrix& right, DistributedMatrix& acc);
     
     // Matrix multiplication: DistributedMatrix * DistributedMatrix^T (returns a regular Matrix)
     //      Can assume the same columns' partitioning across processes for the inputs
@@ -87,6 +116,13 @@ public:
 //      Assumes that the left matrix is already on all processes (no need to broadcast it)
 //      Returns a DistributedMatrix with the same columns' partioning as the input right DistributedMatrix
 DistributedMatrix multiply(const Matrix& left, const DistributedMatrix& right);
+// Same with a transposed left matrix (e.g. `multiply(w.transpose(), dy)`), read in place by GEMM.
+DistributedMatrix multiply(const TransposedView& left, const DistributedMatrix& right);
+// Accumulating products: acc = acc + left * right (or left^T * right), a single GEMM into the
+//      local columns of `acc` (which must have the partitioning of `right`), without any temporary
+//      (e.g. to accumulate a gradient)
+void multiply_add(const Matrix& left, const DistributedMatrix& right, DistributedMatrix& acc);
+void multiply_add(const TransposedView& left, const DistributedMatrix& right, DistributedMatrix& acc);
 
 // Synchronize the value of all processes so that after the call of this function,
 // the value of the matrix on all process is the value before this call that the matrix had on the process for which `rank == src`.
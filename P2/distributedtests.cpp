@@ -211,6 +211,13 @@ void testMultiply() {
     // Gather and check
     Matrix gathered = resultMatrix.gather();
     assert(matricesEqual(gathered, expectedMatrix, 1e-8));  // Use larger epsilon for multiplication
+
+    // Accumulating products, in place: result += left * right, then result += (left^T)^T * right
+    Matrix leftTransposed = leftMatrix.transpose();
+    multiply_add(leftMatrix, rightMatrix, resultMatrix);
+    multiply_add(leftTransposed.transpose(), rightMatrix, resultMatrix);
+    gathered = resultMatrix.gather();
+    assert(matricesEqual(gathered, expectedMatrix * 3.0, 1e-8));
     
     if (rank == 0) {
         std::cout << "Matrix multiplication test passed!" << std::endl;
@@ -0,0 +1,160 @@
+#ifndef FIXED_MATRIX_H
+#define FIXED_MATRIX_H
+
+#include <cstddef>
+#include <initializer_list>
+#include <stdexcept>
+#include <utility>
+
+#include "matrix_view.hpp"
+
+// Row-major R x C matrix whose sizes are template parameters, stored inline (on the stack
+// for a local variable): for the tiny operands of the MLP (one 2 x 1 input, a 1 x 1 target,
+// a bias vector) where a Matrix would cost a heap allocation and loops over 1 or 2 elements.
+//
+// Every operation is unrolled at compile time (one statement per element, see `unroll`)
+// and is constexpr, e.g.
+//      constexpr FixedMatrix<2, 2> a{1, 2, 3, 4};
+//      static_assert((a * a).get(1, 1) == 22);
+// The sizes of the operands are checked at compile time too: a FixedMatrix<2, 3> times a
+// FixedMatrix<2, 3> does not compile.
+//
+// A FixedMatrix<R, C> (of double) interoperates with Matrix through its views: it can be an
+// operand or the output of Matrix::gemm (`Matrix::gemm(false, false, 1.0, W, x.view(), 0.0, y)`),
+// appear in the element-wise expressions of Matrix, and `Matrix(x.view())` copies it to a Matrix.
+template <int R, int C, class T = double>
+class FixedMatrix {
+    static_assert(R > 0 && C > 0, "FixedMatrix dimensions must be positive");
+
+private:
+    T values[R * C];
+
+    // f(0), f(1), ..., f(N - 1), as N separate statements.
+    template <class F, std::size_t... I>
+    static constexpr void unroll(F &&f, std::index_sequence<I...>) {
+        (f(static_cast<int>(I)), ...);
+    }
+    template <int N, class F>
+    static constexpr void unroll(F &&f) {
+        unroll(f, std::make_index_sequence<N>());
+    }
+
+    template <int, int, class>
+    friend class FixedMatrix;
+
+public:
+    static constexpr int rows = R;
+    static constexpr int cols = C;
+
+    // Zero matrix
+    constexpr FixedMatrix() : values() {}
+
+    // Elements in row-major order, e.g. FixedMatrix<2, 1>{x0, x1}.
+    constexpr FixedMatrix(std::initializer_list<T> elements) : values() {
+        if (elements.size() != static_cast<std::size_t>(R * C)) {
+            throw std::invalid_argument("Wrong number of elements for FixedMatrix");
+        }
+        int k = 0;
+        for (T x : elements) {
+            values[k++] = x;
+        }
+    }
+
+    // Copy of a Matrix or of a view, which must be R x C.
+    explicit FixedMatrix(ConstMatrixView m) : values() {
+        if (m.numRows() != R || m.numCols() != C) {
+            throw std::invalid_argument("Matrix dimensions do not match FixedMatrix");
+        }
+        unroll<R * C>([&](int k) { values[k] = static_cast<T>(m.coeff(k / C, k % C)); });
+    }
+
+    constexpr int numRows() const { return R; }
+    constexpr int numCols() const { return C; }
+
+    constexpr T get(int i, int j) const { return values[i * C + j]; }
+    constexpr void set(int i, int j, T value) { values[i * C + j] = value; }
+    constexpr T coeff(int i, int j) const { return values[i * C + j]; }
+
+    constexpr void fill(T value) {
+        unroll<R * C>([&](int k) { values[k] = value; });
+    }
+
+    T *data() { return values; }
+    const T *data() const { return values; }
+
+    // Views for Matrix::gemm and the element-wise expressions (only for T = double).
+    MatrixView view() { return MatrixView(values, R, C, C); }
+    ConstMatrixView view() const { return ConstMatrixView(values, R, C, C); }
+
+    // Element-wise operations
+    constexpr FixedMatrix operator+(const FixedMatrix &other) const {
+        FixedMatrix m;
+        unroll<R * C>([&](int k) { m.values[k] = values[k] + other.values[k]; });
+        return m;
+    }
+    constexpr FixedMatrix operator-(const FixedMatrix &other) const {
+        FixedMatrix m;
+        unroll<R * C>([&](int k) { m.values[k] = values[k] - other.values[k]; });
+        return m;
+    }
+    constexpr FixedMatrix operator-() const {
+        FixedMatrix m;
+        unroll<R * C>([&](int k) { m.values[k] = -values[k]; });
+        return m;
+    }
+    constexpr FixedMatrix operator*(T scalar) const {
+        FixedMatrix m;
+        unroll<R * C>([&](int k) { m.values[k] = values[k] * scalar; });
+        return m;
+    }
+    constexpr FixedMatrix &operator+=(const FixedMatrix &other) {
+        unroll<R * C>([&](int k) { values[k] += other.values[k]; });
+        return *this;
+    }
+    constexpr FixedMatrix &operator-=(const FixedMatrix &other) {
+        unroll<R * C>([&](int k) { values[k] -= other.values[k]; });
+        return *this;
+    }
+    constexpr FixedMatrix &operator*=(T scalar) {
+        unroll<R * C>([&](int k) { values[k] *= scalar; });
+        return *this;
+    }
+    // this = this + alpha * other
+    constexpr void axpy(T alpha, const FixedMatrix &other) {
+        unroll<R * C>([&](int k) { values[k] += alpha * other.values[k]; });
+    }
+
+    // Matrix product, each element is an unrolled sum of C products.
+    template <int N>
+    constexpr FixedMatrix<R, N, T> operator*(const FixedMatrix<C, N, T> &other) const {
+        FixedMatrix<R, N, T> m;
+        unroll<R * N>([&](int k) {
+            const int i = k / N, j = k % N;
+            T sum = T();
+            unroll<C>([&](int p) { sum += values[i * C + p] * other.values[p * N + j]; });
+            m.values[k] = sum;
+        });
+        return m;
+    }
+
+    constexpr FixedMatrix<C, R, T> transpose() const {
+        FixedMatrix<C, R, T> m;
+        unroll<R * C>([&](int k) { m.values[(k % C) * R + k / C] = values[k]; });
+        return m;
+    }
+
+    // f applied to every element (any callable, including the functors of activations.hpp).
+    template <class F>
+    constexpr FixedMatrix apply(F func) const {
+        FixedMatrix m;
+        unroll<R * C>([&](int k) { m.values[k] = func(values[k]); });
+        return m;
+    }
+};
+
+template <int R, int C, class T>
+constexpr FixedMatrix<R, C, T> operator*(T scalar, const FixedMatrix<R, C, T> &m) {
+    return m * scalar;
+}
+
+#endif // FIXED_MATRIX_H
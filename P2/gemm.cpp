@@ -0,0 +1,400 @@
+#include "gemm.hpp"
+#include "pool_allocator.hpp"
+#include "simd.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <type_traits>
+#include <vector>
+
+// Goto/BLIS style GEMM: the product is split into blocks sized for the cache hierarchy.
+//  - an NC wide column panel of B is the outermost block (L3),
+//  - a KC x NC panel of B is packed once and reused for every row block of A (L2/L3),
+//  - an MC x KC block of A is packed and stays in L2 while it sweeps the packed B panel,
+//  - the micro-kernel computes an MR x NR tile of C in registers, streaming an MR x KC
+//    micro-panel of A and a KC x NR micro-panel of B from L1.
+// Packing lays out every micro-panel contiguously in the order the micro-kernel reads it,
+// so the inner loop only does unit-stride loads regardless of the strides of A and B
+// (in particular, a transposed operand costs nothing more than a plain one).
+// The micro-kernel and its MR x NR tile come from the SIMD table selected at startup.
+// Large products are split over the thread pool: the packing of B over its micro-panels,
+// then the row blocks of A, each thread packing its own blocks of A.
+// The same code runs the float products of sgemm: the packing converts the elements (float or
+// bfloat16) to float, the float micro-kernel computes the tiles, and storing a tile rounds it to
+// the element type of C. Only the packed blocks are ever converted, never whole operands.
+
+namespace {
+
+const int MC = 96; // multiple of every MR of simd.hpp
+const int KC = 256;
+const int NC = 4096;
+
+// Products with fewer flops than this stay on the calling thread.
+const long PARALLEL_MIN_FLOPS = 64 * 64 * 64;
+
+// Micro-kernel and register tile computing in P (double or float), from the table of simd.hpp.
+template <class P>
+struct MicroKernel {
+    int mr, nr;
+    void (*run)(int kc, const P *a, const P *b, P *ab);
+};
+
+MicroKernel<double> micro_kernel(const SimdKernels &k, double) { return MicroKernel<double>{k.mr, k.nr, k.gemm_kernel}; }
+MicroKernel<float> micro_kernel(const SimdKernels &k, float) { return MicroKernel<float>{k.mr, k.nr_f32, k.gemm_kernel_f32}; }
+
+// Pack the mc x kc block of A starting at `A` into micro-panels of MR rows.
+// Inside a micro-panel, the MR elements of one column are contiguous.
+// Rows past `mc` are padded with zeros so the micro-kernel never needs to branch.
+// The elements are converted from T to the type P of the micro-kernel on the way.
+template <class T, class P>
+void pack_A(int MR, int mc, int kc, const T *A, int rsa, int csa, P *Ap) {
+    for (int ir = 0; ir < mc; ir += MR) {
+        int mr = std::min(MR, mc - ir);
+        for (int p = 0; p < kc; ++p) {
+            const T *a = A + ir * rsa + p * csa;
+            for (int i = 0; i < mr; ++i) {
+                Ap[i] = static_cast<P>(a[i * rsa]);
+            }
+            for (int i = mr; i < MR; ++i) {
+                Ap[i] = P(0);
+            }
+            Ap += MR;
+        }
+    }
+}
+
+// Pack the kc x nc block of B starting at `B` into micro-panels of NR columns.
+// Inside a micro-panel, the NR elements of one row are contiguous.
+template <class T, class P>
+void pack_B(int NR, int kc, int nc, const T *B, int rsb, int csb, P *Bp) {
+    for (int jr = 0; jr < nc; jr += NR) {
+        int nr = std::min(NR, nc - jr);
+        for (int p = 0; p < kc; ++p) {
+            const T *b = B + p * rsb + jr * csb;
+            for (int j = 0; j < nr; ++j) {
+                Bp[j] = static_cast<P>(b[j * csb]);
+            }
+            for (int j = nr; j < NR; ++j) {
+                Bp[j] = P(0);
+            }
+            Bp += NR;
+        }
+    }
+}
+
+// C[0:mr, 0:nr] = alpha * ab + beta * C, only reading C when beta != 0 (computed in P, then
+// rounded to the element type T of C).
+template <class T, class P>
+void store_tile(int NR, int mr, int nr, P alpha, const P *ab, P beta, T *C, int ldc) {
+    for (int i = 0; i < mr; ++i) {
+        T *c = C + i * ldc;
+        const P *t = ab + i * NR;
+        if (beta == P(0)) {
+            for (int j = 0; j < nr; ++j) {
+                c[j] = static_cast<T>(alpha * t[j]);
+            }
+        } else {
+            for (int j = 0; j < nr; ++j) {
+                c[j] = static_cast<T>(alpha * t[j] + beta * static_cast<P>(c[j]));
+            }
+        }
+    }
+}
+
+// Multiply a packed MC x KC block of A by a packed KC x NC panel of B into C.
+template <class T, class P>
+void macro_kernel(const MicroKernel<P> &k, int mc, int nc, int kc, P alpha,
+                  const P *Ap, const P *Bp, P beta, T *C, int ldc) {
+    const int MR = k.mr, NR = k.nr;
+    alignas(POOL_ALIGNMENT) P ab[SIMD_MAX_MR * SIMD_MAX_NR_F32];
+    for (int jr = 0; jr < nc; jr += NR) {
+        int nr = std::min(NR, nc - jr);
+        const P *b = Bp + jr * kc;
+        for (int ir = 0; ir < mc; ir += MR) {
+            int mr = std::min(MR, mc - ir);
+            k.run(kc, Ap + ir * kc, b, ab);
+            store_tile(NR, mr, nr, alpha, ab, beta, C + ir * ldc + jr, ldc);
+        }
+    }
+}
+
+// Unpacked i-p-j loop for the products that are too thin for packing to pay off
+// (e.g. matrix-vector products where n == 1): every row of C is a sum of scaled rows of B.
+template <class T, class P>
+void small_gemm(int m, int n, int k, P alpha, const T *A, int rsa, int csa,
+                const T *B, int rsb, int csb, P beta, T *C, int ldc) {
+    std::vector<P, PoolAllocator<P>> row(std::is_same<T, P>::value ? 0 : n);
+    for (int i = 0; i < m; ++i) {
+        if (n == 1) {
+            P sum = P(0);
+            for (int p = 0; p < k; ++p) {
+                sum += static_cast<P>(A[i * rsa + p * csa]) * static_cast<P>(B[p * rsb]);
+            }
+            T *c = C + i * ldc;
+            c[0] = static_cast<T>(beta == P(0) ? alpha * sum : alpha * sum + beta * static_cast<P>(c[0]));
+            continue;
+        }
+        // The row of C is accumulated in place, or in `row` when it is stored in another type.
+        P *c = row.data();
+        if constexpr (std::is_same<T, P>::value) {
+            c = C + i * ldc;
+        }
+        for (int j = 0; j < n; ++j) {
+            c[j] = beta == P(0) ? P(0) : beta * static_cast<P>(C[i * ldc + j]);
+        }
+        for (int p = 0; p < k; ++p) {
+            P a = alpha * static_cast<P>(A[i * rsa + p * csa]);
+            const T *b = B + p * rsb;
+            for (int j = 0; j < n; ++j) {
+                c[j] += a * static_cast<P>(b[j * csb]);
+            }
+        }
+        if constexpr (!std::is_same<T, P>::value) {
+            for (int j = 0; j < n; ++j) {
+                C[i * ldc + j] = static_cast<T>(c[j]);
+            }
+        }
+    }
+}
+
+template <class T, class P>
+void scale(int m, int n, P beta, T *C, int ldc) {
+    for (int i = 0; i < m; ++i) {
+        for (int j = 0; j < n; ++j) {
+            C[i * ldc + j] = static_cast<T>(beta == P(0) ? P(0) : beta * static_cast<P>(C[i * ldc + j]));
+        }
+    }
+}
+
+// Block of an operand read through its strides, element (i, j) is p[i * rs + j * cs].
+struct Operand {
+    const double *p;
+    int rs, cs;
+
+    Operand block(int i, int j) const { return Operand{p + static_cast<long>(i) * rs + static_cast<long>(j) * cs, rs, cs}; }
+};
+
+// Elements per chunk of the block additions of Strassen.
+const int ADD_GRAIN = 1 << 15;
+
+// C = X + sign * Y for m x n blocks. C may be X or Y (element by element in place).
+void add(int m, int n, Operand X, double sign, Operand Y, double *C, int ldc) {
+    parallel_for(m, std::max(1, ADD_GRAIN / std::max(n, 1)), [&](int i0, int i1) {
+        for (int i = i0; i < i1; ++i) {
+            const double *x = X.p + static_cast<long>(i) * X.rs;
+            const double *y = Y.p + static_cast<long>(i) * Y.rs;
+            double *c = C + static_cast<long>(i) * ldc;
+            if (X.cs == 1 && Y.cs == 1) {
+                for (int j = 0; j < n; ++j) {
+                    c[j] = x[j] + sign * y[j];
+                }
+            } else {
+                for (int j = 0; j < n; ++j) {
+                    c[j] = x[j * X.cs] + sign * y[j * Y.cs];
+                }
+            }
+        }
+    });
+}
+
+bool strassen_leaf(int m, int n, int k, int crossover) {
+    return std::min(m, std::min(n, k)) < std::max(crossover, 2);
+}
+
+// Doubles of workspace needed by strassen() for an m x n x k product.
+size_t strassen_workspace(int m, int n, int k, int crossover) {
+    if (strassen_leaf(m, n, k, crossover)) {
+        return 0;
+    }
+    const size_t m2 = m / 2, n2 = n / 2, k2 = k / 2;
+    return m2 * k2 + k2 * n2 + m2 * n2 + strassen_workspace(m / 2, n / 2, k / 2, crossover);
+}
+
+// C = A * B (m x k times k x n) with the Winograd variant of Strassen. As in the schedules of
+// Boyer, Dumas, Pernet and Zhou ("Memory efficient scheduling of Strassen-Winograd's matrix
+// multiplication algorithm", 2009), the quadrants of C hold the partial products, so a level
+// only needs three temporaries, X (m/2 x k/2), Y (k/2 x n/2) and Z (m/2 x n/2), at the start of
+// `ws`. The recursive products share the rest of the workspace since they run one after another.
+void strassen(int m, int n, int k, Operand A, Operand B, double *C, int ldc, int crossover, double *ws) {
+    if (strassen_leaf(m, n, k, crossover)) {
+        dgemm(m, n, k, 1.0, A.p, A.rs, A.cs, B.p, B.rs, B.cs, 0.0, C, ldc);
+        return;
+    }
+    const int m2 = m / 2, n2 = n / 2, k2 = k / 2;
+    const Operand A11 = A, A12 = A.block(0, k2), A21 = A.block(m2, 0), A22 = A.block(m2, k2);
+    const Operand B11 = B, B12 = B.block(0, n2), B21 = B.block(k2, 0), B22 = B.block(k2, n2);
+    double *C11 = C, *C12 = C + n2, *C21 = C + static_cast<long>(m2) * ldc, *C22 = C21 + n2;
+    double *X = ws, *Y = X + static_cast<size_t>(m2) * k2, *Z = Y + static_cast<size_t>(k2) * n2;
+    double *next = Z + static_cast<size_t>(m2) * n2;
+    const Operand x{X, k2, 1}, y{Y, n2, 1}, z{Z, n2, 1};
+    const Operand c11{C11, ldc, 1}, c12{C12, ldc, 1}, c21{C21, ldc, 1}, c22{C22, ldc, 1};
+
+    add(m2, k2, A11, -1.0, A21, X, k2);             // S3 = A11 - A21
+    add(k2, n2, B22, -1.0, B12, Y, n2);             // T3 = B22 - B12
+    strassen(m2, n2, k2, x, y, C21, ldc, crossover, next); // P7 = S3 T3
+    add(m2, k2, A21, 1.0, A22, X, k2);              // S1 = A21 + A22
+    add(k2, n2, B12, -1.0, B11, Y, n2);             // T1 = B12 - B11
+    strassen(m2, n2, k2, x, y, C22, ldc, crossover, next); // P5 = S1 T1
+    add(m2, k2, x, -1.0, A11, X, k2);               // S2 = S1 - A11
+    add(k2, n2, B22, -1.0, y, Y, n2);               // T2 = B22 - T1
+    strassen(m2, n2, k2, x, y, C12, ldc, crossover, next); // P6 = S2 T2
+    add(m2, k2, A12, -1.0, x, X, k2);               // S4 = A12 - S2
+    strassen(m2, n2, k2, x, B22, C11, ldc, crossover, next); // P3 = S4 B22
+    strassen(m2, n2, k2, A11, B11, Z, n2, crossover, next);  // P1 = A11 B11
+    add(m2, n2, c12, 1.0, z, C12, ldc);             // U2 = P1 + P6
+    add(m2, n2, c21, 1.0, c12, C21, ldc);           // U3 = U2 + P7
+    add(m2, n2, c12, 1.0, c22, C12, ldc);           // U4 = U2 + P5
+    add(m2, n2, c12, 1.0, c11, C12, ldc);           // C12 = U5 = U4 + P3
+    add(m2, n2, c22, 1.0, c21, C22, ldc);           // C22 = U7 = U3 + P5
+    add(k2, n2, y, -1.0, B21, Y, n2);               // T4 = T2 - B21
+    strassen(m2, n2, k2, A22, y, C11, ldc, crossover, next); // P4 = A22 T4
+    add(m2, n2, c21, -1.0, c11, C21, ldc);          // C21 = U6 = U3 - P4
+    strassen(m2, n2, k2, A12, B21, C11, ldc, crossover, next); // P2 = A12 B21
+    add(m2, n2, c11, 1.0, z, C11, ldc);             // C11 = U1 = P1 + P2
+
+    // Odd dimensions: the last column of A / row of B, then the last column and row of C.
+    if (k % 2 != 0) {
+        const Operand a = A.block(0, k - 1), b = B.block(k - 1, 0);
+        dgemm(2 * m2, 2 * n2, 1, 1.0, a.p, a.rs, a.cs, b.p, b.rs, b.cs, 1.0, C, ldc);
+    }
+    if (n % 2 != 0) {
+        const Operand b = B.block(0, n - 1);
+        dgemm(m, 1, k, 1.0, A.p, A.rs, A.cs, b.p, b.rs, b.cs, 0.0, C + n - 1, ldc);
+    }
+    if (m % 2 != 0) {
+        const Operand a = A.block(m - 1, 0);
+        dgemm(1, 2 * n2, k, 1.0, a.p, a.rs, a.cs, B.p, B.rs, B.cs, 0.0, C + static_cast<long>(m - 1) * ldc, ldc);
+    }
+}
+
+int default_strassen_crossover() {
+    const char *env = std::getenv("MATRIX_STRASSEN");
+    return env != nullptr && std::atoi(env) > 0 ? std::atoi(env) : 0;
+}
+
+std::atomic<int> &strassen_crossover_value() {
+    static std::atomic<int> crossover(default_strassen_crossover());
+    return crossover;
+}
+
+// The blocked product on elements of type T, computed in P by the micro-kernel of P.
+template <class T, class P>
+void gemm_blocked(int m, int n, int k, P alpha, const T *A, int rsa, int csa, const T *B, int rsb, int csb,
+                  P beta, T *C, int ldc) {
+    if (m <= 0 || n <= 0) {
+        return;
+    }
+    if (k <= 0 || alpha == P(0)) {
+        scale(m, n, beta, C, ldc);
+        return;
+    }
+
+    const MicroKernel<P> kernel = micro_kernel(simd(), P(0));
+    const int MR = kernel.mr, NR = kernel.nr;
+    const long flops = static_cast<long>(m) * n * k;
+    if (n < NR || m < MR || flops < 16 * 16 * 16) {
+        // Enough rows per chunk for it to be worth a task.
+        int grain = static_cast<int>(std::max(1L, PARALLEL_MIN_FLOPS / (static_cast<long>(n) * k)));
+        parallel_for(m, grain, [&](int i0, int i1) {
+            small_gemm(i1 - i0, n, k, alpha, A + i0 * rsa, rsa, csa, B, rsb, csb, beta, C + i0 * ldc, ldc);
+        });
+        return;
+    }
+    const bool parallel = flops >= PARALLEL_MIN_FLOPS && ThreadPool::instance().numThreads() > 1;
+
+    // Row blocks of at most MC rows, smaller when needed to give every thread a block.
+    int threads = parallel ? ThreadPool::instance().numThreads() : 1;
+    int mb = std::min(MC, ((m + threads - 1) / threads + MR - 1) / MR * MR);
+    int n_blocks = (m + mb - 1) / mb;
+
+    // The packing buffers are reused across calls to avoid an allocation per product.
+    // A parallel product gets its own B buffer since the calling thread may run another
+    // product from the pool while it waits for the tasks sharing this one.
+    // They come from the pool, so every packed micro-panel is aligned for the micro-kernel.
+    typedef std::vector<P, PoolAllocator<P>> buffer;
+    thread_local buffer Bp_cache;
+    buffer Bp_local;
+    buffer &Bp = parallel ? Bp_local : Bp_cache;
+    int NCr = (std::min(NC, n) + NR - 1) / NR * NR;
+    int KCr = std::min(KC, k);
+    Bp.resize(static_cast<size_t>(KCr) * NCr);
+
+    for (int jc = 0; jc < n; jc += NC) {
+        int nc = std::min(NC, n - jc);
+        int n_panels = (nc + NR - 1) / NR;
+        for (int pc = 0; pc < k; pc += KC) {
+            int kc = std::min(KC, k - pc);
+            parallel_for(n_panels, parallel ? 1 : n_panels, [&](int j0, int j1) {
+                int jr = j0 * NR;
+                pack_B(NR, kc, std::min(j1 * NR, nc) - jr, B + pc * rsb + (jc + jr) * csb, rsb, csb, Bp.data() + jr * kc);
+            });
+            // beta is only applied by the first rank-kc update, the next ones accumulate.
+            P beta_pc = pc == 0 ? beta : P(1);
+            parallel_for(n_blocks, parallel ? 1 : n_blocks, [&](int b0, int b1) {
+                thread_local buffer Ap;
+                Ap.resize(static_cast<size_t>(std::min(MC, m) + MR - 1) / MR * MR * kc);
+                for (int ic = b0 * mb; ic < std::min(b1 * mb, m); ic += mb) {
+                    int mc = std::min(mb, m - ic);
+                    pack_A(MR, mc, kc, A + ic * rsa + pc * csa, rsa, csa, Ap.data());
+                    macro_kernel(kernel, mc, nc, kc, alpha, Ap.data(), Bp.data(), beta_pc, C + ic * ldc + jc, ldc);
+                }
+            });
+        }
+    }
+}
+
+} // namespace
+
+void dgemm(bool transA, bool transB, int m, int n, int k,
+           double alpha, const double *A, int lda,
+           const double *B, int ldb,
+           double beta, double *C, int ldc) {
+    dgemm(m, n, k, alpha,
+          A, transA ? 1 : lda, transA ? lda : 1,
+          B, transB ? 1 : ldb, transB ? ldb : 1,
+          beta, C, ldc);
+}
+
+void dgemm(int m, int n, int k,
+           double alpha, const double *A, int rsa, int csa,
+           const double *B, int rsb, int csb,
+           double beta, double *C, int ldc) {
+    gemm_blocked(m, n, k, alpha, A, rsa, csa, B, rsb, csb, beta, C, ldc);
+}
+
+void sgemm(int m, int n, int k, float alpha, const float *A, int rsa, int csa, const float *B, int rsb, int csb,
+           float beta, float *C, int ldc) {
+    gemm_blocked(m, n, k, alpha, A, rsa, csa, B, rsb, csb, beta, C, ldc);
+}
+
+void sgemm(int m, int n, int k, float alpha, const bfloat16 *A, int rsa, int csa, const bfloat16 *B, int rsb,
+           int csb, float beta, bfloat16 *C, int ldc) {
+    gemm_blocked(m, n, k, alpha, A, rsa, csa, B, rsb, csb, beta, C, ldc);
+}
+
+void dgemm_strassen(bool transA, bool transB, int m, int n, int k,
+                    const double *A, int lda, const double *B, int ldb,
+                    double *C, int ldc, int crossover) {
+    if (crossover <= 0 || m <= 0 || n <= 0 || k <= 0 || strassen_leaf(m, n, k, crossover)) {
+        dgemm(transA, transB, m, n, k, 1.0, A, lda, B, ldb, 0.0, C, ldc);
+        return;
+    }
+    // As the B buffer of dgemm: reused across calls, except when other products could run
+    // on this thread while it waits for the pool.
+    thread_local pooled_vector ws_cache;
+    pooled_vector ws_local;
+    pooled_vector &ws = ThreadPool::instance().numThreads() > 1 ? ws_local : ws_cache;
+    ws.resize(strassen_workspace(m, n, k, crossover));
+    strassen(m, n, k, Operand{A, transA ? 1 : lda, transA ? lda : 1}, Operand{B, transB ? 1 : ldb, transB ? ldb : 1},
+             C, ldc, crossover, ws.data());
+}
+
+int strassen_crossover() {
+    return strassen_crossover_value().load(std::memory_order_relaxed);
+}
+
+void set_strassen_crossover(int crossover) {
+    strassen_crossover_value().store(std::max(crossover, 0), std::memory_order_relaxed);
+}
@@ -0,0 +1,57 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include "bfloat16.hpp"
+
+// Blocked matrix-matrix product on row-major storage:
+//      C = alpha * op(A) * op(B) + beta * C
+// where op(X) is X, or X^T when transX is true, op(A) is m x k, op(B) is k x n and C is m x n.
+// lda, ldb and ldc are the leading dimensions of A, B and C as stored (before op).
+// The transposed operands are read in place, they are never copied to a transposed matrix.
+// When beta == 0, C is not read (so it may contain uninitialized values).
+void dgemm(bool transA, bool transB, int m, int n, int k,
+           double alpha, const double *A, int lda,
+           const double *B, int ldb,
+           double beta, double *C, int ldc);
+
+// Same product with arbitrary strides: element (i, p) of A is A[i * rsa + p * csa]
+// and element (p, j) of B is B[p * rsb + j * csb].
+void dgemm(int m, int n, int k,
+           double alpha, const double *A, int rsa, int csa,
+           const double *B, int rsb, int csb,
+           double beta, double *C, int ldc);
+
+// The same blocked product on float or bfloat16 elements (basic_matrix.hpp), with arbitrary
+// strides as above, computed in float by the float micro-kernel of simd.hpp (twice the flops
+// per instruction of dgemm). The packing converts the blocks of A and B to float while laying
+// them out, so no full copy of the operands is made, and the tiles of C are rounded to its type
+// when stored.
+void sgemm(int m, int n, int k,
+           float alpha, const float *A, int rsa, int csa,
+           const float *B, int rsb, int csb,
+           float beta, float *C, int ldc);
+void sgemm(int m, int n, int k,
+           float alpha, const bfloat16 *A, int rsa, int csa,
+           const bfloat16 *B, int rsb, int csb,
+           float beta, bfloat16 *C, int ldc);
+
+// Strassen-Winograd product C = op(A) * op(B) (alpha = 1, beta = 0, other arguments as dgemm).
+// Every level of the recursion splits the operands in 2 x 2 blocks and computes the product
+// with 7 block products instead of 8 (and 15 block additions), down to the blocks whose smallest
+// dimension is below `crossover`, which go to the blocked dgemm. The odd last row / column /
+// depth of a level is handled by dgemm too. When crossover <= 0 or min(m, n, k) < crossover,
+// this is simply dgemm.
+// The error grows with the number of levels: 2 to 3x per level for random operands,
+// against the n * eps of the classic product (see `matrix_bench strassen`).
+// The temporary blocks of all the levels are carved out of one workspace allocated per call.
+void dgemm_strassen(bool transA, bool transB, int m, int n, int k,
+                    const double *A, int lda, const double *B, int ldb,
+                    double *C, int ldc, int crossover);
+
+// Crossover used by the products of Matrix (operator*): 0 (the default) disables Strassen,
+// otherwise the products whose three dimensions are at least `crossover` go through
+// dgemm_strassen. The initial value is read from the environment variable MATRIX_STRASSEN.
+int strassen_crossover();
+void set_strassen_crossover(int crossover);
+
+#endif // GEMM_H
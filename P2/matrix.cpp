@@ -1,23 +1,35 @@
 #include "matrix.hpp"
+#include "gemm.hpp"
+#include "simd.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
 #include <vector>
 #include <functional>
 
 
-Matrix::Matrix(int n_rows, int n_cols){
+Matrix::BasicMatrix(int n_rows, int n_cols){
     rows = n_rows;
     cols = n_cols;
-    data = std::vector<double>(rows * cols, 0.0);
+    data.assign(static_cast<size_t>(rows) * cols, 0.0);
 }
 
 
-Matrix::Matrix(const Matrix &other){
+Matrix::BasicMatrix(const Matrix &other){
     rows = other.rows;
     cols = other.cols;
     data = other.data;
 }
 
 
+Matrix::BasicMatrix(Matrix &&other) noexcept : rows(other.rows), cols(other.cols), data(std::move(other.data)){
+    other.rows = 0;
+    other.cols = 0;
+    other.data.clear();
+}
+
+
 double Matrix::get(int i, int j) const{
     return data[i * cols + j];
 }
@@ -43,29 +55,15 @@ void Matrix::fill(double value){
     }
 }
 
-Matrix Matrix::operator+(const Matrix &other) const{
-    Matrix m(rows, cols);
-    for(int i = 0; i < rows; i++){
-        for(int j = 0; j < cols; j++){
-            m.set(i,j, data[i * cols + j] + other.get(i,j));
-        }
-    }
-    return m;
-}
-
-Matrix Matrix::operator*(double scalar) const{
-    Matrix m(rows, cols);
-    for(int i = 0; i < rows; i++){
-        for(int j = 0; j < cols; j++){
-            m.set(i,j, data[i * cols + j]*scalar);
-        }
-    }
-    return m;
-}
-
-Matrix Matrix::operator-(const Matrix &other) const{
-    return *this + (other * -1);
-}
+// Les opérations élément par élément passent par les noyaux SIMD (simd.hpp)
+// choisis au démarrage selon le CPU (SSE2, AVX2 ou AVX-512).
+// Au-delà de ELEMENTWISE_GRAIN éléments, elles sont découpées en morceaux répartis
+// sur le pool de threads (threadpool.hpp) ; en dessous, elles restent sur le thread appelant.
+//
+// QUATRIEME VERSION de +, - et * scalaire : ce ne sont plus des méthodes qui renvoient
+// chacune une nouvelle matrice mais des expressions paresseuses (matrix_expr.hpp),
+// évaluées en une seule boucle au moment de l'affectation. `a + b - c` ne crée plus
+// de matrice intermédiaire et `w = w - g * lr` ne fait plus aucune allocation.
 
 // PREMIERE VERSION
 //Matrix Matrix::operator*(const Matrix &other) const{
@@ -86,49 +84,192 @@ Matrix Matrix::operator-(const Matrix &other) const{
 // Temps d'execution moyen (sur 20 echantillions) pour une matrice 500x500 : 858 ms
 
 //DEUXIEME VERSION
-Matrix Matrix::operator*(const Matrix &other) const{
+//Matrix Matrix::operator*(const Matrix &other) const{
+//    Matrix m(rows, other.numCols());
+//    Matrix otherT = other.transpose();
+//    for(int i = 0; i < rows; i++){
+//        for(int j = 0; j < other.numCols(); j++){
+//            double sum = 0;
+//            for(int k = 0; k < cols; k++){
+//                sum += data[i * cols + k] * otherT.get(j,k);
+//            }
+//            m.set(i,j,sum);
+//        }
+//    }
+//    return m;
+//}
+//Bien qu'un peu meilleur, cette version presente les mêmes problèmes de cache
+// Temps d'execution moyen (sur 20 echantillions) pour une matrice 500x500 : 771 ms
+
+//TROISIEME VERSION
+// GEMM par blocs (L1/L2/L3) avec panneaux de A et B empaquetés, voir gemm.cpp.
+// Plus besoin de la transposée : le packing de B range déjà les éléments dans l'ordre
+// où le micro-noyau les lit. Voir `make bench` pour le balayage en taille.
+//
+// QUATRIEME VERSION (optionnelle)
+// Strassen-Winograd au-dessus de la GEMM par blocs (dgemm_strassen, gemm.cpp) : 7 produits de
+// blocs au lieu de 8 par niveau de récursion, jusqu'à ce que la plus petite dimension passe
+// sous le seuil `strassen_crossover()`. Désactivé par défaut (seuil 0), à activer avec
+// set_strassen_crossover(n) ou MATRIX_STRASSEN=n : voir `matrix_bench strassen` pour le gain et
+// l'erreur selon la taille. Seuls les produits (operator*) l'utilisent, pas Matrix::gemm.
+Matrix Matrix::operator*(ConstMatrixView other) const{
+    if(cols != other.numRows()){
+        throw std::invalid_argument("Matrix dimensions do not match for multiplication");
+    }
     Matrix m(rows, other.numCols());
-    Matrix otherT = other.transpose();
-    for(int i = 0; i < rows; i++){
-        for(int j = 0; j < other.numCols(); j++){
-            double sum = 0;
-            for(int k = 0; k < cols; k++){
-                sum += data[i * cols + k] * otherT.get(j,k);
-            }
-            m.set(i,j,sum);
-        }
+    dgemm_strassen(false, false, rows, other.numCols(), cols, data.data(), cols, other.data(), other.stride(), m.data.data(), m.cols, strassen_crossover());
+    return m;
+}
+
+// Même produit, mais A et/ou B peuvent être lus transposés (le packing de gemm.cpp
+// parcourt simplement la matrice dans l'autre sens) et C est mis à jour sur place.
+// Les opérandes sont des vues (matrix_view.hpp) : dgemm prend déjà une dimension principale
+// par matrice, un bloc est donc lu/écrit directement dans la matrice qui le contient.
+void Matrix::gemm(bool transA, bool transB, double alpha, ConstMatrixView A, ConstMatrixView B,
+                  double beta, MatrixView C){
+    int m = transA ? A.numCols() : A.numRows();
+    int k = transA ? A.numRows() : A.numCols();
+    int n = transB ? B.numRows() : B.numCols();
+    if((transB ? B.numCols() : B.numRows()) != k || C.numRows() != m || C.numCols() != n){
+        throw std::invalid_argument("Matrix dimensions do not match for gemm");
+    }
+    if(views_overlap(C, A) || views_overlap(C, B)){
+        throw std::invalid_argument("The output of gemm must not alias its operands");
     }
+    dgemm(transA, transB, m, n, k, alpha, A.data(), A.stride(), B.data(), B.stride(), beta, C.data(), C.stride());
+}
+
+// op(a) * op(b) dans une nouvelle matrice, les vues transposées sont passées telles quelles
+// à dgemm (ou dgemm_strassen) avec transA / transB.
+static Matrix product(bool transA, ConstMatrixView a, bool transB, ConstMatrixView b){
+    if((transA ? a.numRows() : a.numCols()) != (transB ? b.numCols() : b.numRows())){
+        throw std::invalid_argument("Matrix dimensions do not match for multiplication");
+    }
+    Matrix m(transA ? a.numCols() : a.numRows(), transB ? b.numRows() : b.numCols());
+    dgemm_strassen(transA, transB, m.numRows(), m.numCols(), transA ? a.numRows() : a.numCols(),
+                   a.data(), a.stride(), b.data(), b.stride(), m.view().data(), m.numCols(), strassen_crossover());
     return m;
 }
-//Bien qu'un peu meilleur, cette version presente les mêmes problèmes de cache
-// Temps d'execution moyen (sur 20 echantillions) pour une matrice 500x500 : 771 ms
 
+Matrix operator*(ConstMatrixView a, ConstMatrixView b){
+    return product(false, a, false, b);
+}
+
+Matrix operator*(TransposedView a, ConstMatrixView b){
+    return product(true, a.transpose(), false, b);
+}
 
+Matrix operator*(ConstMatrixView a, TransposedView b){
+    return product(false, a, true, b.transpose());
+}
 
+Matrix operator*(TransposedView a, TransposedView b){
+    return product(true, a.transpose(), true, b.transpose());
+}
 
+Matrix Matrix::operator*(const TransposedView &other) const{
+    return product(false, view(), true, other.transpose());
+}
 
-Matrix Matrix::transpose() const{
-    Matrix m(cols, rows);
-    for(int i = 0; i < rows; i++){
-        for(int j = 0; j < cols; j++){
-            m.set(j,i, data[i * cols + j]);
-        }
-    }
-    return m;
+// transpose() ne copie plus rien (vue paresseuse), la copie transposée n'est faite qu'ici.
+Matrix::BasicMatrix(const TransposedView &t) : rows(t.numRows()), cols(t.numCols()), data(static_cast<size_t>(rows) * cols){
+    transpose_into(t.transpose(), view());
 }
 
-Matrix Matrix::apply(const std::function<double(double)> &func) const{
-    Matrix m(rows, cols);
-    for(int i = 0; i < rows; i++){
-        for(int j = 0; j < cols; j++){
-            m.set(i,j, func(data[i * cols + j]));
+// Transposée par tuiles : l'ancienne boucle (m.set(j, i, ...) ligne par ligne) écrivait
+// chaque élément d'une ligne dans une ligne différente de la destination, donc une ligne de
+// cache et souvent une page différente par élément dès que la matrice est grande.
+// Ici chaque tuile TRANSPOSE_TILE x TRANSPOSE_TILE de la source et la tuile correspondante de
+// la destination (2 x 32 Ko) restent en cache (L1/L2) le temps de la copie, et la tuile est
+// elle-même transposée par blocs de la largeur SIMD dans les registres (simd().transpose).
+// 16, 32, 64 et 128 ont été essayés avec `matrix_bench transpose` : 64 est le meilleur compromis.
+static const int TRANSPOSE_TILE = 64;
+
+void transpose_into(ConstMatrixView a, MatrixView out){
+    if(out.numRows() != a.numCols() || out.numCols() != a.numRows()){
+        throw std::invalid_argument("Matrix dimensions do not match for transpose");
+    }
+    if(views_overlap(out, a)){
+        throw std::invalid_argument("The output of transpose must not alias its input");
+    }
+    const SimdKernels &kernels = simd();
+    const int rows = a.numRows(), cols = a.numCols();
+    const int row_tiles = (rows + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE;
+    parallel_for(row_tiles, std::max(1, elementwise_row_grain(cols) / TRANSPOSE_TILE), [&](int t0, int t1){
+        for(int t = t0; t < t1; t++){
+            int i = t * TRANSPOSE_TILE;
+            int n_rows = std::min(TRANSPOSE_TILE, rows - i);
+            for(int j = 0; j < cols; j += TRANSPOSE_TILE){
+                kernels.transpose(n_rows, std::min(TRANSPOSE_TILE, cols - j), a.data() + static_cast<long>(i) * a.stride() + j,
+                                  a.stride(), out.data() + static_cast<long>(j) * out.stride() + i, out.stride());
+            }
         }
+    });
+}
+
+void Matrix::sub_mul(double scalar, const Matrix &other){
+    axpy(-scalar, other);
+}
+
+void Matrix::axpy(double alpha, const Matrix &other){
+    if(rows != other.rows || cols != other.cols){
+        throw std::invalid_argument("Matrix dimensions do not match for axpy");
     }
-    return m;
+    parallel_for(rows * cols, ELEMENTWISE_GRAIN, [&](int begin, int end){
+        simd().axpy(end - begin, alpha, other.data.data() + begin, data.data() + begin);
+    });
 }
 
+// apply est maintenant un template (matrix.hpp) : la fonction est inlinée
+// dans la boucle au lieu d'un appel indirect par std::function pour chaque élément.
+// Les activations prédéfinies (activations.hpp) passent par les noyaux SIMD ci-dessous.
+Matrix Matrix::activation(Activation f, MathMode mode) const{
+    return apply_activation(view(), f, mode, false);
+}
 
-void Matrix::sub_mul(double scalar, const Matrix &other){
-    *this = *this + other * ((-1)*scalar);
+Matrix Matrix::activation_derivative(Activation f, MathMode mode) const{
+    return apply_activation(view(), f, mode, true);
+}
+
+// Vue contiguë : un seul tableau découpé en morceaux de ELEMENTWISE_GRAIN éléments.
+// Sinon (ex: colRange), le noyau est appelé sur chaque ligne de la vue.
+Matrix apply_activation(ConstMatrixView x, Activation f, MathMode mode, bool derivative){
+    Matrix m(x.numRows(), x.numCols());
+    apply_activation_into(x, f, mode, derivative, m.view());
+    return m;
 }
 
+// La sortie est écrite ligne par ligne selon son propre pas (elle peut être un bloc).
+void apply_activation_into(ConstMatrixView x, Activation f, MathMode mode, bool derivative, MatrixView m){
+    if(m.numRows() != x.numRows() || m.numCols() != x.numCols()){
+        throw std::invalid_argument("Matrix dimensions do not match for apply_activation_into");
+    }
+    const SimdKernels &kernels = simd();
+    void (*kernel)(int, const double *, double *) =
+        derivative ? kernels.activation_derivative[static_cast<int>(mode)][static_cast<int>(f)]
+                   : kernels.activation[static_cast<int>(mode)][static_cast<int>(f)];
+    double *out = m.data();
+    int cols = x.numCols();
+    if(x.isContiguous() && m.isContiguous()){
+        parallel_for(x.numRows() * cols, ELEMENTWISE_GRAIN, [&](int begin, int end){
+            kernel(end - begin, x.data() + begin, out + begin);
+        });
+    } else{
+        parallel_for(x.numRows(), elementwise_row_grain(cols), [&](int i0, int i1){
+            for(int i = i0; i < i1; i++){
+                kernel(cols, x.data() + static_cast<long>(i) * x.stride(), out + static_cast<long>(i) * m.stride());
+            }
+        });
+    }
+}
+
+void Matrix::activation_backward(Activation f, const Matrix &input_values, const Matrix &output_gradient,
+                                 MathMode mode){
+    if(rows != input_values.rows || cols != input_values.cols || rows != output_gradient.rows || cols != output_gradient.cols){
+        throw std::invalid_argument("Matrix dimensions do not match for activation_backward");
+    }
+    parallel_for(rows * cols, ELEMENTWISE_GRAIN, [&](int begin, int end){
+        simd().activation_backward[static_cast<int>(mode)][static_cast<int>(f)](end - begin, input_values.data.data() + begin,
+                                                                                output_gradient.data.data() + begin, data.data() + begin);
+    });
+}
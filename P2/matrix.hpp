@@ -3,19 +3,50 @@
 
 #include <vector>
 #include <functional>
+#include <utility>
 
 #include "abstractmatrix.hpp"
+#include "activations.hpp"
+#include "basic_matrix.hpp"
+#include "matrix_expr.hpp"
+#include "matrix_view.hpp"
+#include "pool_allocator.hpp"
 
-class Matrix : public AbstractMatrix
+// Matrix of double. The reduced precision matrices (BasicMatrix<float>, BasicMatrix<bfloat16>)
+// and the conversions between element types are in basic_matrix.hpp.
+template <>
+class BasicMatrix<double> : public AbstractMatrix, public MatrixExpr<Matrix>
 {
 private:
     int rows, cols;
-    std::vector<double> data;
+    pooled_vector data; // 64-byte aligned, from the pool of pool_allocator.hpp
 
 public:
+    typedef double value_type;
+    typedef MatrixView view_type;
+    typedef ConstMatrixView const_view_type;
+
     // Constructors
-    Matrix(int rows, int cols);
-    Matrix(const Matrix &other);
+    BasicMatrix(int rows, int cols);
+    BasicMatrix(const Matrix &other);
+    // Move constructor: takes over the storage of `other`, which is left empty (0 x 0).
+    BasicMatrix(Matrix &&other) noexcept;
+    // Materialises a transposed view (copy in transposed order).
+    BasicMatrix(const TransposedView &t);
+    // Evaluates an element-wise expression (e.g. `Matrix c = a + b * 2.0;`, see matrix_expr.hpp).
+    template <class E>
+    BasicMatrix(const MatrixExpr<E> &expr) : rows(expr.self().numRows()), cols(expr.self().numCols()),
+                                             data(static_cast<size_t>(rows) * cols)
+    {
+        evaluate(expr.self(), data.data());
+    }
+    // Copy of a reduced precision matrix (e.g. `Matrix w64(w32);`), through the conversion kernels.
+    template <class U>
+    explicit BasicMatrix(const BasicMatrix<U> &other) : rows(other.numRows()), cols(other.numCols()),
+                                                        data(static_cast<size_t>(rows) * cols)
+    {
+        convert(other.view().data(), data.data(), rows * cols);
+    }
 
     // Basic access
     double get(int i, int j) const;
@@ -24,23 +55,102 @@ public:
     // Getters for the number of rows and columns
     int numRows() const;
     int numCols() const;
+    // See matrix_expr.hpp.
+    template <class V>
+    bool aliases(const V &dst) const { return view().aliases(dst); }
 
     // Fill the entire matrix with a single value.
     void fill(double value);
 
+    // Element access for the expression templates (no bounds check, not virtual)
+    double coeff(int i, int j) const { return data[i * cols + j]; }
+
+    // Non-owning views of the elements (see matrix_view.hpp), e.g. the columns of a mini-batch
+    // or a block of a weight matrix, to work on them in place without copying them.
+    MatrixView view() { return MatrixView(data.data(), rows, cols, cols); }
+    ConstMatrixView view() const { return ConstMatrixView(data.data(), rows, cols, cols); }
+    MatrixView block(int i, int j, int n_rows, int n_cols) { return view().block(i, j, n_rows, n_cols); }
+    ConstMatrixView block(int i, int j, int n_rows, int n_cols) const { return view().block(i, j, n_rows, n_cols); }
+    MatrixView rowRange(int i, int n_rows) { return view().rowRange(i, n_rows); }
+    ConstMatrixView rowRange(int i, int n_rows) const { return view().rowRange(i, n_rows); }
+    MatrixView colRange(int j, int n_cols) { return view().colRange(j, n_cols); }
+    ConstMatrixView colRange(int j, int n_cols) const { return view().colRange(j, n_cols); }
+
     // Elementary operations
-    Matrix operator+(const Matrix &other) const; // Addition
-    Matrix operator*(const Matrix &other) const; // Matrix multiplication
-    
-    // Transpose: returns a new Matrix that is the transpose.
-    Matrix transpose() const;
+    // Addition, subtraction and scalar multiplication (a + b, a - b, a * 2.0) are the lazy
+    // expressions of matrix_expr.hpp, evaluated in one pass when assigned to a Matrix.
+    // Matrix multiplication (by a Matrix or a view). The products whose three dimensions reach
+    // strassen_crossover() (gemm.hpp, off by default) use the Strassen-Winograd recursion.
+    Matrix operator*(ConstMatrixView other) const;
+    // Product by a transposed matrix (e.g. `a * b.transpose()`), read in place by GEMM.
+    Matrix operator*(const TransposedView &other) const;
+
+    // General matrix product (BLAS-like): C = alpha * op(A) * op(B) + beta * C
+    // where op(X) is X, or X^T when transX is true. The operands are read in transposed
+    // order directly (no transpose() copy) and C is updated in place: use beta = 1 to
+    // accumulate into C. C must already be op(A).numRows() x op(B).numCols() and must not
+    // share an element with A or B (see views_overlap in matrix_view.hpp: disjoint blocks of the
+    // same matrix are fine, views of it with another stride are only compared by address range).
+    // The operands may be matrices or views (e.g. `gemm(false, false, 1.0, W.block(...), X.colRange(...), 0.0, Y)`),
+    // which are read and written in place through their stride.
+    static void gemm(bool transA, bool transB, double alpha, ConstMatrixView A, ConstMatrixView B,
+                     double beta, MatrixView C);
+
+    // Transpose: returns a lazy view of the transpose (matrix_view.hpp), nothing is copied.
+    // Products read it in place (`a.transpose() * b` is a single GEMM with transA), as do the
+    // element-wise expressions; `Matrix t = a.transpose();` makes the transposed copy.
+    TransposedView transpose() const { return TransposedView(view()); }
 
     // Apply a function element–wise.
-    Matrix apply(const std::function<double(double)> &func) const;
+    // `func` may be any callable (lambda, functor, function pointer, std::function): it is
+    // inlined in a single pass over the matrix, which is split over the thread pool for
+    // large matrices, so `func` may be called concurrently. The built-in activations of
+    // activations.hpp (e.g. `m.apply(Tanh())`) run the vectorised kernels instead.
+    template <class F>
+    Matrix apply(F func) const
+    {
+        if constexpr (is_builtin_activation<F>::value)
+        {
+            return F::derivative ? activation_derivative(F::activation, func.mode) : activation(F::activation, func.mode);
+        }
+        else
+        {
+            return Matrix(cwise(func, *this));
+        }
+    }
+    // Same into `out`, which must have the shape of this matrix: its storage is reused and
+    // nothing is allocated (e.g. to replay a captured graph, see Tape in globals.hpp).
+    template <class F>
+    void apply_into(F func, Matrix &out) const;
 
     // Subtract the product of a scalar and a given matrix: "this = this - scalar * other"
     void sub_mul(double scalar, const Matrix &other);
 
+    // In-place operations, they neither allocate nor create temporaries.
+    // "this = this + alpha * other"
+    void axpy(double alpha, const Matrix &other);
+    template <class E>
+    Matrix &operator+=(const MatrixExpr<E> &expr) { return *this = *this + expr; }
+    template <class E>
+    Matrix &operator-=(const MatrixExpr<E> &expr) { return *this = *this - expr; }
+    Matrix &operator*=(double scalar) { return *this = *this * scalar; }
+
+    // Built-in activations (vectorised): f(this), f'(this) and, for the backward pass,
+    // "this = this + output_gradient * f'(input_values)" (gradient accumulator).
+    // `mode` trades accuracy for speed in the underlying exp (see activations.hpp).
+    Matrix activation(Activation f, MathMode mode = MathMode::Precise) const;
+    Matrix activation_derivative(Activation f, MathMode mode = MathMode::Precise) const;
+    void activation_backward(Activation f, const Matrix &input_values, const Matrix &output_gradient,
+                             MathMode mode = MathMode::Precise);
+
+    // Applies sigmoid element-wise: Returns a matrix containing sigmoid(this)
+    Matrix sigmoid(MathMode mode = MathMode::Precise) const { return activation(Activation::Sigmoid, mode); }
+    // Calculates gradient for sigmoid and adds it to 'this' matrix (gradient accumulator).
+    void sigmoid_backward(const Matrix &input_values, const Matrix &output_gradient, MathMode mode = MathMode::Precise)
+    {
+        activation_backward(Activation::Sigmoid, input_values, output_gradient, mode);
+    }
+
     // Add copy assignment operator (For students: you can ignore this)
     Matrix &operator=(const Matrix &other)
     {
@@ -52,6 +162,95 @@ public:
         }
         return *this;
     }
+
+    // Move assignment: takes over the storage of `other`, which is left empty (0 x 0).
+    Matrix &operator=(Matrix &&other) noexcept
+    {
+        if (this != &other)
+        {
+            rows = other.rows;
+            cols = other.cols;
+            data = std::move(other.data);
+            other.rows = 0;
+            other.cols = 0;
+            other.data.clear();
+        }
+        return *this;
+    }
+
+    // Transposed copy, through a temporary so that `a = a.transpose();` works.
+    Matrix &operator=(const TransposedView &t) { return *this = Matrix(t); }
+
+    // Evaluates an element-wise expression in place, the storage is only reallocated if the
+    // shape changes. `this` may appear in the expression (e.g. `w = w - g * lr;`): when the
+    // expression reads other elements of `this` than the one it computes (`a = a.transpose() * 2.0`)
+    // or views `this` with another shape, it is evaluated into a temporary that is moved in.
+    template <class E>
+    Matrix &operator=(const MatrixExpr<E> &expr)
+    {
+        const E &e = expr.self();
+        if (e.aliases(view()))
+        {
+            return *this = Matrix(e);
+        }
+        if (e.numRows() != rows || e.numCols() != cols)
+        {
+            rows = e.numRows();
+            cols = e.numCols();
+            data.resize(static_cast<size_t>(rows) * cols);
+        }
+        evaluate(e, data.data());
+        return *this;
+    }
 };
 
+// Products of views, the transposed ones are read in place by GEMM (Matrix * Matrix, Matrix * view
+// and Matrix * TransposedView are the member operator*).
+Matrix operator*(ConstMatrixView a, ConstMatrixView b);
+Matrix operator*(TransposedView a, ConstMatrixView b);
+Matrix operator*(ConstMatrixView a, TransposedView b);
+Matrix operator*(TransposedView a, TransposedView b);
+
+// out = a^T, by tiles that stay in cache and are transposed in SIMD registers. `out` must be
+// a.numCols() x a.numRows() and must not overlap `a`. This is the copy made by
+// `Matrix t = a.transpose();`, it also works between blocks (e.g. `transpose_into(w.block(...), g.block(...))`).
+void transpose_into(ConstMatrixView a, MatrixView out);
+
+// Built-in activation f (or f' when `derivative` is true) of every element of `x`, through the
+// vectorised kernels (row by row when the rows of `x` are not contiguous).
+Matrix apply_activation(ConstMatrixView x, Activation f, MathMode mode, bool derivative);
+// Same into `out`, which must have the shape of `x` (and may be `x` itself).
+void apply_activation_into(ConstMatrixView x, Activation f, MathMode mode, bool derivative, MatrixView out);
+
+template <class F>
+void Matrix::apply_into(F func, Matrix &out) const
+{
+    if (out.rows != rows || out.cols != cols)
+    {
+        throw std::invalid_argument("Matrix dimensions do not match for apply_into");
+    }
+    if constexpr (is_builtin_activation<F>::value)
+    {
+        apply_activation_into(view(), F::activation, func.mode, F::derivative, out.view());
+    }
+    else
+    {
+        out = cwise(func, *this);
+    }
+}
+
+template <class T>
+template <class F>
+Matrix BasicMatrixView<T>::apply(F func) const
+{
+    if constexpr (is_builtin_activation<F>::value)
+    {
+        return apply_activation(*this, F::activation, func.mode, F::derivative);
+    }
+    else
+    {
+        return Matrix(cwise(func, *this));
+    }
+}
+
 #endif // MATRIX_H
@@ -0,0 +1,552 @@
+#include "matrix.hpp"
+#include "batched_matrix.hpp"
+#include "gemm.hpp"
+#include "quantized_matrix.hpp"
+#include "sparse_matrix.hpp"
+#include "simd.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Benchmarks for the Matrix kernels.
+//      ./matrix_bench gemm [max_size] [peak_gflops]
+//      ./matrix_bench exp [n]
+//      ./matrix_bench transpose [max_size]
+//      ./matrix_bench precision [size]
+//      ./matrix_bench int8 [size]
+//      ./matrix_bench sparse [size]
+//      ./matrix_bench strassen [max_size]
+//      ./matrix_bench batched [batch]
+// `peak_gflops` is the theoretical single-core peak of the machine
+// (frequency x FMA units x 2 x SIMD width), it is only used to print the fraction reached.
+// `exp` measures the error (in ulps, against libm) and the speed of the vectorised exp and
+// sigmoid in both MathMode, on `n` elements (default 1 << 20), in double and in float.
+// `transpose` compares the bandwidth of the tiled transpose with the previous element by element
+// loop, on square matrices up to `max_size` (default 4096, 16384 needs 4 GB of memory).
+// `precision` times the same operations on matrices of double, float and bfloat16
+// (basic_matrix.hpp): an element-wise update, sub_mul and the sigmoid on size x size matrices
+// (default 4096), and a 512 x 512 product, with the speedups of float and bfloat16 over double.
+// `int8` compares y = W x for a size x size weight matrix (default 4096) in double (Matrix::gemm)
+// and quantised (quantized_matrix.hpp), for batches of 1 to 256 samples, with the error of the
+// quantised product relative to the largest element of y.
+// `sparse` times the first layer of the MLP, W x with W 512 x size (default 4096) and a batch x of
+// 256 inputs with 1% to 50% of non-zeros, with Matrix::gemm and with spmm on x in CSR and CSC.
+// `strassen` times the square products A * B up to `max_size` (default 4096) with the blocked GEMM
+// and with Strassen-Winograd for several crossovers (gemm.hpp), with the error of both against
+// a long double reference on a sample of elements, relative to sum_k |a_ik| |b_kj|.
+// `batched` times `batch` (default 4096) independent products of the shape of the first layer of
+// the MLP, 128 x 2 times 2 x 1, one Matrix::gemm per sample against one batched_gemm
+// (batched_matrix.hpp), with weights shared by the batch or one weight matrix per sample.
+
+namespace {
+
+Matrix random_matrix(int rows, int cols, std::mt19937 &gen) {
+    std::uniform_real_distribution<double> dis(-1.0, 1.0);
+    Matrix m(rows, cols);
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j < cols; ++j) {
+            m.set(i, j, dis(gen));
+        }
+    }
+    return m;
+}
+
+// Second version of `Matrix::operator*` (transpose then dot products), kept as reference.
+Matrix reference_product(const Matrix &a, const Matrix &b) {
+    Matrix bT = b.transpose();
+    Matrix c(a.numRows(), b.numCols());
+    for (int i = 0; i < a.numRows(); ++i) {
+        for (int j = 0; j < b.numCols(); ++j) {
+            double sum = 0;
+            for (int k = 0; k < a.numCols(); ++k) {
+                sum += a.get(i, k) * bT.get(j, k);
+            }
+            c.set(i, j, sum);
+        }
+    }
+    return c;
+}
+
+// Previous `Matrix::transpose` (element by element, following the rows of the source), kept as reference.
+void reference_transpose(const Matrix &a, Matrix &t) {
+    parallel_for(a.numRows(), elementwise_row_grain(a.numCols()), [&](int i0, int i1) {
+        for (int i = i0; i < i1; ++i) {
+            for (int j = 0; j < a.numCols(); ++j) {
+                t.set(j, i, a.get(i, j));
+            }
+        }
+    });
+}
+
+double max_abs_diff(const Matrix &a, const Matrix &b) {
+    double err = 0;
+    for (int i = 0; i < a.numRows(); ++i) {
+        for (int j = 0; j < a.numCols(); ++j) {
+            err = std::max(err, std::fabs(a.get(i, j) - b.get(i, j)));
+        }
+    }
+    return err;
+}
+
+// Best wall time in seconds of `f` over enough repetitions to last ~0.2s.
+template <typename F>
+double best_time(F &&f) {
+    using clock = std::chrono::steady_clock;
+    double best = 1e30, total = 0;
+    for (int rep = 0; rep < 50 && (rep < 3 || total < 0.2); ++rep) {
+        auto start = clock::now();
+        f();
+        double t = std::chrono::duration<double>(clock::now() - start).count();
+        best = std::min(best, t);
+        total += t;
+    }
+    return best;
+}
+
+void bench_gemm_shape(int m, int n, int k, double peak, std::mt19937 &gen) {
+    Matrix a = random_matrix(m, k, gen);
+    Matrix b = random_matrix(k, n, gen);
+    Matrix c(m, n);
+    double t = best_time([&]() { c = a * b; });
+    double gflops = 2.0 * m * n * k / t * 1e-9;
+
+    std::cout << std::setw(6) << m << std::setw(6) << n << std::setw(6) << k
+              << std::setw(12) << std::fixed << std::setprecision(3) << t * 1e3
+              << std::setw(10) << std::setprecision(2) << gflops;
+    if (peak > 0) {
+        std::cout << std::setw(8) << std::setprecision(1) << 100.0 * gflops / peak << "%";
+    } else {
+        std::cout << std::setw(9) << "-";
+    }
+    // The reference is cubic with a bad memory access pattern, only run it on small sizes.
+    if (static_cast<double>(m) * n * k <= 512.0 * 512 * 512) {
+        Matrix ref(m, n);
+        double t_ref = best_time([&]() { ref = reference_product(a, b); });
+        std::cout << std::setw(12) << std::setprecision(1) << t_ref / t << "x"
+                  << std::setw(12) << std::scientific << std::setprecision(1) << max_abs_diff(c, ref);
+    }
+    std::cout << std::defaultfloat << std::endl;
+}
+
+void bench_gemm(int max_size, double peak) {
+    std::mt19937 gen(42);
+    std::cout << "Square GEMM sweep (C = A * B), " << simd().name << " kernels" << std::endl;
+    std::cout << std::setw(6) << "m" << std::setw(6) << "n" << std::setw(6) << "k"
+              << std::setw(12) << "time [ms]" << std::setw(10) << "GFLOP/s" << std::setw(9) << "peak"
+              << std::setw(13) << "vs. v2" << std::setw(12) << "max err" << std::endl;
+    for (int n = 32; n <= max_size; n *= 2) {
+        bench_gemm_shape(n, n, n, peak, gen);
+        if (n * 3 / 2 <= max_size) {
+            bench_gemm_shape(n * 3 / 2, n * 3 / 2, n * 3 / 2, peak, gen);
+        }
+    }
+    // Shapes of the MLP layers: hidden x input times input x batch.
+    std::cout << "MLP shaped GEMM" << std::endl;
+    for (int hidden : {1024, 2048, 4096}) {
+        if (hidden <= max_size) {
+            bench_gemm_shape(hidden, 256, hidden, peak, gen);
+            bench_gemm_shape(hidden, 1, hidden, peak, gen);
+        }
+    }
+}
+
+bool is_transpose(const Matrix &a, const Matrix &t) {
+    for (int i = 0; i < a.numRows(); ++i) {
+        for (int j = 0; j < a.numCols(); ++j) {
+            if (t.get(j, i) != a.get(i, j)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Bandwidth counts one read and one write of every element.
+void bench_transpose_shape(int m, int n, std::mt19937 &gen) {
+    Matrix a = random_matrix(m, n, gen);
+    Matrix t(n, m);
+    double t_tiled = best_time([&]() { transpose_into(a, t); });
+    bool ok = is_transpose(a, t);
+    double t_ref = best_time([&]() { reference_transpose(a, t); });
+    ok = ok && is_transpose(a, t);
+    double bytes = 2.0 * sizeof(double) * m * n;
+
+    std::cout << std::setw(7) << m << std::setw(7) << n << std::fixed << std::setprecision(2)
+              << std::setw(12) << t_tiled * 1e3 << std::setw(10) << bytes / t_tiled * 1e-9
+              << std::setw(12) << t_ref * 1e3 << std::setw(10) << bytes / t_ref * 1e-9
+              << std::setw(9) << std::setprecision(1) << t_ref / t_tiled << "x"
+              << std::setw(6) << (ok ? "ok" : "WRONG") << std::defaultfloat << std::endl;
+}
+
+void bench_transpose(int max_size) {
+    std::mt19937 gen(42);
+    std::cout << "Transpose bandwidth (T = A^T), tiled " << simd().name << " kernel against the element by element loop"
+              << std::endl;
+    std::cout << std::setw(7) << "m" << std::setw(7) << "n" << std::setw(12) << "tiled [ms]" << std::setw(10) << "GB/s"
+              << std::setw(12) << "loop [ms]" << std::setw(10) << "GB/s" << std::setw(10) << "speedup" << std::endl;
+    for (int n = 256; n <= max_size; n *= 2) {
+        bench_transpose_shape(n, n, gen);
+        // Powers of two are the worst case for cache associativity, compare with a neighbour.
+        if (n + 8 <= max_size) {
+            bench_transpose_shape(n + 8, n + 8, gen);
+        }
+    }
+    // Shapes of the MLP: a batch of 256 columns against a hidden layer.
+    for (int hidden : {1024, 4096}) {
+        if (hidden <= max_size) {
+            bench_transpose_shape(hidden, 256, gen);
+        }
+    }
+}
+
+// Error of `y` in units in the last place of `ref`.
+double ulp_error(double y, double ref) {
+    if (y == ref) {
+        return 0.0;
+    }
+    double a = std::fabs(ref);
+    return std::fabs(y - ref) / (std::nextafter(a, INFINITY) - a);
+}
+
+double ulp_error_f32(float y, float ref) {
+    if (y == ref) {
+        return 0.0;
+    }
+    float a = std::fabs(ref);
+    return std::fabs(y - ref) / (std::nextafter(a, INFINITY) - a);
+}
+
+struct ExpCase {
+    const char *name;
+    void (*run)(int n, const double *x, double *y);
+};
+
+void bench_exp(int n) {
+    std::mt19937 gen(42);
+    // Half of the points spread over the whole range of exp, half in the usual range of activations.
+    std::uniform_real_distribution<double> wide(-708.0, 709.0), narrow(-20.0, 20.0);
+    std::vector<double> x(n), y(n), ref(n);
+    for (int i = 0; i < n; ++i) {
+        x[i] = i % 2 == 0 ? wide(gen) : narrow(gen);
+    }
+
+    std::cout << "Vectorised exp and sigmoid against libm on " << n << " elements, " << simd().name << " kernels"
+              << std::endl;
+    std::cout << std::setw(20) << "" << std::setw(14) << "ns / element" << std::setw(12) << "speedup"
+              << std::setw(14) << "max ulp" << std::endl;
+
+    auto report = [&](const char *name, double t, double t_libm, const double *out, const double *expected) {
+        double worst = 0.0;
+        for (int i = 0; i < n; ++i) {
+            worst = std::max(worst, ulp_error(out[i], expected[i]));
+        }
+        std::cout << std::setw(20) << name << std::setw(14) << std::fixed << std::setprecision(2) << t / n * 1e9
+                  << std::setw(11) << std::setprecision(1) << t_libm / t << "x"
+                  << std::setw(14) << std::setprecision(1) << worst << std::defaultfloat << std::endl;
+    };
+
+    double t_libm = best_time([&]() {
+        for (int i = 0; i < n; ++i) {
+            ref[i] = std::exp(x[i]);
+        }
+    });
+    report("exp libm", t_libm, t_libm, ref.data(), ref.data());
+    const ExpCase exps[] = {{"exp precise", simd().exp[static_cast<int>(MathMode::Precise)]},
+                            {"exp fast", simd().exp[static_cast<int>(MathMode::Fast)]}};
+    for (const ExpCase &c : exps) {
+        double t = best_time([&]() { c.run(n, x.data(), y.data()); });
+        report(c.name, t, t_libm, y.data(), ref.data());
+    }
+
+    // Sigmoid only matters (and only has full relative accuracy to measure) on the narrow range.
+    for (int i = 0; i < n; ++i) {
+        x[i] = narrow(gen);
+    }
+    t_libm = best_time([&]() {
+        for (int i = 0; i < n; ++i) {
+            ref[i] = 1.0 / (1.0 + std::exp(-x[i]));
+        }
+    });
+    report("sigmoid libm", t_libm, t_libm, ref.data(), ref.data());
+    const int sigmoid = static_cast<int>(Activation::Sigmoid);
+    const ExpCase sigmoids[] = {{"sigmoid precise", simd().activation[static_cast<int>(MathMode::Precise)][sigmoid]},
+                                {"sigmoid fast", simd().activation[static_cast<int>(MathMode::Fast)][sigmoid]}};
+    for (const ExpCase &c : sigmoids) {
+        double t = best_time([&]() { c.run(n, x.data(), y.data()); });
+        report(c.name, t, t_libm, y.data(), ref.data());
+    }
+
+    // Hidden layer of the MLP: 4096 units x batch of 256, through Matrix::apply (thread pool included).
+    Matrix z = random_matrix(4096, 256, gen);
+    Matrix a(4096, 256);
+    double t_apply = best_time([&]() { a = z.apply(Sigmoid()); });
+    double t_fast = best_time([&]() { a = z.apply(Sigmoid{MathMode::Fast}); });
+    std::cout << "Matrix::apply(Sigmoid) on 4096 x 256: " << std::fixed << std::setprecision(3) << t_apply * 1e3
+              << " ms precise, " << t_fast * 1e3 << " ms fast" << std::defaultfloat << std::endl;
+
+    // The float kernels of the reduced precision matrices, against expf, on the range of float.
+    std::uniform_real_distribution<float> wide_f32(-87.0f, 88.0f), narrow_f32(-20.0f, 20.0f);
+    std::vector<float> xf(n), yf(n), reff(n);
+    auto report_f32 = [&](const char *name, double t, double t_libm) {
+        double worst = 0.0;
+        for (int i = 0; i < n; ++i) {
+            worst = std::max(worst, ulp_error_f32(yf[i], reff[i]));
+        }
+        std::cout << std::setw(20) << name << std::setw(14) << std::fixed << std::setprecision(2) << t / n * 1e9
+                  << std::setw(11) << std::setprecision(1) << t_libm / t << "x"
+                  << std::setw(14) << std::setprecision(1) << worst << std::defaultfloat << std::endl;
+    };
+    for (int i = 0; i < n; ++i) {
+        xf[i] = i % 2 == 0 ? wide_f32(gen) : narrow_f32(gen);
+    }
+    t_libm = best_time([&]() {
+        for (int i = 0; i < n; ++i) {
+            reff[i] = std::exp(xf[i]);
+        }
+    });
+    for (int mode = 0; mode < MATH_MODE_COUNT; ++mode) {
+        double t = best_time([&]() { simd().exp_f32[mode](n, xf.data(), yf.data()); });
+        report_f32(mode == 0 ? "exp float precise" : "exp float fast", t, t_libm);
+    }
+    for (int i = 0; i < n; ++i) {
+        xf[i] = narrow_f32(gen);
+    }
+    t_libm = best_time([&]() {
+        for (int i = 0; i < n; ++i) {
+            reff[i] = 1.0f / (1.0f + std::exp(-xf[i]));
+        }
+    });
+    for (int mode = 0; mode < MATH_MODE_COUNT; ++mode) {
+        double t = best_time([&]() { simd().activation_f32[mode][sigmoid](n, xf.data(), yf.data()); });
+        report_f32(mode == 0 ? "sigmoid float prec." : "sigmoid float fast", t, t_libm);
+    }
+}
+
+struct PrecisionTimes {
+    double update, sub_mul, sigmoid, gemm;
+};
+
+template <class T>
+PrecisionTimes bench_precision_type(const char *name, const Matrix &x64, const Matrix &a64, const Matrix &b64) {
+    BasicMatrix<T> x(x64), y(x64), a(a64), b(b64), c(a64.numRows(), b64.numCols());
+    const double bytes = 3.0 * sizeof(T) * x.numRows() * x.numCols();
+    PrecisionTimes t;
+    t.update = best_time([&] { y = y * 0.5 + x; });
+    t.sub_mul = best_time([&] { y.sub_mul(1e-3, x); });
+    t.sigmoid = best_time([&] { y = x.apply(Sigmoid()); });
+    t.gemm = best_time([&] { BasicMatrix<T>::gemm(false, false, 1.0, a, b, 0.0, c); });
+    double flops = 2.0 * a.numRows() * a.numCols() * b.numCols();
+    std::cout << std::setw(10) << name << std::fixed << std::setprecision(2) << std::setw(14) << t.update * 1e3
+              << std::setw(10) << bytes / t.update * 1e-9 << std::setw(14) << t.sub_mul * 1e3 << std::setw(15)
+              << t.sigmoid * 1e3 << std::setw(12) << t.gemm * 1e3 << std::setw(10) << flops / t.gemm * 1e-9
+              << std::defaultfloat << std::endl;
+    return t;
+}
+
+void bench_precision(int size) {
+    std::mt19937 gen(42);
+    Matrix x = random_matrix(size, size, gen);
+    Matrix a = random_matrix(512, 512, gen), b = random_matrix(512, 512, gen);
+    std::cout << "Element types on " << size << " x " << size << " matrices (y = 0.5 y + x, y.sub_mul(s, x), "
+              << "y = sigmoid(x)) and a 512 x 512 product, " << simd().name << " kernels" << std::endl;
+    std::cout << std::setw(10) << "type" << std::setw(14) << "update [ms]" << std::setw(10) << "GB/s" << std::setw(14)
+              << "sub_mul [ms]" << std::setw(15) << "sigmoid [ms]" << std::setw(12) << "gemm [ms]" << std::setw(10)
+              << "GFLOPS" << std::endl;
+    PrecisionTimes t64 = bench_precision_type<double>("double", x, a, b);
+    PrecisionTimes t32 = bench_precision_type<float>("float", x, a, b);
+    PrecisionTimes t16 = bench_precision_type<bfloat16>("bfloat16", x, a, b);
+    // Speedups over double: the reduced precision types must be worth their rounding.
+    std::cout << "speedup over double (update, sub_mul, sigmoid, gemm):" << std::fixed << std::setprecision(1);
+    const char *names[] = {"float", "bfloat16"};
+    const PrecisionTimes reduced[] = {t32, t16};
+    for (int k = 0; k < 2; ++k) {
+        const PrecisionTimes &t = reduced[k];
+        std::cout << "  " << names[k] << " " << t64.update / t.update << "x " << t64.sub_mul / t.sub_mul << "x "
+                  << t64.sigmoid / t.sigmoid << "x " << t64.gemm / t.gemm << "x";
+    }
+    std::cout << std::defaultfloat << std::endl;
+}
+
+void bench_int8(int size) {
+    std::mt19937 gen(42);
+    Matrix w = random_matrix(size, size, gen);
+    QuantizedMatrix wq(w.view());
+    std::cout << "y = W x with W " << size << " x " << size << ": " << std::fixed << std::setprecision(1)
+              << size * (size * sizeof(double)) / 1048576.0 << " MB in double, " << wq.bytes() / 1048576.0
+              << " MB in int8 (kernel " << simd().name << ")" << std::defaultfloat << std::endl;
+    std::cout << std::setw(8) << "batch" << std::setw(14) << "double [ms]" << std::setw(12) << "int8 [ms]"
+              << std::setw(10) << "speedup" << std::setw(16) << "rel. error" << std::endl;
+    for (int batch : {1, 16, 64, 256}) {
+        Matrix x = random_matrix(size, batch, gen);
+        Matrix y(size, batch), yq(size, batch);
+        double t = best_time([&]() { Matrix::gemm(false, false, 1.0, w, x, 0.0, y); });
+        double tq = best_time([&]() { wq.multiply(x, yq); });
+        double err = 0.0, scale = 0.0;
+        for (int i = 0; i < size; ++i) {
+            for (int j = 0; j < batch; ++j) {
+                err = std::max(err, std::fabs(yq.get(i, j) - y.get(i, j)));
+                scale = std::max(scale, std::fabs(y.get(i, j)));
+            }
+        }
+        std::cout << std::setw(8) << batch << std::fixed << std::setprecision(3) << std::setw(14) << t * 1e3
+                  << std::setw(12) << tq * 1e3 << std::setw(9) << std::setprecision(1) << t / tq << "x"
+                  << std::setw(16) << std::scientific << std::setprecision(2) << err / scale << std::defaultfloat
+                  << std::endl;
+    }
+}
+
+void bench_sparse(int size) {
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> unit(0.0, 1.0), dis(-1.0, 1.0);
+    Matrix w = random_matrix(512, size, gen);
+    Matrix y(512, 256), ys(512, 256);
+    std::cout << "W x with W 512 x " << size << " and x " << size << " x 256" << std::endl;
+    std::cout << std::setw(10) << "density" << std::setw(14) << "dense [ms]" << std::setw(12) << "CSR [ms]"
+              << std::setw(12) << "CSC [ms]" << std::endl;
+    for (double density : {0.01, 0.05, 0.2, 0.5}) {
+        Matrix x(size, 256);
+        for (int i = 0; i < size; ++i) {
+            for (int j = 0; j < 256; ++j) {
+                if (unit(gen) < density) {
+                    x.set(i, j, dis(gen));
+                }
+            }
+        }
+        SparseMatrix csr(x), csc(x, SparseMatrix::Format::CSC);
+        double t = best_time([&]() { Matrix::gemm(false, false, 1.0, w, x, 0.0, y); });
+        double t_csr = best_time([&]() { spmm(1.0, w, false, csr, 0.0, ys); });
+        double t_csc = best_time([&]() { spmm(1.0, w, false, csc, 0.0, ys); });
+        std::cout << std::setw(9) << density * 100 << "%" << std::fixed << std::setprecision(3) << std::setw(14)
+                  << t * 1e3 << std::setw(12) << t_csr * 1e3 << std::setw(12) << t_csc * 1e3 << std::defaultfloat
+                  << std::endl;
+    }
+}
+
+// Largest error of c on `samples` random elements, against the product in long double and
+// relative to sum_k |a_ik b_kj| (the scale of the usual error bounds).
+double product_error(const Matrix &a, const Matrix &b, const Matrix &c, int samples, std::mt19937 &gen) {
+    std::uniform_int_distribution<int> row(0, c.numRows() - 1), col(0, c.numCols() - 1);
+    double err = 0.0;
+    for (int s = 0; s < samples; ++s) {
+        int i = row(gen), j = col(gen);
+        long double sum = 0.0L, scale = 0.0L;
+        for (int k = 0; k < a.numCols(); ++k) {
+            long double p = static_cast<long double>(a.get(i, k)) * b.get(k, j);
+            sum += p;
+            scale += std::fabs(p);
+        }
+        err = std::max(err, static_cast<double>(std::fabs(c.get(i, j) - sum) / scale));
+    }
+    return err;
+}
+
+void bench_strassen(int max_size) {
+    std::mt19937 gen(42);
+    const int previous = strassen_crossover();
+    std::cout << "Square products C = A * B, " << simd().name << " kernels" << std::endl;
+    std::cout << std::setw(6) << "n" << std::setw(11) << "crossover" << std::setw(8) << "levels"
+              << std::setw(12) << "time [ms]" << std::setw(10) << "GFLOP/s" << std::setw(10) << "speedup"
+              << std::setw(12) << "rel. error" << std::endl;
+    for (int n = 256; n <= max_size; n *= 2) {
+        Matrix a = random_matrix(n, n, gen);
+        Matrix b = random_matrix(n, n, gen);
+        Matrix c(n, n);
+        double t_classic = 0.0;
+        for (int crossover : {0, 64, 128, 256, 512, 1024}) {
+            if (crossover > n) {
+                break;
+            }
+            set_strassen_crossover(crossover);
+            double t = best_time([&]() { c = a * b; });
+            int levels = 0;
+            for (int size = n; crossover > 0 && size >= crossover; size /= 2) {
+                ++levels;
+            }
+            if (crossover == 0) {
+                t_classic = t;
+            }
+            // The GFLOP/s are those of the classic product (2 n^3 flops), to compare the times.
+            std::cout << std::setw(6) << n;
+            if (crossover == 0) {
+                std::cout << std::setw(11) << "classic";
+            } else {
+                std::cout << std::setw(11) << crossover;
+            }
+            std::cout << std::setw(8) << levels << std::fixed << std::setprecision(3) << std::setw(12) << t * 1e3
+                      << std::setw(10) << std::setprecision(2) << 2.0 * n * n * n / t * 1e-9 << std::setw(9)
+                      << t_classic / t << "x" << std::setw(12) << std::scientific << std::setprecision(2)
+                      << product_error(a, b, c, 256, gen) << std::defaultfloat << std::endl;
+        }
+    }
+    set_strassen_crossover(previous);
+}
+
+void bench_batched(int batch) {
+    std::mt19937 gen(42);
+    const int m = 128, k = 2;
+    std::vector<Matrix> w, x, y;
+    std::vector<ConstMatrixView> w_views, x_views;
+    for (int s = 0; s < batch; ++s) {
+        w.push_back(random_matrix(m, k, gen));
+        x.push_back(random_matrix(k, 1, gen));
+        y.push_back(Matrix(m, 1));
+    }
+    for (int s = 0; s < batch; ++s) {
+        w_views.push_back(w[s]);
+        x_views.push_back(x[s]);
+    }
+    BatchedMatrix W(w_views), X(x_views), Y(batch, m, 1);
+    std::cout << batch << " products " << m << " x " << k << " times " << k << " x 1, " << simd().name
+              << " kernels" << std::endl;
+    std::cout << std::setw(14) << "weights" << std::setw(20) << "per sample [ns]" << std::setw(18)
+              << "batched [ns]" << std::setw(10) << "speedup" << std::endl;
+    for (bool shared : {true, false}) {
+        double t = best_time([&]() {
+            for (int s = 0; s < batch; ++s) {
+                Matrix::gemm(false, false, 1.0, shared ? w[0] : w[s], x[s], 0.0, y[s]);
+            }
+        });
+        double t_batched = best_time([&]() {
+            batched_gemm(false, false, 1.0, shared ? ConstBatchedView(w[0].view()) : ConstBatchedView(W), X, 0.0, Y);
+        });
+        std::cout << std::setw(14) << (shared ? "shared" : "per sample") << std::fixed << std::setprecision(1)
+                  << std::setw(20) << t / batch * 1e9 << std::setw(18) << t_batched / batch * 1e9 << std::setw(9)
+                  << t / t_batched << "x" << std::defaultfloat << std::endl;
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const char *what = argc > 1 ? argv[1] : "gemm";
+    int max_size = argc > 2 ? std::atoi(argv[2]) : 2048;
+    double peak = argc > 3 ? std::atof(argv[3]) : 0.0;
+
+    if (std::strcmp(what, "gemm") == 0) {
+        bench_gemm(max_size, peak);
+    } else if (std::strcmp(what, "exp") == 0) {
+        bench_exp(argc > 2 ? max_size : 1 << 20);
+    } else if (std::strcmp(what, "transpose") == 0) {
+        bench_transpose(argc > 2 ? max_size : 4096);
+    } else if (std::strcmp(what, "precision") == 0) {
+        bench_precision(argc > 2 ? max_size : 4096);
+    } else if (std::strcmp(what, "int8") == 0) {
+        bench_int8(argc > 2 ? max_size : 4096);
+    } else if (std::strcmp(what, "sparse") == 0) {
+        bench_sparse(argc > 2 ? max_size : 4096);
+    } else if (std::strcmp(what, "strassen") == 0) {
+        bench_strassen(argc > 2 ? max_size : 4096);
+    } else if (std::strcmp(what, "batched") == 0) {
+        bench_batched(argc > 2 ? max_size : 4096);
+    } else {
+        std::cerr << "Unknown benchmark '" << what << "', expected: gemm, exp, transpose, precision, int8, sparse, strassen or batched"
+                  << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,175 @@
+#ifndef MATRIX_EXPR_H
+#define MATRIX_EXPR_H
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "threadpool.hpp"
+
+// Lazily evaluated element-wise expressions on matrices (expression templates).
+//
+// `A + B`, `A - B`, `-A`, `A * s`, `s * A`, `hadamard(A, B)` and `cwise(f, A)` do not compute anything: they return a small
+// object describing the operation, which references its Matrix operands and holds its
+// sub-expressions by value. The whole expression is only evaluated when it is assigned to
+// (or used to construct) a Matrix, in a single pass over the destination, e.g.
+//      W = W - G * lr;        // one fused loop, no temporary matrix, no allocation
+//      D = A + B - C;
+// The destination may appear in the expression: an element that only depends on the same
+// element of the operands (`W = W - G * lr`) is computed in place, and when the expression reads
+// other elements of the destination (`a = a.transpose() * 2.0`, or an operand viewing the storage
+// of a matrix that is resized) it is evaluated into a temporary first (see `aliases`).
+// An expression must not outlive the matrices it refers to: store results in a Matrix,
+// not in an `auto` variable.
+//
+// An expression type `E` derives from `MatrixExpr<E>` and provides
+//      int numRows() const, int numCols() const and double coeff(int i, int j) const,
+// and `template <class V> bool aliases(const V &dst) const`, true when evaluating the expression
+// into the view `dst` (matrix_view.hpp) would read an element of `dst` other than the one being
+// written (such an element may already be overwritten).
+
+// Element-wise operations are split over the thread pool in chunks of at least this many elements.
+const int ELEMENTWISE_GRAIN = 1 << 15;
+
+// Number of rows per chunk for a row by row pass over a matrix with `cols` columns.
+inline int elementwise_row_grain(int cols) {
+    return std::max(1, ELEMENTWISE_GRAIN / std::max(cols, 1));
+}
+
+template <class E>
+struct MatrixExpr {
+    const E &self() const { return static_cast<const E &>(*this); }
+};
+
+// How an operand is stored inside an expression: sub-expressions are copied (they are just
+// a few references), matrices (BasicMatrix, basic_matrix.hpp) are stored by reference.
+template <class E>
+struct expr_nested {
+    typedef E type;
+};
+
+template <class Op, class L, class R>
+class CwiseBinaryExpr : public MatrixExpr<CwiseBinaryExpr<Op, L, R>> {
+private:
+    typename expr_nested<L>::type lhs;
+    typename expr_nested<R>::type rhs;
+    Op op;
+
+public:
+    CwiseBinaryExpr(const L &lhs, const R &rhs, Op op, const char *error) : lhs(lhs), rhs(rhs), op(op) {
+        if (lhs.numRows() != rhs.numRows() || lhs.numCols() != rhs.numCols()) {
+            throw std::invalid_argument(error);
+        }
+    }
+
+    int numRows() const { return lhs.numRows(); }
+    int numCols() const { return lhs.numCols(); }
+    double coeff(int i, int j) const { return op(lhs.coeff(i, j), rhs.coeff(i, j)); }
+    template <class V>
+    bool aliases(const V &dst) const { return lhs.aliases(dst) || rhs.aliases(dst); }
+};
+
+template <class Op, class E>
+class CwiseUnaryExpr : public MatrixExpr<CwiseUnaryExpr<Op, E>> {
+private:
+    typename expr_nested<E>::type arg;
+    Op op;
+
+public:
+    CwiseUnaryExpr(const E &arg, Op op) : arg(arg), op(op) {}
+
+    int numRows() const { return arg.numRows(); }
+    int numCols() const { return arg.numCols(); }
+    double coeff(int i, int j) const { return op(arg.coeff(i, j)); }
+    template <class V>
+    bool aliases(const V &dst) const { return arg.aliases(dst); }
+};
+
+struct AddOp {
+    double operator()(double a, double b) const { return a + b; }
+};
+
+struct SubOp {
+    double operator()(double a, double b) const { return a - b; }
+};
+
+struct MulOp {
+    double operator()(double a, double b) const { return a * b; }
+};
+
+struct ConstantOp {
+    double value;
+    double operator()(double) const { return value; }
+};
+
+struct ScaleOp {
+    double scalar;
+    double operator()(double a) const { return scalar * a; }
+};
+
+template <class L, class R>
+CwiseBinaryExpr<AddOp, L, R> operator+(const MatrixExpr<L> &a, const MatrixExpr<R> &b) {
+    return CwiseBinaryExpr<AddOp, L, R>(a.self(), b.self(), AddOp(), "Matrix dimensions do not match for addition");
+}
+
+template <class L, class R>
+CwiseBinaryExpr<SubOp, L, R> operator-(const MatrixExpr<L> &a, const MatrixExpr<R> &b) {
+    return CwiseBinaryExpr<SubOp, L, R>(a.self(), b.self(), SubOp(), "Matrix dimensions do not match for subtraction");
+}
+
+template <class E>
+CwiseUnaryExpr<ScaleOp, E> operator*(const MatrixExpr<E> &a, double scalar) {
+    return CwiseUnaryExpr<ScaleOp, E>(a.self(), ScaleOp{scalar});
+}
+
+template <class E>
+CwiseUnaryExpr<ScaleOp, E> operator*(double scalar, const MatrixExpr<E> &a) {
+    return CwiseUnaryExpr<ScaleOp, E>(a.self(), ScaleOp{scalar});
+}
+
+template <class E>
+CwiseUnaryExpr<ScaleOp, E> operator-(const MatrixExpr<E> &a) {
+    return CwiseUnaryExpr<ScaleOp, E>(a.self(), ScaleOp{-1.0});
+}
+
+// Element-wise application of any callable (lambda, functor, function pointer...):
+//      cwise(f, A)(i, j) = f(A(i, j)) and cwise(f, A, B)(i, j) = f(A(i, j), B(i, j)).
+// The callable is stored by value in the expression and inlined in the evaluation loop.
+template <class F, class E>
+CwiseUnaryExpr<F, E> cwise(F func, const MatrixExpr<E> &a) {
+    return CwiseUnaryExpr<F, E>(a.self(), func);
+}
+
+template <class F, class L, class R>
+CwiseBinaryExpr<F, L, R> cwise(F func, const MatrixExpr<L> &a, const MatrixExpr<R> &b) {
+    return CwiseBinaryExpr<F, L, R>(a.self(), b.self(), func, "Matrix dimensions do not match for element-wise operation");
+}
+
+// Element-wise (Hadamard) product
+template <class L, class R>
+CwiseBinaryExpr<MulOp, L, R> hadamard(const MatrixExpr<L> &a, const MatrixExpr<R> &b) {
+    return CwiseBinaryExpr<MulOp, L, R>(a.self(), b.self(), MulOp(), "Matrix dimensions do not match for element-wise product");
+}
+
+// Evaluate `expr` into the rows x cols array `out` whose rows are `ld` elements apart
+// (one pass, split over the thread pool). The elements are computed in double and rounded
+// once when stored, whatever the element type T of the destination (double, float, bfloat16).
+template <class E, class T>
+void evaluate(const E &expr, T *out, long ld) {
+    const int cols = expr.numCols();
+    parallel_for(expr.numRows(), elementwise_row_grain(cols), [&](int i0, int i1) {
+        for (int i = i0; i < i1; ++i) {
+            T *row = out + i * ld;
+            for (int j = 0; j < cols; ++j) {
+                row[j] = static_cast<T>(expr.coeff(i, j));
+            }
+        }
+    });
+}
+
+// Evaluate `expr` into the row-major rows x cols array `out`.
+template <class E, class T>
+void evaluate(const E &expr, T *out) {
+    evaluate(expr, out, expr.numCols());
+}
+
+#endif // MATRIX_EXPR_H
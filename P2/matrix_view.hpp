@@ -0,0 +1,206 @@
+#ifndef MATRIX_VIEW_H
+#define MATRIX_VIEW_H
+
+#include <stdexcept>
+#include <type_traits>
+
+#include "matrix_expr.hpp"
+
+template <class T>
+class BasicMatrix;
+typedef BasicMatrix<double> Matrix;
+template <class T>
+class BasicTransposedView;
+typedef BasicTransposedView<double> TransposedView;
+
+// Non-owning view of a rows x cols block of a row-major array: element (i, j) is at
+// data[i * ld + j], where the leading dimension ld >= cols is the distance between two rows.
+//
+// A view is a pointer, two sizes and a stride: creating or copying one never copies the
+// elements. They are obtained from a Matrix (or another view) with
+//      block(i, j, rows, cols), rowRange(i, rows) and colRange(j, cols),
+// and a Matrix converts implicitly to a view of all its elements.
+// Views are expressions (matrix_expr.hpp), so they mix freely with matrices in element-wise
+// operations, e.g. `Matrix c = a.colRange(0, 32) + b;` or `w.block(0, 0, 4, 4) -= g * lr;`.
+// Matrix::gemm reads them in place through their stride, and `apply` accepts them too.
+//
+// Assigning to a view writes into the elements it refers to (it never rebinds the view), and
+// the shapes must then match. An element may depend on the same element of the destination
+// (`v = v * 2.0`) but not on other elements of it (e.g. a view of an overlapping block).
+// A view must not outlive its matrix, and is invalidated if the matrix is resized or moved.
+//
+// MatrixView refers to mutable elements, ConstMatrixView to read-only ones. The reduced
+// precision matrices of basic_matrix.hpp have views of their element type too (e.g.
+// BasicMatrixView<float>), whose elements are read as double like those of any expression.
+template <class T>
+class BasicMatrixView : public MatrixExpr<BasicMatrixView<T>> {
+private:
+    T *ptr;
+    int rows, cols, ld;
+
+public:
+    typedef BasicMatrix<typename std::remove_const<T>::type> plain_matrix_type;
+    typedef typename std::conditional<std::is_const<T>::value, const plain_matrix_type, plain_matrix_type>::type matrix_type;
+
+    BasicMatrixView(T *data, int rows, int cols, int ld) : ptr(data), rows(rows), cols(cols), ld(ld) {
+        if (rows < 0 || cols < 0 || ld < cols) {
+            throw std::invalid_argument("Invalid MatrixView dimensions");
+        }
+    }
+
+    // View of a whole matrix (defined in basic_matrix.hpp).
+    BasicMatrixView(matrix_type &m);
+
+    // A mutable view converts to a read-only one.
+    template <class U, class = typename std::enable_if<std::is_same<const U, T>::value &&
+                                                       !std::is_same<U, T>::value>::type>
+    BasicMatrixView(const BasicMatrixView<U> &other)
+        : ptr(other.data()), rows(other.numRows()), cols(other.numCols()), ld(other.stride()) {}
+
+    BasicMatrixView(const BasicMatrixView &other) = default;
+
+    int numRows() const { return rows; }
+    int numCols() const { return cols; }
+    // Leading dimension: distance between the first elements of two consecutive rows
+    int stride() const { return ld; }
+    T *data() const { return ptr; }
+    // True when the rows follow each other in memory (e.g. a view of a whole Matrix or a row range)
+    bool isContiguous() const { return ld == cols || rows <= 1; }
+
+    double coeff(int i, int j) const { return ptr[static_cast<long>(i) * ld + j]; }
+    double get(int i, int j) const { return coeff(i, j); }
+    void set(int i, int j, double value) const { ptr[static_cast<long>(i) * ld + j] = static_cast<T>(value); }
+
+    // Sub-views, with bounds checking (std::out_of_range)
+    BasicMatrixView block(int i, int j, int n_rows, int n_cols) const {
+        if (i < 0 || j < 0 || n_rows < 0 || n_cols < 0 || i + n_rows > rows || j + n_cols > cols) {
+            throw std::out_of_range("MatrixView block out of range");
+        }
+        return BasicMatrixView(ptr + static_cast<long>(i) * ld + j, n_rows, n_cols, ld);
+    }
+    BasicMatrixView rowRange(int i, int n_rows) const { return block(i, 0, n_rows, cols); }
+    BasicMatrixView colRange(int j, int n_cols) const { return block(0, j, rows, n_cols); }
+    // Whether evaluating this view into `dst` reads an element of `dst` other than the one
+    // being written: the views share an element and are not the same elements (see matrix_expr.hpp).
+    template <class U>
+    bool aliases(const BasicMatrixView<U> &dst) const {
+        if constexpr (std::is_same<typename std::remove_const<T>::type, typename std::remove_const<U>::type>::value) {
+            const bool same = static_cast<const void *>(ptr) == static_cast<const void *>(dst.data()) &&
+                              ld == dst.stride() && rows == dst.numRows() && cols == dst.numCols();
+            return !same && views_overlap(*this, dst);
+        } else {
+            return false;
+        }
+    }
+
+    // Lazy transpose (see TransposedView below), nothing is copied.
+    BasicTransposedView<typename std::remove_const<T>::type> transpose() const;
+
+    // Writes into the viewed elements, which must have the shape of the expression.
+    template <class E>
+    const BasicMatrixView &operator=(const MatrixExpr<E> &expr) const {
+        const E &e = expr.self();
+        if (e.numRows() != rows || e.numCols() != cols) {
+            throw std::invalid_argument("Matrix dimensions do not match for assignment to a view");
+        }
+        evaluate(e, ptr, ld);
+        return *this;
+    }
+    const BasicMatrixView &operator=(const BasicMatrixView &other) const {
+        return *this = static_cast<const MatrixExpr<BasicMatrixView> &>(other);
+    }
+
+    template <class E>
+    const BasicMatrixView &operator+=(const MatrixExpr<E> &expr) const { return *this = *this + expr; }
+    template <class E>
+    const BasicMatrixView &operator-=(const MatrixExpr<E> &expr) const { return *this = *this - expr; }
+    const BasicMatrixView &operator*=(double scalar) const { return *this = *this * scalar; }
+    void fill(double value) const { *this = cwise(ConstantOp{value}, *this); }
+
+    // Element-wise function, as Matrix::apply (defined in matrix.hpp, for views of double).
+    template <class F>
+    Matrix apply(F func) const;
+};
+
+typedef BasicMatrixView<double> MatrixView;
+typedef BasicMatrixView<const double> ConstMatrixView;
+
+// True when the two views share at least one element (e.g. the output and an operand of a GEMM).
+// Views with the same stride, such as blocks of the same matrix, are compared element-wise: `b`
+// is placed in the rows of width `stride` that start at a.data(), so disjoint blocks whose rows
+// interleave in memory (`m.colRange(0, k)` and `m.colRange(k, k)`) do not overlap. Views with
+// different strides are only compared by the address ranges they span, which may report an
+// overlap for views that have no element in common.
+template <class T, class U>
+bool views_overlap(const BasicMatrixView<T> &a, const BasicMatrixView<U> &b) {
+    static_assert(std::is_same<typename std::remove_const<T>::type, typename std::remove_const<U>::type>::value,
+                  "views_overlap compares views of the same element type");
+    if (a.numRows() == 0 || a.numCols() == 0 || b.numRows() == 0 || b.numCols() == 0) {
+        return false;
+    }
+    const T *a_first = a.data();
+    const U *b_first = b.data();
+    const T *a_end = a_first + static_cast<long>(a.numRows() - 1) * a.stride() + a.numCols();
+    const U *b_end = b_first + static_cast<long>(b.numRows() - 1) * b.stride() + b.numCols();
+    if (!(a_first < b_end && b_first < a_end)) {
+        return false;
+    }
+    if (a.stride() != b.stride()) {
+        return true;
+    }
+    if (b_first < a_first) {
+        return views_overlap(b, a);
+    }
+    // Row r and column c of `b` in the rows of `a`; a row of `b` that goes past the end of a row
+    // of width `stride` continues at the start of the next one.
+    const long ld = a.stride(), offset = b_first - a_first;
+    const long r = offset / ld, c = offset % ld;
+    const bool first_part = r < a.numRows() && c < a.numCols();
+    const bool wrapped_part = c + b.numCols() > ld && r + 1 < a.numRows();
+    return first_part || wrapped_part;
+}
+
+// Lazy transpose of a read-only view: element (i, j) is element (j, i) of the view.
+//
+// Matrix::transpose() and ConstMatrixView::transpose() return it instead of a transposed copy:
+// the products (operator*, see matrix.hpp) hand it to GEMM as a transposed operand, element-wise
+// expressions read it with swapped indices (e.g. `g += dy.transpose();`), and the elements are
+// only copied when a Matrix is built from it (`Matrix t = a.transpose();`).
+// Like any view it must not outlive its matrix. A matrix may be assigned an expression that
+// reads it transposed (`a = a + a.transpose()`), which is then evaluated into a temporary, but a
+// view may not (as for any overlap of the destination of a view, see BasicMatrixView).
+// The views of the reduced precision matrices have one too (BasicTransposedView<float>), for the
+// element-wise expressions only.
+template <class T>
+class BasicTransposedView : public MatrixExpr<BasicTransposedView<T>> {
+private:
+    BasicMatrixView<const T> m;
+
+public:
+    explicit BasicTransposedView(BasicMatrixView<const T> m) : m(m) {}
+
+    int numRows() const { return m.numCols(); }
+    int numCols() const { return m.numRows(); }
+    double coeff(int i, int j) const { return m.coeff(j, i); }
+    double get(int i, int j) const { return coeff(i, j); }
+
+    // (A^T)^T = A: the view that is transposed
+    BasicMatrixView<const T> transpose() const { return m; }
+
+    // Any element read transposed may have been written already (see matrix_expr.hpp).
+    template <class U>
+    bool aliases(const BasicMatrixView<U> &dst) const {
+        if constexpr (std::is_same<T, typename std::remove_const<U>::type>::value) {
+            return views_overlap(m, dst);
+        } else {
+            return false;
+        }
+    }
+};
+
+template <class T>
+BasicTransposedView<typename std::remove_const<T>::type> BasicMatrixView<T>::transpose() const {
+    return BasicTransposedView<typename std::remove_const<T>::type>(*this);
+}
+
+#endif // MATRIX_VIEW_H
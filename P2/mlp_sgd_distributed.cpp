@@ -4,6 +4,8 @@
 #include <random>
 #include <cassert>
 #include <cmath>
+#include <cstddef>
+#include <type_traits>
 #include <mpi.h>
 #include <unistd.h>
 
@@ -19,6 +21,9 @@ public:
     AbstractMatrix* grads;
     std::function<void()> backward_op;
     std::vector<Node*> dependencies;
+    // State of the last backward pass that reached this node (see backward)
+    unsigned backward_pass = 0;
+    int pending_consumers = 0;
 
 public:
     Node(int m, int n) : rows(m), cols(n)
@@ -37,12 +42,21 @@ public:
         this->values = new Matrix(values);
         this->grads = new Matrix(values.numRows(), values.numCols());
     }
+
+    // Takes over the storage of a temporary result instead of copying it
+    Node(Matrix &&values) : rows(values.numRows()), cols(values.numCols())
+    {
+        this->values = new Matrix(std::move(values));
+        this->grads = new Matrix(rows, cols);
+    }
     
-    Node(const DistributedMatrix& dMatrix) : 
+    Node(const DistributedMatrix& dMatrix) : Node(DistributedMatrix(dMatrix)) {}
+
+    Node(DistributedMatrix&& dMatrix) : 
                                          rows(dMatrix.numRows()),
                                          cols(dMatrix.numCols())
     {
-        values = new DistributedMatrix(dMatrix);
+        values = new DistributedMatrix(std::move(dMatrix));
         
         // Create a zero matrix with same dimensions for gradients
         int numProcs;
@@ -86,21 +100,28 @@ public:
             // dL/dA = dL/dC * B^T
             DistributedMatrix* result_grads_ = dynamic_cast<DistributedMatrix*>(result_grads); 
             Matrix* this_grads_ = dynamic_cast<Matrix*>(this_grads);
-            *this_grads_ = *this_grads_ + result_grads_->multiplyTransposed(*other_values);
+            *this_grads_ += result_grads_->multiplyTransposed(*other_values);
             // dL/dB = A^T * dL/dC
-            // Add to existing gradients
+            // Add to existing gradients (a single GEMM accumulating in place)
             DistributedMatrix* other_grads_ = dynamic_cast<DistributedMatrix*>(other_grads);
-            *other_grads_ = DistributedMatrix::applyBinary(*other_grads_, multiply(this_values->transpose(), (*result_grads_)), 
-                                              [](double a, double b) { return a + b; });
+            multiply_add(this_values->transpose(), *result_grads_, *other_grads_);
         };
 
         return result;
     }
 
     // Apply an element-wise function to the distributed matrix
-    Node* apply(std::function<double(double)> func, 
-                          std::function<double(double)> func_derivative = nullptr)
+    //      `func` and `func_derivative` may be any callables (e.g. Sigmoid() and SigmoidDerivative() of activations.hpp),
+    //      without a derivative no gradient flows back through this node
+    //      The built-in derivatives that can be written in terms of the output (sigmoid, tanh, ReLU) go through apply_from_output
+    template <class F, class DF = std::nullptr_t>
+    Node* apply(F func, DF func_derivative = nullptr)
     {
+        if constexpr (has_output_derivative<DF>::value)
+        {
+            return apply_from_output(func, [](double y) { return DF::from_output(y); });
+        }
+
         DistributedMatrix* values_ = dynamic_cast<DistributedMatrix*>(values);
         Node* result = new Node(values_->apply(func));
         push_node(result);
@@ -112,38 +133,88 @@ public:
         auto this_grads = grads;
         auto result_grads = result->grads;
 
-        if (func_derivative)
+        if constexpr (!std::is_same<DF, std::nullptr_t>::value)
         {
             result->backward_op = [values_ptr, this_grads, result_grads, func_derivative]()
             {
-                // Apply the derivative function and multiply by the incoming gradient
-                auto derivative_func = [func_derivative](double x) { return func_derivative(x); };
-                
-                // Create a matrix with derivatives
-                DistributedMatrix derivatives = values_ptr->apply(derivative_func);
-                
-                // Multiply element-wise with incoming gradients
+                // Multiply the incoming gradients by the derivative and add them to the existing gradients in the same pass
                 DistributedMatrix* result_grads_ = dynamic_cast<DistributedMatrix*>(result_grads);
-                DistributedMatrix gradient = DistributedMatrix::applyBinary(*result_grads_, derivatives, 
-                                                              [](double a, double b) { return a * b; });
-                
-                // Add to existing gradients
                 DistributedMatrix* this_grads_ = dynamic_cast<DistributedMatrix*>(this_grads);
-                *this_grads_ = DistributedMatrix::applyBinary(*this_grads_, gradient, 
-                                                  [](double a, double b) { return a + b; });
+                this_grads_->addBinary(*result_grads_, *values_ptr,
+                                       [func_derivative](double g, double x) { return g * func_derivative(x); });
             };
         }
 
         return result;
     }
 
+    // Apply an element-wise function whose derivative is given in terms of the output y = func(x) (e.g. s * (1 - s) for the sigmoid)
+    //      The backward pass reads the output saved by the forward pass instead of evaluating the derivative at the input
+    //      (no exp for the sigmoid, and no temporary DistributedMatrix)
+    template <class F, class DY>
+    Node* apply_from_output(F func, DY output_derivative)
+    {
+        DistributedMatrix* values_ = dynamic_cast<DistributedMatrix*>(values);
+        Node* result = new Node(values_->apply(func));
+        push_node(result);
+
+        result->dependencies.push_back(this);
+
+        auto this_grads = grads;
+        auto result_values = result->values;
+        auto result_grads = result->grads;
+
+        result->backward_op = [this_grads, result_values, result_grads, output_derivative]()
+        {
+            DistributedMatrix* result_values_ = dynamic_cast<DistributedMatrix*>(result_values);
+            DistributedMatrix* result_grads_ = dynamic_cast<DistributedMatrix*>(result_grads);
+            DistributedMatrix* this_grads_ = dynamic_cast<DistributedMatrix*>(this_grads);
+            this_grads_->addBinary(*result_grads_, *result_values_,
+                                   [output_derivative](double g, double y) { return g * output_derivative(y); });
+        };
+
+        return result;
+    }
+
+    // Backward pass from this node, as a reverse topological sweep: a first pass counts the
+    // consumers of every node reachable from this one (one per use, so `x * x` counts twice),
+    // then a node runs its backward_op once all of them have run theirs. Each backward_op runs
+    // exactly once, however many paths lead to its node, so the cost is linear in the graph.
     void backward()
     {
-        if (backward_op)
-            backward_op();
-        for (const auto& dep : dependencies)
+        static unsigned passes = 0;
+        const unsigned pass = ++passes;
+        std::vector<Node*> stack{this};
+        backward_pass = pass;
+        pending_consumers = 0;
+        while (!stack.empty())
+        {
+            Node* node = stack.back();
+            stack.pop_back();
+            for (Node* dep : node->dependencies)
+            {
+                if (dep->backward_pass != pass)
+                {
+                    dep->backward_pass = pass;
+                    dep->pending_consumers = 0;
+                    stack.push_back(dep);
+                }
+                ++dep->pending_consumers;
+            }
+        }
+
+        stack.push_back(this);
+        while (!stack.empty())
         {
-            dep->backward();
+            Node* node = stack.back();
+            stack.pop_back();
+            if (node->backward_op)
+                node->backward_op();
+            for (Node* dep : node->dependencies)
+            {
+                if (--dep->pending_consumers == 0)
+                    stack.push_back(dep);
+            }
         }
     }
 
@@ -200,16 +271,11 @@ inline Node* binary_cross_entropy(Node& predictions, Node& targets)
             return (-target / (pred + 1e-12) + (1 - target) / (1 - pred + 1e-12));
         };
         
-        // Apply gradient computation element-wise
+        // Apply gradient computation element-wise and add it to existing gradients in the same pass
         DistributedMatrix* prediction_values = dynamic_cast<DistributedMatrix*>(predictions.values);
         DistributedMatrix* target_values = dynamic_cast<DistributedMatrix*>(targets.values);
-        DistributedMatrix gradient = DistributedMatrix::applyBinary(*prediction_values, *target_values, bce_grad_func);
-        
-        // Add to existing gradients
         DistributedMatrix* prediction_grads = dynamic_cast<DistributedMatrix*>(predictions.grads);
-        (*prediction_grads) = DistributedMatrix::applyBinary(*prediction_grads, gradient, 
-                                                 [](double a, double b) { return a + b; });
-        
+        prediction_grads->addBinary(*prediction_values, *target_values, bce_grad_func);
     };
 
     return loss;
@@ -242,13 +308,15 @@ class MLP
 private:
     Node W1, W2;
     double learning_rate;
+    MathMode math_mode; // accuracy of the vectorised activations (see activations.hpp)
     int rank, numProcesses;
 
 public:
-    MLP(int input_size, int hidden_size, int output_size, double lr)
+    MLP(int input_size, int hidden_size, int output_size, double lr, MathMode mode = MathMode::Precise)
         : W1(hidden_size, input_size),
           W2(output_size, hidden_size),
           learning_rate(lr),
+          math_mode(mode),
           rank(0),
           numProcesses(0)
     {
@@ -289,9 +357,9 @@ public:
     {
         
         Node *z1 = W1 * input;
-        Node *a1 = z1->apply(sigmoid, sigmoid_derivative);
+        Node *a1 = z1->apply(Sigmoid{math_mode}, SigmoidDerivative{math_mode});
         Node *z2 = W2 * *a1;
-        return z2->apply(sigmoid, sigmoid_derivative);
+        return z2->apply(Sigmoid{math_mode}, SigmoidDerivative{math_mode});
     }
 
     void train(const Dataset& data, int epochs)
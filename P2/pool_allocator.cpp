@@ -0,0 +1,120 @@
+#include "pool_allocator.hpp"
+
+#include <cstdlib>
+
+namespace {
+
+// Size classes: 64 bytes, then 4 classes between each power of two 2^p and 2^(p+1)
+// (2^p + 2^(p-2), 2^p + 2 * 2^(p-2), ...) up to POOL_MAX_BYTES.
+const int MIN_SHIFT = 6; // 64 bytes
+const int MAX_SHIFT = 30;
+const int N_CLASSES = (MAX_SHIFT - MIN_SHIFT) * 4 + 1;
+
+int size_class(std::size_t bytes) {
+    if (bytes <= (std::size_t(1) << MIN_SHIFT)) {
+        return 0;
+    }
+    int p = 63 - __builtin_clzll(static_cast<unsigned long long>(bytes - 1)); // 2^p < bytes <= 2^(p+1)
+    std::size_t quarter = std::size_t(1) << (p - 2);
+    int k = static_cast<int>((bytes - 1 - (std::size_t(1) << p)) / quarter); // 0 to 3
+    return (p - MIN_SHIFT) * 4 + k + 1;
+}
+
+std::size_t class_bytes(int c) {
+    if (c == 0) {
+        return std::size_t(1) << MIN_SHIFT;
+    }
+    int p = (c - 1) / 4 + MIN_SHIFT;
+    int k = (c - 1) % 4;
+    return (std::size_t(1) << p) + (k + 1) * (std::size_t(1) << (p - 2));
+}
+
+std::size_t cache_limit() {
+    const char *env = std::getenv("MATRIX_POOL_MB");
+    if (env != nullptr && std::atol(env) >= 0) {
+        return static_cast<std::size_t>(std::atol(env)) << 20;
+    }
+    return std::size_t(256) << 20;
+}
+
+void *system_allocate(std::size_t bytes) {
+    // aligned_alloc wants a multiple of the alignment.
+    void *p = std::aligned_alloc(POOL_ALIGNMENT, (bytes + POOL_ALIGNMENT - 1) / POOL_ALIGNMENT * POOL_ALIGNMENT);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+// Set once the cache of the thread is destroyed: a Matrix that outlives it (e.g. a static one,
+// destroyed after the thread_local objects of the main thread) then frees its block directly.
+thread_local bool cache_destroyed = false;
+
+struct ThreadCache {
+    std::vector<void *> free_blocks[N_CLASSES];
+    std::size_t cached_bytes = 0;
+    std::size_t limit = cache_limit();
+    long allocations = 0;
+    long reused = 0;
+
+    ~ThreadCache() {
+        for (std::vector<void *> &blocks : free_blocks) {
+            for (void *p : blocks) {
+                std::free(p);
+            }
+        }
+        cache_destroyed = true;
+    }
+};
+
+ThreadCache &cache() {
+    thread_local ThreadCache c;
+    return c;
+}
+
+} // namespace
+
+void *pool_allocate(std::size_t bytes) {
+    if (bytes > POOL_MAX_BYTES || cache_destroyed) {
+        return system_allocate(bytes);
+    }
+    int c = size_class(bytes);
+    ThreadCache &tc = cache();
+    ++tc.allocations;
+    std::vector<void *> &blocks = tc.free_blocks[c];
+    if (!blocks.empty()) {
+        void *p = blocks.back();
+        blocks.pop_back();
+        tc.cached_bytes -= class_bytes(c);
+        ++tc.reused;
+        return p;
+    }
+    return system_allocate(class_bytes(c));
+}
+
+void pool_deallocate(void *p, std::size_t bytes) {
+    if (p == nullptr) {
+        return;
+    }
+    if (bytes > POOL_MAX_BYTES || cache_destroyed) {
+        std::free(p);
+        return;
+    }
+    int c = size_class(bytes);
+    ThreadCache &tc = cache();
+    if (tc.cached_bytes + class_bytes(c) > tc.limit) {
+        std::free(p);
+        return;
+    }
+    try {
+        tc.free_blocks[c].push_back(p);
+        tc.cached_bytes += class_bytes(c);
+    } catch (const std::bad_alloc &) {
+        std::free(p);
+    }
+}
+
+PoolStats pool_stats() {
+    ThreadCache &tc = cache();
+    return PoolStats{tc.allocations, tc.reused, tc.cached_bytes};
+}
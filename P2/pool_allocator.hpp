@@ -0,0 +1,64 @@
+#ifndef POOL_ALLOCATOR_H
+#define POOL_ALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Pooled, 64-byte aligned storage for the Matrix buffers and the GEMM packing buffers.
+//
+// Every operation on matrices returns a new Matrix, so a training step allocates and frees
+// the same few sizes over and over. Blocks are rounded up to a size class (4 classes per
+// power of two, so at most 25% is wasted) and, when freed, kept on a free list of the
+// calling thread instead of being returned to the system: the next allocation of the same
+// class is a pop from that list, without any lock.
+// Every block starts on a cache line (64 bytes), so it is also aligned for any SIMD load.
+//
+// Each thread keeps at most MATRIX_POOL_MB megabytes (default 256) of free blocks, the rest
+// is returned to the system, as well as all the blocks of a thread when it exits.
+// Blocks of more than POOL_MAX_BYTES are never cached.
+
+const std::size_t POOL_ALIGNMENT = 64;
+const std::size_t POOL_MAX_BYTES = std::size_t(1) << 30;
+
+// Returns a block of at least `bytes` bytes aligned on POOL_ALIGNMENT (throws std::bad_alloc).
+void *pool_allocate(std::size_t bytes);
+// Gives back a block from pool_allocate, `bytes` must be the size it was allocated with.
+void pool_deallocate(void *p, std::size_t bytes);
+
+// Counters of the calling thread, to check that a loop has stopped allocating.
+struct PoolStats {
+    long allocations; // number of calls to pool_allocate
+    long reused;      // how many of them were served from the free lists
+    std::size_t cached_bytes; // size of the free blocks currently kept
+};
+PoolStats pool_stats();
+
+// Standard allocator on top of the pool, e.g. std::vector<double, PoolAllocator<double>>.
+template <class T>
+struct PoolAllocator {
+    typedef T value_type;
+
+    PoolAllocator() noexcept {}
+    template <class U>
+    PoolAllocator(const PoolAllocator<U> &) noexcept {}
+
+    T *allocate(std::size_t n) {
+        if (n > static_cast<std::size_t>(-1) / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T *>(pool_allocate(n * sizeof(T)));
+    }
+    void deallocate(T *p, std::size_t n) noexcept { pool_deallocate(p, n * sizeof(T)); }
+};
+
+// All the PoolAllocator share the same pool, so memory from one can be freed by any other.
+template <class T, class U>
+bool operator==(const PoolAllocator<T> &, const PoolAllocator<U> &) { return true; }
+template <class T, class U>
+bool operator!=(const PoolAllocator<T> &, const PoolAllocator<U> &) { return false; }
+
+// Contiguous, aligned and pooled array of doubles.
+typedef std::vector<double, PoolAllocator<double>> pooled_vector;
+
+#endif // POOL_ALLOCATOR_H
@@ -0,0 +1,97 @@
+#include "quantized_matrix.hpp"
+#include "simd.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+// Products with fewer multiply-adds than this stay on the calling thread.
+const long PARALLEL_MIN_MACS = 1L << 18;
+
+inline std::int8_t quantize_value(double x, double inv_scale) {
+    return static_cast<std::int8_t>(std::clamp(std::lrint(x * inv_scale), -127L, 127L));
+}
+
+// q = round(x / scale) with scale = max |x| / 127, for the n values x(0), ..., x(n - 1).
+// Returns the scale.
+template <class Get>
+float quantize_vector(int n, Get x, std::int8_t *q) {
+    double max_abs = 0.0;
+    for (int k = 0; k < n; ++k) {
+        max_abs = std::max(max_abs, std::abs(x(k)));
+    }
+    const float scale = static_cast<float>(max_abs / 127.0);
+    const double inv = max_abs > 0.0 ? 127.0 / max_abs : 0.0;
+    for (int k = 0; k < n; ++k) {
+        q[k] = quantize_value(x(k), inv);
+    }
+    return scale;
+}
+
+} // namespace
+
+QuantizedMatrix::QuantizedMatrix(ConstMatrixView m) { quantize(m); }
+QuantizedMatrix::QuantizedMatrix(BasicMatrixView<const float> m) { quantize(m); }
+QuantizedMatrix::QuantizedMatrix(BasicMatrixView<const bfloat16> m) { quantize(m); }
+
+template <class T>
+void QuantizedMatrix::quantize(BasicMatrixView<const T> m) {
+    rows = m.numRows();
+    cols = m.numCols();
+    data.resize(static_cast<size_t>(rows) * cols);
+    scales.resize(rows);
+    parallel_for(rows, elementwise_row_grain(cols), [&](int i0, int i1) {
+        for (int i = i0; i < i1; ++i) {
+            scales[i] = quantize_vector(cols, [&](int j) { return m.coeff(i, j); }, data.data() + static_cast<size_t>(i) * cols);
+        }
+    });
+}
+
+// The columns of x are quantised into the rows of xq (n x cols, each sample contiguous as
+// gemm_s8 wants it), then blocks of rows of W are multiplied by all of xq.
+void QuantizedMatrix::multiply(ConstMatrixView x, MatrixView y) const {
+    if (x.numRows() != cols || y.numRows() != rows || y.numCols() != x.numCols()) {
+        throw std::invalid_argument("Matrix dimensions do not match for QuantizedMatrix::multiply");
+    }
+    const int n = x.numCols();
+    std::vector<std::int8_t, PoolAllocator<std::int8_t>> xq(static_cast<size_t>(n) * cols);
+    std::vector<float> x_scales(n);
+    if (n == 1) {
+        x_scales[0] = quantize_vector(cols, [&](int p) { return x.coeff(p, 0); }, xq.data());
+    } else {
+        // x is read along its rows (the columns are strided): maxima first, then the quantisation.
+        std::vector<double> max_abs(n, 0.0), inv(n);
+        for (int p = 0; p < cols; ++p) {
+            for (int j = 0; j < n; ++j) {
+                max_abs[j] = std::max(max_abs[j], std::abs(x.coeff(p, j)));
+            }
+        }
+        for (int j = 0; j < n; ++j) {
+            x_scales[j] = static_cast<float>(max_abs[j] / 127.0);
+            inv[j] = max_abs[j] > 0.0 ? 127.0 / max_abs[j] : 0.0;
+        }
+        for (int p = 0; p < cols; ++p) {
+            for (int j = 0; j < n; ++j) {
+                xq[static_cast<size_t>(j) * cols + p] = quantize_value(x.coeff(p, j), inv[j]);
+            }
+        }
+    }
+
+    const long row_macs = static_cast<long>(cols) * n;
+    const int grain = static_cast<int>(std::max(1L, PARALLEL_MIN_MACS / std::max(1L, row_macs)));
+    parallel_for(rows, grain, [&](int i0, int i1) {
+        std::vector<std::int32_t, PoolAllocator<std::int32_t>> acc(static_cast<size_t>(i1 - i0) * n);
+        simd().gemm_s8(i1 - i0, n, cols, data.data() + static_cast<size_t>(i0) * cols, cols, xq.data(), cols,
+                       acc.data(), n);
+        for (int i = i0; i < i1; ++i) {
+            double *out = y.data() + static_cast<long>(i) * y.stride();
+            const std::int32_t *a = acc.data() + static_cast<size_t>(i - i0) * n;
+            for (int j = 0; j < n; ++j) {
+                out[j] = static_cast<double>(scales[i]) * x_scales[j] * a[j];
+            }
+        }
+    });
+}
@@ -0,0 +1,59 @@
+#ifndef QUANTIZED_MATRIX_H
+#define QUANTIZED_MATRIX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bfloat16.hpp"
+#include "matrix_view.hpp"
+#include "pool_allocator.hpp"
+
+// Post-training quantisation of a weight matrix, for inference: int8 elements with one scale
+// per row, w_ij ~ scale_i * q_ij where q_ij is in [-127, 127] and scale_i = max_j |w_ij| / 127
+// (symmetric, so a row keeps its relative accuracy whatever the magnitude of the other rows).
+// It takes an eighth of the bytes of a Matrix, plus one float per row.
+// (Only views in the interface: this file is shared with P1, whose Matrix is declared differently.)
+//
+// `multiply` computes y = W x for inputs in double (one sample per column of x): every column
+// is quantised on the fly with its own scale, the dot products are int8 x int8 accumulated in
+// int32 (gemm_s8 of simd.hpp: AVX512-VNNI, AVX2 pmaddubsw or SSE2 pmaddwd) and rescaled to
+// double. The error of y_ij is at most about (|W_i|_1 scale_j + |x_j|_1 scale_i) / 2, i.e.
+// a few 1 / 127 of the magnitude of the row and of the column, which is fine for the
+// activations of an MLP but not for training.
+class QuantizedMatrix {
+private:
+    int rows, cols;
+    std::vector<std::int8_t, PoolAllocator<std::int8_t>> data; // row-major
+    std::vector<float> scales;                                 // one per row
+
+    template <class T>
+    void quantize(BasicMatrixView<const T> m);
+
+public:
+    // Empty (0 x 0) matrix
+    QuantizedMatrix() : rows(0), cols(0) {}
+
+    // Quantises `m`, a Matrix or a view of double, float or bfloat16 (see basic_matrix.hpp),
+    // e.g. `QuantizedMatrix(w.view())`.
+    explicit QuantizedMatrix(ConstMatrixView m);
+    explicit QuantizedMatrix(BasicMatrixView<const float> m);
+    explicit QuantizedMatrix(BasicMatrixView<const bfloat16> m);
+
+    int numRows() const { return rows; }
+    int numCols() const { return cols; }
+
+    std::int8_t quantized(int i, int j) const { return data[static_cast<size_t>(i) * cols + j]; }
+    float scale(int i) const { return scales[i]; }
+    // Dequantised element: scale(i) * quantized(i, j)
+    double get(int i, int j) const { return static_cast<double>(scales[i]) * quantized(i, j); }
+
+    // Bytes of the elements and of the scales.
+    size_t bytes() const { return data.size() * sizeof(std::int8_t) + scales.size() * sizeof(float); }
+
+    // y = W x, where x is cols x n and y is rows x n (see above), e.g. `w.multiply(x, y)` for
+    // matrices x and y.
+    void multiply(ConstMatrixView x, MatrixView y) const;
+};
+
+#endif // QUANTIZED_MATRIX_H
@@ -0,0 +1,143 @@
+#include "simd.hpp"
+#include "simd_impl.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// Plain C++ fallback, used on CPUs without SSE2 (or when MATRIX_SIMD=scalar).
+struct Scalar {
+    using scalar = double;
+    using reg = double;
+    static const int width = 1;
+    static reg load(const double *p) { return *p; }
+    static void store(double *p, reg x) { *p = x; }
+    static reg load_aligned(const double *p) { return *p; }
+    static void store_aligned(double *p, reg x) { *p = x; }
+    static reg set1(double x) { return x; }
+    static reg zero() { return 0.0; }
+    static reg add(reg a, reg b) { return a + b; }
+    static reg sub(reg a, reg b) { return a - b; }
+    static reg mul(reg a, reg b) { return a * b; }
+    static reg div(reg a, reg b) { return a / b; }
+    static reg min(reg a, reg b) { return a < b ? a : b; }
+    static reg max(reg a, reg b) { return a > b ? a : b; }
+    static reg fmadd(reg a, reg b, reg c) { return a * b + c; }
+    static reg step(reg x) { return x > 0.0 ? 1.0 : 0.0; }
+    static void transpose(reg *) {}
+    static std::int32_t dot_s8(int k, const std::int8_t *a, const std::int8_t *b) {
+        std::int32_t sum = 0;
+        for (int p = 0; p < k; ++p) {
+            sum += a[p] * b[p];
+        }
+        return sum;
+    }
+    static reg pow2n(reg t) {
+        std::uint64_t n;
+        std::memcpy(&n, &t, sizeof(n));
+        n = (n + 1023) << 52;
+        std::memcpy(&t, &n, sizeof(n));
+        return t;
+    }
+};
+
+struct ScalarF {
+    using scalar = float;
+    using reg = float;
+    static const int width = 1;
+    static reg load(const float *p) { return *p; }
+    static void store(float *p, reg x) { *p = x; }
+    static reg load_aligned(const float *p) { return *p; }
+    static void store_aligned(float *p, reg x) { *p = x; }
+    static reg set1(float x) { return x; }
+    static reg zero() { return 0.0f; }
+    static reg add(reg a, reg b) { return a + b; }
+    static reg sub(reg a, reg b) { return a - b; }
+    static reg mul(reg a, reg b) { return a * b; }
+    static reg div(reg a, reg b) { return a / b; }
+    static reg min(reg a, reg b) { return a < b ? a : b; }
+    static reg max(reg a, reg b) { return a > b ? a : b; }
+    static reg fmadd(reg a, reg b, reg c) { return a * b + c; }
+    static reg step(reg x) { return x > 0.0f ? 1.0f : 0.0f; }
+    static reg pow2n(reg t) {
+        std::uint32_t n;
+        std::memcpy(&n, &t, sizeof(n));
+        n = (n + 127) << 23;
+        std::memcpy(&t, &n, sizeof(n));
+        return t;
+    }
+};
+
+enum Level { SCALAR, SSE2, AVX2, AVX512 };
+
+Level cpu_level() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SSE2;
+    }
+#endif
+    return SCALAR;
+}
+
+Level requested_level() {
+    const char *env = std::getenv("MATRIX_SIMD");
+    if (env == nullptr) {
+        return AVX512;
+    }
+    if (std::strcmp(env, "scalar") == 0) {
+        return SCALAR;
+    }
+    if (std::strcmp(env, "sse2") == 0) {
+        return SSE2;
+    }
+    if (std::strcmp(env, "avx2") == 0) {
+        return AVX2;
+    }
+    return AVX512;
+}
+
+SimdKernels select_kernels() {
+    Level level = cpu_level();
+    Level requested = requested_level();
+    if (requested < level) {
+        level = requested;
+    }
+    switch (level) {
+#if defined(__x86_64__) || defined(__i386__)
+    case AVX512: {
+        SimdKernels kernels = simd_avx512_kernels();
+        if (__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni")) {
+            kernels.gemm_s8 = simd_avx512vnni_gemm_s8;
+        }
+        return kernels;
+    }
+    case AVX2:
+        return simd_avx2_kernels();
+    case SSE2:
+        return simd_sse2_kernels();
+#endif
+    default:
+        return simd_scalar_kernels();
+    }
+}
+
+} // namespace
+
+SimdKernels simd_scalar_kernels() {
+    return simd_impl::make_kernels<Scalar, ScalarF, 4, 4>("scalar");
+}
+
+const SimdKernels &simd() {
+    // Initialized once, in a thread-safe way, on first use.
+    static const SimdKernels kernels = select_kernels();
+    return kernels;
+}
@@ -0,0 +1,98 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstdint>
+
+#include "activations.hpp"
+
+// Table of the hand-vectorised kernels used by Matrix.
+// One table is compiled per instruction set (simd_sse2.cpp, simd_avx2.cpp, simd_avx512.cpp)
+// and `simd()` picks the widest one supported by the CPU the first time it is called,
+// so that the same binary runs on every node of the cluster.
+// The environment variable MATRIX_SIMD (scalar, sse2, avx2 or avx512) caps the selection,
+// which is useful to benchmark or test the narrower kernels on a recent CPU.
+struct SimdKernels {
+    const char *name;
+
+    // Register tile of `gemm_kernel`, the packing in gemm.cpp follows it.
+    int mr, nr;
+
+    // ab = a * b where `a` is a packed mr x kc micro-panel (mr contiguous elements per column),
+    // `b` is a packed kc x nr micro-panel (nr contiguous elements per row) and
+    // `ab` is an mr x nr row-major tile. `b` and `ab` must be aligned on nr doubles (at most
+    // 64 bytes): they are read and written with aligned loads and stores.
+    void (*gemm_kernel)(int kc, const double *a, const double *b, double *ab);
+
+    // z = x + y
+    void (*add)(int n, const double *x, const double *y, double *z);
+    // y = alpha * x
+    void (*scale)(int n, double alpha, const double *x, double *y);
+    // y = y + alpha * x
+    void (*axpy)(int n, double alpha, const double *x, double *y);
+    // b = a^T, where `a` is a rows x cols block whose rows are lda apart and `b` is cols x rows
+    // with rows ldb apart. Meant for blocks that stay in cache (see the tiling in matrix.cpp).
+    void (*transpose)(int rows, int cols, const double *a, long lda, double *b, long ldb);
+    // c = a b^T on int8, accumulated in int32 (see quantized_matrix.hpp): a is m x k, b is n x k
+    // and c is m x n, with rows lda, ldb and ldc apart. The elements must be in [-127, 127],
+    // which keeps the pairwise sums of pmaddubsw (AVX2) from saturating.
+    void (*gemm_s8)(int m, int n, int k, const std::int8_t *a, long lda, const std::int8_t *b, long ldb,
+                    std::int32_t *c, long ldc);
+    // Batch of small products on interleaved matrices (batched_matrix.hpp), one per lane: for
+    // l < lanes, c_l = alpha * a_l b_l + beta * c_l with a_l m x k, b_l k x n and c_l m x n.
+    // Element (i, p) of a_l is a[i * rsa + p * csa + l], or a[i * rsa + p * csa] for every l when
+    // a_lanes is false (the same matrix for the whole batch), likewise for b; c always has lanes
+    // and is not read when beta == 0.
+    void (*batched_gemm)(int lanes, int m, int n, int k, double alpha, const double *a, long rsa, long csa,
+                         bool a_lanes, const double *b, long rsb, long csb, bool b_lanes, double beta, double *c,
+                         long rsc, long csc);
+
+
+    // The transcendental kernels come in both MathMode (activations.hpp), indexed by mode first.
+    // y = exp(x)
+    void (*exp[MATH_MODE_COUNT])(int n, const double *x, double *y);
+    // Built-in activations f of activations.hpp, indexed by `Activation`:
+    // y = f(x)
+    void (*activation[MATH_MODE_COUNT][ACTIVATION_COUNT])(int n, const double *x, double *y);
+    // y = f'(x)
+    void (*activation_derivative[MATH_MODE_COUNT][ACTIVATION_COUNT])(int n, const double *x, double *y);
+    // acc = acc + g * f'(x)
+    void (*activation_backward[MATH_MODE_COUNT][ACTIVATION_COUNT])(int n, const double *x, const double *g, double *acc);
+
+    // Float versions for the reduced precision matrices (basic_matrix.hpp), with twice as many
+    // elements per register. The micro-kernel of the float GEMM has an mr x nr_f32 tile (`b` and
+    // `ab` aligned on nr_f32 floats, at most 64 bytes), the packing of gemm.cpp follows it.
+    int nr_f32;
+    void (*gemm_kernel_f32)(int kc, const float *a, const float *b, float *ab);
+    // y = y + alpha * x
+    void (*axpy_f32)(int n, float alpha, const float *x, float *y);
+    // exp and the activations in float. Measured maximum error against expf (see
+    // `matrix_bench exp`): exp 1 ulp in Precise mode and 3 ulp in Fast mode, sigmoid 4 ulp.
+    void (*exp_f32[MATH_MODE_COUNT])(int n, const float *x, float *y);
+    void (*activation_f32[MATH_MODE_COUNT][ACTIVATION_COUNT])(int n, const float *x, float *y);
+    void (*activation_derivative_f32[MATH_MODE_COUNT][ACTIVATION_COUNT])(int n, const float *x, float *y);
+    void (*activation_backward_f32[MATH_MODE_COUNT][ACTIVATION_COUNT])(int n, const float *x, const float *g, float *acc);
+    // Conversions between float and bfloat16 (bfloat16.hpp), on the bits of the bfloat16:
+    // y = bfloat16(x), rounded to nearest even with NaNs kept quiet, and y = float(x).
+    void (*float_to_bf16)(int n, const float *x, std::uint16_t *y);
+    void (*bf16_to_float)(int n, const std::uint16_t *x, float *y);
+};
+
+// Largest register tile over all the kernels, used to size the temporary tiles.
+const int SIMD_MAX_MR = 8;
+const int SIMD_MAX_NR = 16;
+const int SIMD_MAX_NR_F32 = 32;
+
+const SimdKernels &simd();
+
+// Tables of the instruction set specific translation units.
+SimdKernels simd_scalar_kernels();
+SimdKernels simd_sse2_kernels();
+SimdKernels simd_avx2_kernels();
+SimdKernels simd_avx512_kernels();
+
+// gemm_s8 with the dot product instructions of AVX512-VNNI (simd_avx512vnni.cpp): replaces the
+// one of the avx512 table on the CPUs that have them.
+void simd_avx512vnni_gemm_s8(int m, int n, int k, const std::int8_t *a, long lda, const std::int8_t *b, long ldb,
+                             std::int32_t *c, long ldc);
+
+#endif // SIMD_H
@@ -0,0 +1,81 @@
+// Compiled with -mavx2 -mfma, only called when the CPU supports them (see simd.cpp).
+#include "simd_impl.hpp"
+
+#include <immintrin.h>
+
+namespace {
+
+struct AVX2 {
+    using scalar = double;
+    using reg = __m256d;
+    static const int width = 4;
+    static reg load(const double *p) { return _mm256_loadu_pd(p); }
+    static void store(double *p, reg x) { _mm256_storeu_pd(p, x); }
+    static reg load_aligned(const double *p) { return _mm256_load_pd(p); }
+    static void store_aligned(double *p, reg x) { _mm256_store_pd(p, x); }
+    static reg set1(double x) { return _mm256_set1_pd(x); }
+    static reg zero() { return _mm256_setzero_pd(); }
+    static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+    static reg div(reg a, reg b) { return _mm256_div_pd(a, b); }
+    static reg min(reg a, reg b) { return _mm256_min_pd(a, b); }
+    static reg max(reg a, reg b) { return _mm256_max_pd(a, b); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_pd(a, b, c); }
+    static reg step(reg x) {
+        return _mm256_and_pd(_mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_GT_OQ), _mm256_set1_pd(1.0));
+    }
+    // 4 x 4: interleave pairs of rows, then swap the 128-bit halves.
+    static void transpose(reg r[4]) {
+        reg t0 = _mm256_unpacklo_pd(r[0], r[1]); // r00 r10 r02 r12
+        reg t1 = _mm256_unpackhi_pd(r[0], r[1]); // r01 r11 r03 r13
+        reg t2 = _mm256_unpacklo_pd(r[2], r[3]); // r20 r30 r22 r32
+        reg t3 = _mm256_unpackhi_pd(r[2], r[3]); // r21 r31 r23 r33
+        r[0] = _mm256_permute2f128_pd(t0, t2, 0x20);
+        r[1] = _mm256_permute2f128_pd(t1, t3, 0x20);
+        r[2] = _mm256_permute2f128_pd(t0, t2, 0x31);
+        r[3] = _mm256_permute2f128_pd(t1, t3, 0x31);
+    }
+    static reg pow2n(reg t) {
+        __m256i n = _mm256_add_epi64(_mm256_castpd_si256(t), _mm256_set1_epi64x(1023));
+        return _mm256_castsi256_pd(_mm256_slli_epi64(n, 52));
+    }
+    static std::int32_t dot_s8(int k, const std::int8_t *a, const std::int8_t *b) {
+        return simd_impl::dot_s8_avx2<AVX2>(k, a, b);
+    }
+};
+
+
+// Float registers for the float kernels (see simd_impl.hpp).
+struct AVX2F {
+    using scalar = float;
+    using reg = __m256;
+    static const int width = 8;
+    static reg load(const float *p) { return _mm256_loadu_ps(p); }
+    static void store(float *p, reg x) { _mm256_storeu_ps(p, x); }
+    static reg load_aligned(const float *p) { return _mm256_load_ps(p); }
+    static void store_aligned(float *p, reg x) { _mm256_store_ps(p, x); }
+    static reg set1(float x) { return _mm256_set1_ps(x); }
+    static reg zero() { return _mm256_setzero_ps(); }
+    static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+    static reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+    static reg min(reg a, reg b) { return _mm256_min_ps(a, b); }
+    static reg max(reg a, reg b) { return _mm256_max_ps(a, b); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+    static reg step(reg x) {
+        return _mm256_and_ps(_mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ), _mm256_set1_ps(1.0f));
+    }
+    static reg pow2n(reg t) {
+        __m256i n = _mm256_add_epi32(_mm256_castps_si256(t), _mm256_set1_epi32(127));
+        return _mm256_castsi256_ps(_mm256_slli_epi32(n, 23));
+    }
+};
+
+} // namespace
+
+SimdKernels simd_avx2_kernels() {
+    // 6 x 8 tile: 12 accumulators, 2 registers for the row of b and 1 for the broadcast.
+    return simd_impl::make_kernels<AVX2, AVX2F, 6, 2>("avx2");
+}
@@ -0,0 +1,91 @@
+// Compiled with -mavx512f -mfma, only called when the CPU supports them (see simd.cpp).
+#include "simd_impl.hpp"
+
+#include <immintrin.h>
+
+namespace {
+
+struct AVX512 {
+    using scalar = double;
+    using reg = __m512d;
+    static const int width = 8;
+    static reg load(const double *p) { return _mm512_loadu_pd(p); }
+    static void store(double *p, reg x) { _mm512_storeu_pd(p, x); }
+    static reg load_aligned(const double *p) { return _mm512_load_pd(p); }
+    static void store_aligned(double *p, reg x) { _mm512_store_pd(p, x); }
+    static reg set1(double x) { return _mm512_set1_pd(x); }
+    static reg zero() { return _mm512_setzero_pd(); }
+    static reg add(reg a, reg b) { return _mm512_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm512_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm512_mul_pd(a, b); }
+    static reg div(reg a, reg b) { return _mm512_div_pd(a, b); }
+    static reg min(reg a, reg b) { return _mm512_min_pd(a, b); }
+    static reg max(reg a, reg b) { return _mm512_max_pd(a, b); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_pd(a, b, c); }
+    static reg step(reg x) {
+        return _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_GT_OQ), _mm512_set1_pd(1.0));
+    }
+    // 8 x 8: interleave pairs of rows, then gather the 128-bit lanes in two rounds
+    // (0x88 takes the even lanes of both operands, 0xDD the odd ones).
+    static void transpose(reg r[8]) {
+        reg t[8], u[8];
+        for (int k = 0; k < 8; k += 2) {
+            t[k] = _mm512_unpacklo_pd(r[k], r[k + 1]);
+            t[k + 1] = _mm512_unpackhi_pd(r[k], r[k + 1]);
+        }
+        for (int k = 0; k < 8; k += 4) {
+            u[k] = _mm512_shuffle_f64x2(t[k], t[k + 2], 0x88);
+            u[k + 1] = _mm512_shuffle_f64x2(t[k + 1], t[k + 3], 0x88);
+            u[k + 2] = _mm512_shuffle_f64x2(t[k], t[k + 2], 0xDD);
+            u[k + 3] = _mm512_shuffle_f64x2(t[k + 1], t[k + 3], 0xDD);
+        }
+        for (int k = 0; k < 4; ++k) {
+            r[k] = _mm512_shuffle_f64x2(u[k], u[k + 4], 0x88);
+            r[k + 4] = _mm512_shuffle_f64x2(u[k], u[k + 4], 0xDD);
+        }
+    }
+    static reg pow2n(reg t) {
+        __m512i n = _mm512_add_epi64(_mm512_castpd_si512(t), _mm512_set1_epi64(1023));
+        return _mm512_castsi512_pd(_mm512_slli_epi64(n, 52));
+    }
+    // The byte instructions of AVX-512 need AVX512BW: 256-bit AVX2 ones here, VNNI has its own
+    // translation unit (simd_avx512vnni.cpp).
+    static std::int32_t dot_s8(int k, const std::int8_t *a, const std::int8_t *b) {
+        return simd_impl::dot_s8_avx2<AVX512>(k, a, b);
+    }
+};
+
+
+// Float registers for the float kernels (see simd_impl.hpp).
+struct AVX512F {
+    using scalar = float;
+    using reg = __m512;
+    static const int width = 16;
+    static reg load(const float *p) { return _mm512_loadu_ps(p); }
+    static void store(float *p, reg x) { _mm512_storeu_ps(p, x); }
+    static reg load_aligned(const float *p) { return _mm512_load_ps(p); }
+    static void store_aligned(float *p, reg x) { _mm512_store_ps(p, x); }
+    static reg set1(float x) { return _mm512_set1_ps(x); }
+    static reg zero() { return _mm512_setzero_ps(); }
+    static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+    static reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+    static reg min(reg a, reg b) { return _mm512_min_ps(a, b); }
+    static reg max(reg a, reg b) { return _mm512_max_ps(a, b); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+    static reg step(reg x) {
+        return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_GT_OQ), _mm512_set1_ps(1.0f));
+    }
+    static reg pow2n(reg t) {
+        __m512i n = _mm512_add_epi32(_mm512_castps_si512(t), _mm512_set1_epi32(127));
+        return _mm512_castsi512_ps(_mm512_slli_epi32(n, 23));
+    }
+};
+
+} // namespace
+
+SimdKernels simd_avx512_kernels() {
+    // 8 x 16 tile (8 x 32 in float): 16 accumulators out of the 32 zmm registers.
+    return simd_impl::make_kernels<AVX512, AVX512F, 8, 2>("avx512");
+}
@@ -0,0 +1,69 @@
+// Compiled with -mavx512f -mavx512bw -mavx512vnni, only called when the CPU supports them (see simd.cpp).
+#include "simd.hpp"
+
+#include <immintrin.h>
+
+namespace {
+
+// MR x NR block of c = a b^T, in MR * NR accumulators of 16 int32: each step loads 64 bytes of
+// MR rows of a and of NR rows of b, and issues one vpdpbusd per element of the block.
+// vpdpbusd multiplies unsigned by signed bytes, so b is offset to b + 128 (a flip of the sign
+// bit) and 128 * sum(a), accumulated with one more vpdpbusd per row of a, is subtracted at the
+// end. The tail goes through masked loads (zeros in a, which contribute nothing).
+template <int MR, int NR>
+void block_s8(int k, const std::int8_t *a, long lda, const std::int8_t *b, long ldb, std::int32_t *c, long ldc) {
+    const __m512i offset = _mm512_set1_epi8(static_cast<char>(0x80));
+    __m512i acc[MR][NR], correction[MR];
+    for (int i = 0; i < MR; ++i) {
+        correction[i] = _mm512_setzero_si512();
+        for (int j = 0; j < NR; ++j) {
+            acc[i][j] = _mm512_setzero_si512();
+        }
+    }
+    for (int p = 0; p < k; p += 64) {
+        const __mmask64 mask = k - p >= 64 ? ~__mmask64(0) : (__mmask64(1) << (k - p)) - 1;
+        __m512i x[MR];
+        for (int i = 0; i < MR; ++i) {
+            x[i] = _mm512_maskz_loadu_epi8(mask, a + i * lda + p);
+            correction[i] = _mm512_dpbusd_epi32(correction[i], offset, x[i]);
+        }
+        for (int j = 0; j < NR; ++j) {
+            __m512i y = _mm512_xor_si512(_mm512_maskz_loadu_epi8(mask, b + j * ldb + p), offset);
+            for (int i = 0; i < MR; ++i) {
+                acc[i][j] = _mm512_dpbusd_epi32(acc[i][j], y, x[i]);
+            }
+        }
+    }
+    for (int i = 0; i < MR; ++i) {
+        for (int j = 0; j < NR; ++j) {
+            c[i * ldc + j] = _mm512_reduce_add_epi32(_mm512_sub_epi32(acc[i][j], correction[i]));
+        }
+    }
+}
+
+// Rows of b per block: 4 x 4 blocks keep 20 accumulators and 5 loaded registers out of 32, and
+// read each row of b once for 4 rows of a.
+template <int MR>
+void rows_s8(int n, int k, const std::int8_t *a, long lda, const std::int8_t *b, long ldb, std::int32_t *c, long ldc) {
+    int j = 0;
+    for (; j + 4 <= n; j += 4) {
+        block_s8<MR, 4>(k, a, lda, b + j * ldb, ldb, c + j, ldc);
+    }
+    for (; j < n; ++j) {
+        block_s8<MR, 1>(k, a, lda, b + j * ldb, ldb, c + j, ldc);
+    }
+}
+
+} // namespace
+
+// (Unlike the kernels of simd_impl.hpp, this one is also exact for elements equal to -128.)
+void simd_avx512vnni_gemm_s8(int m, int n, int k, const std::int8_t *a, long lda, const std::int8_t *b, long ldb,
+                             std::int32_t *c, long ldc) {
+    int i = 0;
+    for (; i + 4 <= m; i += 4) {
+        rows_s8<4>(n, k, a + i * lda, lda, b, ldb, c + i * ldc, ldc);
+    }
+    for (; i < m; ++i) {
+        rows_s8<1>(n, k, a + i * lda, lda, b, ldb, c + i * ldc, ldc);
+    }
+}
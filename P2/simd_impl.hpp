@@ -0,0 +1,510 @@
+#ifndef SIMD_IMPL_H
+#define SIMD_IMPL_H
+
+// Kernels of simd.hpp written once against a small vector abstraction `V`.
+// Each instruction set specific translation unit defines `V` with its intrinsics
+// (in an anonymous namespace) and calls `make_kernels<V, MR, NB>`.
+//
+// `V` must provide:
+//      typename V::scalar (double), typename V::reg, V::width (number of doubles per register),
+//      load, store (unaligned), load_aligned, store_aligned (on the register width), set1, zero, add, sub, mul, div, min, max,
+//      fmadd(a, b, c) = a * b + c, step(x) = (x > 0 ? 1 : 0),
+//      pow2n(t) = 2^n where t = n + 1.5 * 2^52 (n is then stored in the low mantissa bits) and
+//      transpose(r), which transposes in place the width x width tile held in r[0 .. width - 1],
+//      dot_s8(k, a, b), the int32 dot product of two int8 vectors of length k (elements in [-127, 127]).
+// The float kernels (gemm_kernel_f32, exp_f32 and the activations) are instantiated on a second
+// abstraction `F` of float registers: the same members with V::scalar = float, except transpose
+// and dot_s8, and pow2n(t) = 2^n where t = n + 1.5 * 2^23.
+//
+// Every instantiation is compiled with the flags of the including translation unit
+// (e.g. -mavx2), so this header must only be included by the simd*.cpp files, which
+// only export the kernel tables and never call the kernels before the CPU is checked.
+
+#include "simd.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace simd_impl {
+
+// expm1_reduced (below) on float registers: the input is clamped to [-87, 88] and p is the
+// degree 6 (Precise) or 5 (Fast) Taylor polynomial (truncation errors < 1.5e-8 and < 3.5e-7,
+// against a float epsilon of 6e-8). ln(2) is split as in the Cephes expf.
+template <class V, MathMode M>
+inline typename V::reg expm1_reduced_f32(typename V::reg x, typename V::reg &scale) {
+    using reg = typename V::reg;
+    const reg magic = V::set1(12582912.0f); // 1.5 * 2^23
+    x = V::min(V::set1(88.0f), V::max(V::set1(-87.0f), x));
+    reg t = V::fmadd(x, V::set1(1.44269504f), magic);
+    reg n = V::sub(t, magic);
+    reg r = V::fmadd(n, V::set1(-6.93359375e-1f), x);
+    r = V::fmadd(n, V::set1(2.12194440e-4f), r);
+    reg p;
+    if constexpr (M == MathMode::Fast) {
+        p = V::set1(1.0f / 720.0f);
+    } else {
+        p = V::set1(1.0f / 5040.0f);
+        p = V::fmadd(p, r, V::set1(1.0f / 720.0f));
+    }
+    p = V::fmadd(p, r, V::set1(1.0f / 120.0f));
+    p = V::fmadd(p, r, V::set1(1.0f / 24.0f));
+    p = V::fmadd(p, r, V::set1(1.0f / 6.0f));
+    p = V::fmadd(p, r, V::set1(0.5f));
+    p = V::fmadd(p, r, V::set1(1.0f));
+    scale = V::pow2n(t);
+    return V::mul(p, r);
+}
+
+// Range reduction shared by exp and expm1: x = n ln(2) + r, |r| <= ln(2) / 2.
+// Returns exp(r) - 1 = r p(r) and sets `scale` to 2^n, where p is
+//      Precise: the degree 12 Taylor polynomial of (exp(r) - 1) / r (truncation error < 1e-17),
+//      Fast: a degree 7 minimax polynomial (relative error < 4.5e-12), 5 fewer FMAs.
+// The input is clamped to [-708, 709] so that 2^n stays a normal number. The min / max
+// instructions return their second operand when one of them is NaN, so x goes second: a NaN
+// stays NaN (as with libm) instead of being clamped to a finite bound.
+template <class V, MathMode M>
+inline typename V::reg expm1_reduced(typename V::reg x, typename V::reg &scale) {
+    using reg = typename V::reg;
+    if constexpr (std::is_same<typename V::scalar, float>::value) {
+        return expm1_reduced_f32<V, M>(x, scale);
+    } else {
+        const reg magic = V::set1(6755399441055744.0); // 1.5 * 2^52
+        x = V::min(V::set1(709.0), V::max(V::set1(-708.0), x));
+        reg t = V::fmadd(x, V::set1(1.4426950408889634), magic); // n = round(x / ln(2))
+        reg n = V::sub(t, magic);
+        // ln(2) is split in a part with few significant bits (so n * hi is exact) and the rest.
+        reg r = V::fmadd(n, V::set1(-6.93145751953125e-1), x);
+        r = V::fmadd(n, V::set1(-1.42860682030941723212e-6), r);
+
+        reg p;
+        if constexpr (M == MathMode::Fast) {
+            p = V::set1(2.4801568919834886e-05);
+            p = V::fmadd(p, r, V::set1(1.9907464332286163e-04));
+            p = V::fmadd(p, r, V::set1(1.3888978367088327e-03));
+            p = V::fmadd(p, r, V::set1(8.333283731739407e-03));
+            p = V::fmadd(p, r, V::set1(4.166666595101376e-02));
+            p = V::fmadd(p, r, V::set1(1.6666666785422038e-01));
+            p = V::fmadd(p, r, V::set1(5.000000000120627e-01));
+            p = V::fmadd(p, r, V::set1(9.999999999955693e-01));
+        } else {
+            p = V::set1(1.0 / 6227020800.0);
+            p = V::fmadd(p, r, V::set1(1.0 / 479001600.0));
+            p = V::fmadd(p, r, V::set1(1.0 / 39916800.0));
+            p = V::fmadd(p, r, V::set1(1.0 / 3628800.0));
+            p = V::fmadd(p, r, V::set1(1.0 / 362880.0));
+            p = V::fmadd(p, r, V::set1(1.0 / 40320.0));
+            p = V::fmadd(p, r, V::set1(1.0 / 5040.0));
+            p = V::fmadd(p, r, V::set1(1.0 / 720.0));
+            p = V::fmadd(p, r, V::set1(1.0 / 120.0));
+            p = V::fmadd(p, r, V::set1(1.0 / 24.0));
+            p = V::fmadd(p, r, V::set1(1.0 / 6.0));
+            p = V::fmadd(p, r, V::set1(0.5));
+            p = V::fmadd(p, r, V::set1(1.0));
+        }
+        scale = V::pow2n(t);
+        return V::mul(p, r);
+    }
+}
+
+// exp(x) = 2^n (1 + q). Measured maximum error over [-708, 709] (see `matrix_bench exp`):
+// 1 ulp in Precise mode, 1.2e4 ulp (relative error 2.6e-12) in Fast mode.
+template <class V, MathMode M>
+inline typename V::reg exp(typename V::reg x) {
+    typename V::reg scale;
+    typename V::reg q = expm1_reduced<V, M>(x, scale);
+    return V::fmadd(q, scale, scale);
+}
+
+// exp(x) - 1 = (2^n - 1) + 2^n q, which is q itself when n = 0: no cancellation near 0.
+template <class V, MathMode M>
+inline typename V::reg expm1(typename V::reg x) {
+    typename V::reg scale;
+    typename V::reg q = expm1_reduced<V, M>(x, scale);
+    return V::fmadd(q, scale, V::sub(scale, V::set1(1.0)));
+}
+
+// Measured maximum error over [-20, 20]: 2 ulp in Precise mode, 1.2e4 ulp in Fast mode.
+template <class V, MathMode M>
+inline typename V::reg sigmoid(typename V::reg x) {
+    const typename V::reg one = V::set1(1.0);
+    return V::div(one, V::add(one, exp<V, M>(V::sub(V::zero(), x))));
+}
+
+// Vector versions of the functors of activations.hpp: f(x) and df(x) = f'(x).
+template <class V, Activation A, MathMode M>
+struct activation_ops;
+
+template <class V, MathMode M>
+struct activation_ops<V, Activation::Sigmoid, M> {
+    using reg = typename V::reg;
+    static reg f(reg x) { return sigmoid<V, M>(x); }
+    static reg df(reg x) {
+        reg s = sigmoid<V, M>(x);
+        return V::mul(s, V::sub(V::set1(1.0), s));
+    }
+};
+
+// tanh(x) = -expm1(-2x) / (2 + expm1(-2x)), accurate near 0 and saturating to +-1
+// (the clamping of expm1 keeps the ratio finite for large negative x).
+template <class V, MathMode M>
+struct activation_ops<V, Activation::Tanh, M> {
+    using reg = typename V::reg;
+    static reg f(reg x) {
+        reg e = expm1<V, M>(V::mul(V::set1(-2.0), x));
+        return V::div(V::sub(V::zero(), e), V::add(V::set1(2.0), e));
+    }
+    static reg df(reg x) {
+        reg t = f(x);
+        return V::sub(V::set1(1.0), V::mul(t, t));
+    }
+};
+
+template <class V, MathMode M>
+struct activation_ops<V, Activation::ReLU, M> {
+    using reg = typename V::reg;
+    static reg f(reg x) { return V::max(x, V::zero()); }
+    static reg df(reg x) { return V::step(x); }
+};
+
+// x * sigmoid(v) with v = 2 sqrt(2 / pi) (x + 0.044715 x^3), see activations.hpp.
+template <class V, MathMode M>
+struct activation_ops<V, Activation::GELU, M> {
+    using reg = typename V::reg;
+    static reg v(reg x) {
+        return V::mul(x, V::fmadd(V::set1(2.0 * GELU_C * GELU_A), V::mul(x, x), V::set1(2.0 * GELU_C)));
+    }
+    static reg f(reg x) { return V::mul(x, sigmoid<V, M>(v(x))); }
+    static reg df(reg x) {
+        reg s = sigmoid<V, M>(v(x));
+        reg dv = V::fmadd(V::set1(6.0 * GELU_C * GELU_A), V::mul(x, x), V::set1(2.0 * GELU_C));
+        return V::fmadd(V::mul(V::mul(x, s), V::sub(V::set1(1.0), s)), dv, s);
+    }
+};
+
+// Register blocked micro-kernel: the MR x (NB * width) tile of `ab` is accumulated in
+// MR * NB registers, each step loads one row of `b` and broadcasts one column of `a`.
+// Instantiated on double and on float registers (gemm_kernel and gemm_kernel_f32 of simd.hpp).
+template <class V, int MR, int NB>
+void gemm_kernel(int kc, const typename V::scalar *a, const typename V::scalar *b, typename V::scalar *ab) {
+    using reg = typename V::reg;
+    const int W = V::width;
+    reg c[MR][NB];
+    for (int i = 0; i < MR; ++i) {
+        for (int j = 0; j < NB; ++j) {
+            c[i][j] = V::zero();
+        }
+    }
+    for (int p = 0; p < kc; ++p) {
+        reg bv[NB];
+        for (int j = 0; j < NB; ++j) {
+            bv[j] = V::load_aligned(b + j * W);
+        }
+        for (int i = 0; i < MR; ++i) {
+            reg ai = V::set1(a[i]);
+            for (int j = 0; j < NB; ++j) {
+                c[i][j] = V::fmadd(ai, bv[j], c[i][j]);
+            }
+        }
+        a += MR;
+        b += NB * W;
+    }
+    for (int i = 0; i < MR; ++i) {
+        for (int j = 0; j < NB; ++j) {
+            V::store_aligned(ab + (i * NB + j) * W, c[i][j]);
+        }
+    }
+}
+
+// The element-wise kernels process full registers then finish the tail one element at a time.
+template <class V>
+void add(int n, const double *x, const double *y, double *z) {
+    int i = 0;
+    for (; i + V::width <= n; i += V::width) {
+        V::store(z + i, V::add(V::load(x + i), V::load(y + i)));
+    }
+    for (; i < n; ++i) {
+        z[i] = x[i] + y[i];
+    }
+}
+
+template <class V>
+void scale(int n, double alpha, const double *x, double *y) {
+    const typename V::reg a = V::set1(alpha);
+    int i = 0;
+    for (; i + V::width <= n; i += V::width) {
+        V::store(y + i, V::mul(a, V::load(x + i)));
+    }
+    for (; i < n; ++i) {
+        y[i] = alpha * x[i];
+    }
+}
+
+// Also instantiated on float registers (axpy_f32).
+template <class V>
+void axpy(int n, typename V::scalar alpha, const typename V::scalar *x, typename V::scalar *y) {
+    const typename V::reg a = V::set1(alpha);
+    int i = 0;
+    for (; i + V::width <= n; i += V::width) {
+        V::store(y + i, V::fmadd(a, V::load(x + i), V::load(y + i)));
+    }
+    for (; i < n; ++i) {
+        y[i] += alpha * x[i];
+    }
+}
+
+// Full width x width tiles go through registers (width loads, the in-register transpose and
+// width stores), the edges of the block are copied element by element.
+template <class V>
+void transpose(int rows, int cols, const double *a, long lda, double *b, long ldb) {
+    const int W = V::width;
+    int i = 0;
+    for (; i + W <= rows; i += W) {
+        int j = 0;
+        for (; j + W <= cols; j += W) {
+            typename V::reg r[W];
+            for (int k = 0; k < W; ++k) {
+                r[k] = V::load(a + (i + k) * lda + j);
+            }
+            V::transpose(r);
+            for (int k = 0; k < W; ++k) {
+                V::store(b + (j + k) * ldb + i, r[k]);
+            }
+        }
+        for (; j < cols; ++j) {
+            for (int k = 0; k < W; ++k) {
+                b[j * ldb + i + k] = a[(i + k) * lda + j];
+            }
+        }
+    }
+    for (; i < rows; ++i) {
+        for (int j = 0; j < cols; ++j) {
+            b[j * ldb + i] = a[i * lda + j];
+        }
+    }
+}
+
+// One dot product per element of c: the rows of b are read again for every row of a, so
+// quantized_matrix.cpp calls this on blocks of a whose b stays in cache.
+template <class V>
+void gemm_s8(int m, int n, int k, const std::int8_t *a, long lda, const std::int8_t *b, long ldb, std::int32_t *c,
+             long ldc) {
+    for (int i = 0; i < m; ++i) {
+        for (int j = 0; j < n; ++j) {
+            c[i * ldc + j] = V::dot_s8(k, a + i * lda, b + j * ldb);
+        }
+    }
+}
+
+#ifdef __AVX2__
+// dot_s8 of the AVX2 and AVX-512 tables. pmaddubsw multiplies unsigned by signed bytes, so it is
+// given |a| and b with the sign of a, and adds pairs of products into int16: at most
+// 2 * 127 * 127, no saturation. pmaddwd then adds pairs of those into int32.
+// (Templated on V so that each translation unit gets its own copy, compiled with its flags.)
+template <class V>
+inline std::int32_t dot_s8_avx2(int k, const std::int8_t *a, const std::int8_t *b) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i acc = _mm256_setzero_si256();
+    int p = 0;
+    for (; p + 32 <= k; p += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + p));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + p));
+        __m256i pairs = _mm256_maddubs_epi16(_mm256_sign_epi8(x, x), _mm256_sign_epi8(y, x));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(pairs, ones));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    std::int32_t sum = _mm_cvtsi128_si32(s);
+    for (; p < k; ++p) {
+        sum += a[p] * b[p];
+    }
+    return sum;
+}
+#endif
+
+// The exp and activation kernels finish the tail through a zero padded register
+// so that every element goes through the same approximation.
+template <class V, class Op>
+inline void unary(int n, const typename V::scalar *x, typename V::scalar *y, Op op) {
+    int i = 0;
+    for (; i + V::width <= n; i += V::width) {
+        V::store(y + i, op(V::load(x + i)));
+    }
+    if (i < n) {
+        typename V::scalar in[V::width] = {}, out[V::width];
+        for (int k = 0; i + k < n; ++k) {
+            in[k] = x[i + k];
+        }
+        V::store(out, op(V::load(in)));
+        for (int k = 0; i + k < n; ++k) {
+            y[i + k] = out[k];
+        }
+    }
+}
+
+template <class V, class A>
+void activation(int n, const typename V::scalar *x, typename V::scalar *y) {
+    unary<V>(n, x, y, [](typename V::reg v) { return A::f(v); });
+}
+
+template <class V, class A>
+void activation_derivative(int n, const typename V::scalar *x, typename V::scalar *y) {
+    unary<V>(n, x, y, [](typename V::reg v) { return A::df(v); });
+}
+
+template <class V, class A>
+void activation_backward(int n, const typename V::scalar *x, const typename V::scalar *g, typename V::scalar *acc) {
+    int i = 0;
+    for (; i + V::width <= n; i += V::width) {
+        V::store(acc + i, V::fmadd(V::load(g + i), A::df(V::load(x + i)), V::load(acc + i)));
+    }
+    if (i < n) {
+        typename V::scalar xt[V::width] = {}, gt[V::width] = {}, at[V::width] = {};
+        for (int k = 0; i + k < n; ++k) {
+            xt[k] = x[i + k];
+            gt[k] = g[i + k];
+            at[k] = acc[i + k];
+        }
+        V::store(at, V::fmadd(V::load(gt), A::df(V::load(xt)), V::load(at)));
+        for (int k = 0; i + k < n; ++k) {
+            acc[i + k] = at[k];
+        }
+    }
+}
+
+template <class V, MathMode M>
+void exp(int n, const typename V::scalar *x, typename V::scalar *y) {
+    unary<V>(n, x, y, [](typename V::reg v) { return exp<V, M>(v); });
+}
+
+// Fills the double tables, or the _f32 ones for float registers.
+template <class V, Activation A, MathMode M>
+void set_activation(SimdKernels &k) {
+    const int index = static_cast<int>(A), mode = static_cast<int>(M);
+    if constexpr (std::is_same<typename V::scalar, float>::value) {
+        k.activation_f32[mode][index] = activation<V, activation_ops<V, A, M>>;
+        k.activation_derivative_f32[mode][index] = activation_derivative<V, activation_ops<V, A, M>>;
+        k.activation_backward_f32[mode][index] = activation_backward<V, activation_ops<V, A, M>>;
+    } else {
+        k.activation[mode][index] = activation<V, activation_ops<V, A, M>>;
+        k.activation_derivative[mode][index] = activation_derivative<V, activation_ops<V, A, M>>;
+        k.activation_backward[mode][index] = activation_backward<V, activation_ops<V, A, M>>;
+    }
+}
+
+template <class V, MathMode M>
+void set_math_mode(SimdKernels &k) {
+    if constexpr (std::is_same<typename V::scalar, float>::value) {
+        k.exp_f32[static_cast<int>(M)] = exp<V, M>;
+    } else {
+        k.exp[static_cast<int>(M)] = exp<V, M>;
+    }
+    set_activation<V, Activation::Sigmoid, M>(k);
+    set_activation<V, Activation::Tanh, M>(k);
+    set_activation<V, Activation::ReLU, M>(k);
+    set_activation<V, Activation::GELU, M>(k);
+}
+
+// bfloat16::round and float(bfloat16) of bfloat16.hpp, repeated here so that the loops are
+// vectorised with the flags of each translation unit (and not shared with the baseline code).
+template <class V>
+void float_to_bf16(int n, const float *x, std::uint16_t *y) {
+    for (int i = 0; i < n; ++i) {
+        std::uint32_t u;
+        std::memcpy(&u, x + i, sizeof(u));
+        std::uint16_t rounded = static_cast<std::uint16_t>((u + 0x7fffu + ((u >> 16) & 1u)) >> 16);
+        std::uint16_t nan = static_cast<std::uint16_t>((u >> 16) | 0x0040u);
+        y[i] = (u & 0x7fffffffu) > 0x7f800000u ? nan : rounded;
+    }
+}
+
+template <class V>
+void bf16_to_float(int n, const std::uint16_t *x, float *y) {
+    for (int i = 0; i < n; ++i) {
+        std::uint32_t u = static_cast<std::uint32_t>(x[i]) << 16;
+        std::memcpy(y + i, &u, sizeof(u));
+    }
+}
+
+// The lanes of an element of c are the vector registers: for every element, its k products are
+// accumulated in one register per block of V::width lanes (the last lanes one at a time), so
+// that the lanes of a, b and c are streamed contiguously. An operand without lanes is broadcast
+// to every lane with set1.
+template <class V, bool AL, bool BL>
+void batched_gemm_lanes(int lanes, int m, int n, int k, double alpha, const double *a, long rsa, long csa,
+                        const double *b, long rsb, long csb, double beta, double *c, long rsc, long csc) {
+    using reg = typename V::reg;
+    const reg va = V::set1(alpha), vb = V::set1(beta);
+    for (int i = 0; i < m; ++i) {
+        for (int j = 0; j < n; ++j) {
+            double *cp = c + i * rsc + j * csc;
+            int l = 0;
+            for (; l + V::width <= lanes; l += V::width) {
+                reg acc = V::zero();
+                for (int p = 0; p < k; ++p) {
+                    const double *ap = a + i * rsa + p * csa;
+                    const double *bp = b + p * rsb + j * csb;
+                    acc = V::fmadd(AL ? V::load(ap + l) : V::set1(*ap), BL ? V::load(bp + l) : V::set1(*bp), acc);
+                }
+                V::store(cp + l, beta == 0.0 ? V::mul(va, acc) : V::fmadd(vb, V::load(cp + l), V::mul(va, acc)));
+            }
+            for (; l < lanes; ++l) {
+                double acc = 0.0;
+                for (int p = 0; p < k; ++p) {
+                    acc += a[i * rsa + p * csa + (AL ? l : 0)] * b[p * rsb + j * csb + (BL ? l : 0)];
+                }
+                cp[l] = beta == 0.0 ? alpha * acc : alpha * acc + beta * cp[l];
+            }
+        }
+    }
+}
+
+template <class V>
+void batched_gemm(int lanes, int m, int n, int k, double alpha, const double *a, long rsa, long csa, bool a_lanes,
+                  const double *b, long rsb, long csb, bool b_lanes, double beta, double *c, long rsc, long csc) {
+    if (a_lanes && b_lanes) {
+        batched_gemm_lanes<V, true, true>(lanes, m, n, k, alpha, a, rsa, csa, b, rsb, csb, beta, c, rsc, csc);
+    } else if (a_lanes) {
+        batched_gemm_lanes<V, true, false>(lanes, m, n, k, alpha, a, rsa, csa, b, rsb, csb, beta, c, rsc, csc);
+    } else if (b_lanes) {
+        batched_gemm_lanes<V, false, true>(lanes, m, n, k, alpha, a, rsa, csa, b, rsb, csb, beta, c, rsc, csc);
+    } else {
+        batched_gemm_lanes<V, false, false>(lanes, m, n, k, alpha, a, rsa, csa, b, rsb, csb, beta, c, rsc, csc);
+    }
+}
+
+// V and F are the double and float registers of the instruction set. The float micro-kernel
+// keeps the MR x NB register tile of the double one, on twice as many columns.
+template <class V, class F, int MR, int NB>
+SimdKernels make_kernels(const char *name) {
+    SimdKernels k;
+    k.name = name;
+    k.mr = MR;
+    k.nr = NB * V::width;
+    k.nr_f32 = NB * F::width;
+    k.gemm_kernel = gemm_kernel<V, MR, NB>;
+    k.gemm_kernel_f32 = gemm_kernel<F, MR, NB>;
+    k.axpy_f32 = axpy<F>;
+    k.add = add<V>;
+    k.scale = scale<V>;
+    k.axpy = axpy<V>;
+    k.transpose = transpose<V>;
+    k.gemm_s8 = gemm_s8<V>;
+    k.batched_gemm = batched_gemm<V>;
+    k.float_to_bf16 = float_to_bf16<V>;
+    k.bf16_to_float = bf16_to_float<V>;
+    set_math_mode<V, MathMode::Precise>(k);
+    set_math_mode<V, MathMode::Fast>(k);
+    set_math_mode<F, MathMode::Precise>(k);
+    set_math_mode<F, MathMode::Fast>(k);
+    return k;
+}
+
+} // namespace simd_impl
+
+#endif // SIMD_IMPL_H
@@ -0,0 +1,91 @@
+// Compiled with the baseline flags: SSE2 is part of x86-64.
+#include "simd_impl.hpp"
+
+#include <emmintrin.h>
+
+namespace {
+
+struct SSE2 {
+    using scalar = double;
+    using reg = __m128d;
+    static const int width = 2;
+    static reg load(const double *p) { return _mm_loadu_pd(p); }
+    static void store(double *p, reg x) { _mm_storeu_pd(p, x); }
+    static reg load_aligned(const double *p) { return _mm_load_pd(p); }
+    static void store_aligned(double *p, reg x) { _mm_store_pd(p, x); }
+    static reg set1(double x) { return _mm_set1_pd(x); }
+    static reg zero() { return _mm_setzero_pd(); }
+    static reg add(reg a, reg b) { return _mm_add_pd(a, b); }
+    static reg sub(reg a, reg b) { return _mm_sub_pd(a, b); }
+    static reg mul(reg a, reg b) { return _mm_mul_pd(a, b); }
+    static reg div(reg a, reg b) { return _mm_div_pd(a, b); }
+    static reg min(reg a, reg b) { return _mm_min_pd(a, b); }
+    static reg max(reg a, reg b) { return _mm_max_pd(a, b); }
+    // No FMA before AVX2, this is a separate multiply and add.
+    static reg fmadd(reg a, reg b, reg c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+    static reg step(reg x) { return _mm_and_pd(_mm_cmpgt_pd(x, _mm_setzero_pd()), _mm_set1_pd(1.0)); }
+    static void transpose(reg r[2]) {
+        reg t0 = _mm_unpacklo_pd(r[0], r[1]);
+        reg t1 = _mm_unpackhi_pd(r[0], r[1]);
+        r[0] = t0;
+        r[1] = t1;
+    }
+    static reg pow2n(reg t) {
+        __m128i n = _mm_add_epi64(_mm_castpd_si128(t), _mm_set1_epi64x(1023));
+        return _mm_castsi128_pd(_mm_slli_epi64(n, 52));
+    }
+    // Bytes sign-extended to int16 (unpacked with their sign mask), then multiplied and added
+    // by pairs into int32 with pmaddwd.
+    static std::int32_t dot_s8(int k, const std::int8_t *a, const std::int8_t *b) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i acc = zero;
+        int p = 0;
+        for (; p + 16 <= k; p += 16) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + p));
+            __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + p));
+            __m128i sx = _mm_cmpgt_epi8(zero, x), sy = _mm_cmpgt_epi8(zero, y);
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi8(x, sx), _mm_unpacklo_epi8(y, sy)));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpackhi_epi8(x, sx), _mm_unpackhi_epi8(y, sy)));
+        }
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4E));
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xB1));
+        std::int32_t sum = _mm_cvtsi128_si32(acc);
+        for (; p < k; ++p) {
+            sum += a[p] * b[p];
+        }
+        return sum;
+    }
+};
+
+
+// Float registers for the float kernels (see simd_impl.hpp).
+struct SSE2F {
+    using scalar = float;
+    using reg = __m128;
+    static const int width = 4;
+    static reg load(const float *p) { return _mm_loadu_ps(p); }
+    static void store(float *p, reg x) { _mm_storeu_ps(p, x); }
+    static reg load_aligned(const float *p) { return _mm_load_ps(p); }
+    static void store_aligned(float *p, reg x) { _mm_store_ps(p, x); }
+    static reg set1(float x) { return _mm_set1_ps(x); }
+    static reg zero() { return _mm_setzero_ps(); }
+    static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+    static reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+    static reg min(reg a, reg b) { return _mm_min_ps(a, b); }
+    static reg max(reg a, reg b) { return _mm_max_ps(a, b); }
+    static reg fmadd(reg a, reg b, reg c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static reg step(reg x) { return _mm_and_ps(_mm_cmpgt_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.0f)); }
+    static reg pow2n(reg t) {
+        __m128i n = _mm_add_epi32(_mm_castps_si128(t), _mm_set1_epi32(127));
+        return _mm_castsi128_ps(_mm_slli_epi32(n, 23));
+    }
+};
+
+} // namespace
+
+SimdKernels simd_sse2_kernels() {
+    // 4 x 4 tile: 8 accumulators out of the 16 xmm registers.
+    return simd_impl::make_kernels<SSE2, SSE2F, 4, 2>("sse2");
+}
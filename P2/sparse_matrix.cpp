@@ -0,0 +1,246 @@
+#include "sparse_matrix.hpp"
+#include "pool_allocator.hpp"
+#include "simd.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+// Tiled transposition of matrix.cpp (declared in matrix.hpp, which is not included here: see
+// sparse_matrix.hpp).
+void transpose_into(ConstMatrixView a, MatrixView out);
+
+namespace {
+
+// Products with fewer flops than this stay on the calling thread.
+const long PARALLEL_MIN_FLOPS = 1L << 16;
+
+// Compressed storage of op(S), seen as CSR (`by_rows`: lines are the rows of op(S) and the
+// indices its columns) or as CSC (lines are its columns, indices its rows).
+struct Compressed {
+    const int *offsets;
+    const int *indices;
+    const double *values;
+    int lines;
+    bool by_rows;
+};
+
+Compressed compressed(const SparseMatrix &S, bool transS) {
+    const bool csr = S.getFormat() == SparseMatrix::Format::CSR;
+    const int lines = csr ? S.numRows() : S.numCols();
+    return {S.getOffsets().data(), S.getIndices().data(), S.getValues().data(), lines, csr != transS};
+}
+
+int grain_for(long flops_per_item) {
+    return static_cast<int>(std::max(1L, PARALLEL_MIN_FLOPS / std::max(1L, flops_per_item)));
+}
+
+// C[i0:i1, j0:j1] *= beta (set to 0 when beta = 0, without reading C).
+void scale_block(MatrixView C, double beta, int i0, int i1, int j0, int j1) {
+    if (beta == 1.0) {
+        return;
+    }
+    for (int i = i0; i < i1; ++i) {
+        double *c = C.data() + static_cast<long>(i) * C.stride();
+        for (int j = j0; j < j1; ++j) {
+            c[j] = beta == 0.0 ? 0.0 : beta * c[j];
+        }
+    }
+}
+
+} // namespace
+
+SparseMatrix::SparseMatrix(int rows, int cols, Format format) : rows(rows), cols(cols), format(format) {
+    if (rows < 0 || cols < 0) {
+        throw std::invalid_argument("Invalid SparseMatrix dimensions");
+    }
+    offsets.assign(lines() + 1, 0);
+}
+
+// Counting sort of the entries by line, then by index within each line, and duplicates merged.
+SparseMatrix::SparseMatrix(int rows, int cols, const std::vector<Entry> &entries, Format format)
+    : SparseMatrix(rows, cols, format) {
+    const bool csr = format == Format::CSR;
+    std::vector<int> count(lines() + 1, 0);
+    for (const Entry &e : entries) {
+        if (e.row < 0 || e.row >= rows || e.col < 0 || e.col >= cols) {
+            throw std::invalid_argument("SparseMatrix entry out of range");
+        }
+        ++count[(csr ? e.row : e.col) + 1];
+    }
+    for (int l = 0; l < lines(); ++l) {
+        count[l + 1] += count[l];
+    }
+    std::vector<std::pair<int, double>> sorted(entries.size());
+    std::vector<int> next(count.begin(), count.end() - 1);
+    for (const Entry &e : entries) {
+        sorted[next[csr ? e.row : e.col]++] = {csr ? e.col : e.row, e.value};
+    }
+    indices.reserve(entries.size());
+    values.reserve(entries.size());
+    for (int l = 0; l < lines(); ++l) {
+        auto begin = sorted.begin() + count[l], end = sorted.begin() + count[l + 1];
+        std::sort(begin, end, [](const std::pair<int, double> &a, const std::pair<int, double> &b) { return a.first < b.first; });
+        for (auto it = begin; it != end; ++it) {
+            if (static_cast<int>(indices.size()) > offsets[l] && indices.back() == it->first) {
+                values.back() += it->second;
+            } else {
+                indices.push_back(it->first);
+                values.push_back(it->second);
+            }
+        }
+        offsets[l + 1] = static_cast<int>(indices.size());
+    }
+}
+
+SparseMatrix::SparseMatrix(ConstMatrixView dense, Format format) : SparseMatrix(dense.numRows(), dense.numCols(), format) {
+    const bool csr = format == Format::CSR;
+    for (int l = 0; l < lines(); ++l) {
+        for (int k = 0; k < lineLength(); ++k) {
+            double x = csr ? dense.coeff(l, k) : dense.coeff(k, l);
+            if (x != 0.0) {
+                indices.push_back(k);
+                values.push_back(x);
+            }
+        }
+        offsets[l + 1] = static_cast<int>(indices.size());
+    }
+}
+
+int SparseMatrix::find(int line, int index) const {
+    auto begin = indices.begin() + offsets[line], end = indices.begin() + offsets[line + 1];
+    auto it = std::lower_bound(begin, end, index);
+    return it != end && *it == index ? static_cast<int>(it - indices.begin()) : -1;
+}
+
+double SparseMatrix::get(int i, int j) const {
+    int k = format == Format::CSR ? find(i, j) : find(j, i);
+    return k < 0 ? 0.0 : values[k];
+}
+
+void SparseMatrix::set(int i, int j, double value) {
+    const int line = format == Format::CSR ? i : j, index = format == Format::CSR ? j : i;
+    int k = find(line, index);
+    if (k >= 0) {
+        values[k] = value;
+        return;
+    }
+    if (value == 0.0) {
+        return;
+    }
+    auto pos = std::lower_bound(indices.begin() + offsets[line], indices.begin() + offsets[line + 1], index);
+    const long at = pos - indices.begin();
+    indices.insert(pos, index);
+    values.insert(values.begin() + at, value);
+    for (int l = line + 1; l <= lines(); ++l) {
+        ++offsets[l];
+    }
+}
+
+// The other format stores the transpose: a counting sort of the non-zeros by index, which
+// visits the lines in order and so keeps the new indices increasing.
+SparseMatrix SparseMatrix::toFormat(Format target) const {
+    if (target == format) {
+        return *this;
+    }
+    SparseMatrix t(rows, cols, target);
+    std::vector<int> &t_offsets = t.offsets;
+    for (int index : indices) {
+        ++t_offsets[index + 1];
+    }
+    for (int l = 0; l < t.lines(); ++l) {
+        t_offsets[l + 1] += t_offsets[l];
+    }
+    t.indices.resize(indices.size());
+    t.values.resize(values.size());
+    std::vector<int> next(t_offsets.begin(), t_offsets.end() - 1);
+    for (int l = 0; l < lines(); ++l) {
+        for (int k = offsets[l]; k < offsets[l + 1]; ++k) {
+            int pos = next[indices[k]]++;
+            t.indices[pos] = l;
+            t.values[pos] = values[k];
+        }
+    }
+    return t;
+}
+
+void SparseMatrix::toDense(MatrixView dense) const {
+    if (dense.numRows() != rows || dense.numCols() != cols) {
+        throw std::invalid_argument("Matrix dimensions do not match for SparseMatrix::toDense");
+    }
+    dense.fill(0.0);
+    for (int l = 0; l < lines(); ++l) {
+        for (int k = offsets[l]; k < offsets[l + 1]; ++k) {
+            if (format == Format::CSR) {
+                dense.set(l, indices[k], values[k]);
+            } else {
+                dense.set(indices[k], l, values[k]);
+            }
+        }
+    }
+}
+
+// C = alpha * op(S) * D + beta * C, with op(S) m x k and D k x n:
+//      op(S) by rows: row i of C accumulates the rows of D of the non-zeros of row i (one
+//          axpy of length n per non-zero), in parallel over the rows of C,
+//      op(S) by columns: the non-zeros of column p scatter row p of D into the rows of C, in
+//          parallel over blocks of columns of C (each thread owns its block).
+void spmm(bool transS, double alpha, const SparseMatrix &S, ConstMatrixView D, double beta, MatrixView C) {
+    const int m = transS ? S.numCols() : S.numRows();
+    const int k = transS ? S.numRows() : S.numCols();
+    const int n = D.numCols();
+    if (D.numRows() != k || C.numRows() != m || C.numCols() != n) {
+        throw std::invalid_argument("Matrix dimensions do not match for spmm");
+    }
+    const Compressed s = compressed(S, transS);
+    const long flops_per_line = 2L * n * (S.nonZeros() / std::max(1, s.lines) + 1);
+    auto row_of_D = [&](int p) { return D.data() + static_cast<long>(p) * D.stride(); };
+    auto row_of_C = [&](int i) { return C.data() + static_cast<long>(i) * C.stride(); };
+
+    if (s.by_rows) {
+        parallel_for(m, grain_for(flops_per_line), [&](int i0, int i1) {
+            scale_block(C, beta, i0, i1, 0, n);
+            for (int i = i0; i < i1; ++i) {
+                for (int q = s.offsets[i]; q < s.offsets[i + 1]; ++q) {
+                    simd().axpy(n, alpha * s.values[q], row_of_D(s.indices[q]), row_of_C(i));
+                }
+            }
+        });
+    } else {
+        const long flops_per_column = 2L * S.nonZeros() + m;
+        parallel_for(n, grain_for(flops_per_column), [&](int j0, int j1) {
+            scale_block(C, beta, 0, m, j0, j1);
+            for (int p = 0; p < k; ++p) {
+                for (int q = s.offsets[p]; q < s.offsets[p + 1]; ++q) {
+                    simd().axpy(j1 - j0, alpha * s.values[q], row_of_D(p) + j0, row_of_C(s.indices[q]) + j0);
+                }
+            }
+        });
+    }
+}
+
+// C = alpha * D * op(S) + beta * C, with D m x k and op(S) k x n, computed as
+// C^T = alpha * op(S)^T * D^T by the product above: with D^T copied to contiguous rows, every
+// non-zero is a vectorised axpy of length m instead of m scattered scalar updates. The two
+// transpositions cost O(m x (k + n)), against O(m x non-zeros) for the product itself.
+void spmm(double alpha, ConstMatrixView D, bool transS, const SparseMatrix &S, double beta, MatrixView C) {
+    const int m = D.numRows();
+    const int k = transS ? S.numCols() : S.numRows();
+    const int n = transS ? S.numRows() : S.numCols();
+    if (D.numCols() != k || C.numRows() != m || C.numCols() != n) {
+        throw std::invalid_argument("Matrix dimensions do not match for spmm");
+    }
+    std::vector<double, PoolAllocator<double>> dt(static_cast<size_t>(k) * m), ct(static_cast<size_t>(n) * m);
+    MatrixView Dt(dt.data(), k, m, m), Ct(ct.data(), n, m, m);
+    transpose_into(D, Dt);
+    spmm(!transS, alpha, S, Dt, 0.0, Ct);
+    if (beta == 0.0) {
+        transpose_into(Ct, C);
+    } else {
+        std::vector<double, PoolAllocator<double>> product(static_cast<size_t>(m) * n);
+        MatrixView P(product.data(), m, n, n);
+        transpose_into(Ct, P);
+        C = C * beta + P;
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef SPARSE_MATRIX_H
+#define SPARSE_MATRIX_H
+
+#include <vector>
+
+#include "abstractmatrix.hpp"
+#include "matrix_view.hpp"
+
+// Sparse matrix in compressed storage, for mostly zero operands such as input features:
+//      CSR: the non-zeros row by row, `offsets` has rows + 1 entries and row i holds the
+//           non-zeros offsets[i] to offsets[i + 1] - 1, whose columns are in `indices`,
+//      CSC: the same column by column (the rows are in `indices`),
+// with the indices increasing within a row (column). The CSC storage of S is the CSR storage
+// of S^T, so switching the format of a matrix is a transposition of its arrays.
+//
+// Build it from a dense matrix (its non-zero elements) or from a list of entries, not with
+// `set`: inserting a non-zero shifts all the following ones.
+//
+// The products with dense matrices (spmm below) cost O(non-zeros x size of the dense
+// dimension), so the first layer of the MLP (`W1 * input`) only does work for the non-zeros
+// of a sparse input.
+// (The dense operands are views, so this file is shared with P1, whose Matrix has no
+// AbstractMatrix base.)
+class SparseMatrix : public AbstractMatrix {
+public:
+    enum class Format { CSR, CSC };
+
+    // Element (row, col) of the matrix, for the constructor from a list of entries.
+    struct Entry {
+        int row, col;
+        double value;
+    };
+
+private:
+    int rows, cols;
+    Format format;
+    std::vector<int> offsets; // rows + 1 (CSR) or cols + 1 (CSC) entries
+    std::vector<int> indices; // column (CSR) or row (CSC) of each non-zero
+    std::vector<double> values;
+
+    // Rows (CSR) or columns (CSC) of the storage, and the size of the other dimension.
+    int lines() const { return format == Format::CSR ? rows : cols; }
+    int lineLength() const { return format == Format::CSR ? cols : rows; }
+    // Position of (line, index) in `values`, or -1 if it is not stored.
+    int find(int line, int index) const;
+
+public:
+    // Zero matrix
+    SparseMatrix(int rows, int cols, Format format = Format::CSR);
+    // Entries in any order, those at the same position are summed.
+    SparseMatrix(int rows, int cols, const std::vector<Entry> &entries, Format format = Format::CSR);
+    // Non-zero elements of a dense matrix.
+    explicit SparseMatrix(ConstMatrixView dense, Format format = Format::CSR);
+
+    // Implementation of AbstractMatrix interface
+    int numRows() const override { return rows; }
+    int numCols() const override { return cols; }
+    double get(int i, int j) const override;
+    // Overwrites a stored element (even with 0, it stays stored), or inserts it in O(non-zeros).
+    void set(int i, int j, double value) override;
+
+    Format getFormat() const { return format; }
+    int nonZeros() const { return static_cast<int>(values.size()); }
+
+    // Compressed arrays (see above)
+    const std::vector<int> &getOffsets() const { return offsets; }
+    const std::vector<int> &getIndices() const { return indices; }
+    const std::vector<double> &getValues() const { return values; }
+
+    // Same matrix in the given format (a copy if it already is).
+    SparseMatrix toFormat(Format format) const;
+    // dense = this (dense must be rows x cols)
+    void toDense(MatrixView dense) const;
+};
+
+// Products of sparse and dense matrices, as Matrix::gemm: op(S) is S or S^T, C must already
+// have the shape of the product, and C is not read when beta = 0.
+//      C = alpha * op(S) * D + beta * C
+void spmm(bool transS, double alpha, const SparseMatrix &S, ConstMatrixView D, double beta, MatrixView C);
+//      C = alpha * D * op(S) + beta * C (through the transposes of D and C, see sparse_matrix.cpp)
+void spmm(double alpha, ConstMatrixView D, bool transS, const SparseMatrix &S, double beta, MatrixView C);
+
+#endif // SPARSE_MATRIX_H
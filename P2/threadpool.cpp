@@ -0,0 +1,167 @@
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+// Chunks of a single parallel_for, the caller waits until `pending` drops to zero.
+struct ThreadPool::Group {
+    std::atomic<int> pending{0};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+};
+
+namespace {
+
+// Index of the worker running on this thread, -1 for any other thread.
+thread_local int current_worker = -1;
+
+int default_num_threads() {
+    const char *env = std::getenv("MATRIX_NUM_THREADS");
+    if (env != nullptr && std::atoi(env) > 0) {
+        return std::atoi(env);
+    }
+    int n = std::max(1u, std::thread::hardware_concurrency());
+    // Share the cores between the MPI ranks of the node (Open MPI, then MPICH).
+    for (const char *var : {"OMPI_COMM_WORLD_LOCAL_SIZE", "MPI_LOCALNRANKS"}) {
+        const char *local = std::getenv(var);
+        if (local != nullptr && std::atoi(local) > 0) {
+            n = std::max(1, n / std::atoi(local));
+            break;
+        }
+    }
+    return n;
+}
+
+} // namespace
+
+ThreadPool &ThreadPool::instance() {
+    static ThreadPool pool(default_num_threads());
+    return pool;
+}
+
+ThreadPool::ThreadPool(int n_threads) : queued(0), next_queue(0), stop(false) {
+    // The thread calling parallel_for works too, so n_threads - 1 workers are enough.
+    for (int i = 0; i < n_threads - 1; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 0; i < n_threads - 1; ++i) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : workers) {
+        t.join();
+    }
+}
+
+int ThreadPool::numThreads() const {
+    return static_cast<int>(workers.size()) + 1;
+}
+
+void ThreadPool::parallel_for(int n, int grain, const std::function<void(int, int)> &body) {
+    if (n <= 0) {
+        return;
+    }
+    grain = std::max(grain, 1);
+    if (n <= grain || workers.empty()) {
+        body(0, n);
+        return;
+    }
+
+    // A few chunks per thread so that stealing can even out the load.
+    int chunks = std::min((n + grain - 1) / grain, 4 * numThreads());
+    Group group;
+    group.pending = chunks;
+    auto chunk = [&](int c) {
+        return Task{&body, static_cast<int>(static_cast<long>(c) * n / chunks),
+                    static_cast<int>(static_cast<long>(c + 1) * n / chunks), &group};
+    };
+
+    const int self = current_worker;
+    for (int c = chunks - 1; c >= 1; --c) {
+        int q = self >= 0 ? self : static_cast<int>(next_queue++ % queues.size());
+        std::lock_guard<std::mutex> lock(queues[q]->mutex);
+        queues[q]->tasks.push_back(chunk(c));
+    }
+    queued += chunks - 1;
+    {
+        // Taking the lock makes sure no worker misses the update of `queued` before going to sleep.
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    wake.notify_all();
+
+    run(chunk(0));
+    while (group.pending.load(std::memory_order_acquire) > 0) {
+        Task task;
+        if ((self >= 0 && pop(self, task)) || steal(self, task)) {
+            run(task);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    if (group.error) {
+        std::rethrow_exception(group.error);
+    }
+}
+
+void ThreadPool::run(const Task &task) {
+    try {
+        (*task.body)(task.begin, task.end);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(task.group->error_mutex);
+        if (!task.group->error) {
+            task.group->error = std::current_exception();
+        }
+    }
+    // Last access to the group: the thread waiting on it may return right after.
+    task.group->pending.fetch_sub(1, std::memory_order_release);
+}
+
+bool ThreadPool::pop(int index, Task &task) {
+    Queue &q = *queues[index];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty()) {
+        return false;
+    }
+    task = q.tasks.back();
+    q.tasks.pop_back();
+    --queued;
+    return true;
+}
+
+bool ThreadPool::steal(int index, Task &task) {
+    const int n = static_cast<int>(queues.size());
+    for (int k = 1; k <= n; ++k) {
+        Queue &q = *queues[(index + k + n) % n];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.tasks.empty()) {
+            task = q.tasks.front();
+            q.tasks.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(int index) {
+    current_worker = index;
+    for (;;) {
+        Task task;
+        if (pop(index, task) || steal(index, task)) {
+            run(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this]() { return stop || queued.load() > 0; });
+        if (stop) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Process-wide work-stealing thread pool used by the Matrix kernels.
+//
+// Every worker owns a deque of tasks: it pops its own tasks from the back and,
+// when it runs out, steals from the front of the other deques. A `parallel_for`
+// issued from inside a task pushes its chunks on the deque of the current worker
+// instead of spawning threads, so nested or concurrent operations on several
+// matrices share the same fixed set of threads and never oversubscribe the node.
+// The calling thread always takes part in the work while it waits.
+//
+// The number of threads is read from MATRIX_NUM_THREADS, and defaults to the number
+// of hardware threads divided by the number of MPI ranks running on the same node.
+class ThreadPool {
+public:
+    static ThreadPool &instance();
+
+    // Number of threads taking part in a parallel_for (workers + calling thread).
+    int numThreads() const;
+
+    // Calls body(begin, end) on disjoint chunks covering [0, n) and returns once they are all done.
+    // The range is only split in chunks of at least `grain` iterations, so that when n <= grain
+    // (or with a single thread) the body is simply called once on the calling thread.
+    // The first exception thrown by the body is rethrown here.
+    void parallel_for(int n, int grain, const std::function<void(int, int)> &body);
+
+    ~ThreadPool();
+
+private:
+    struct Group;
+
+    struct Task {
+        const std::function<void(int, int)> *body;
+        int begin, end;
+        Group *group;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    explicit ThreadPool(int n_threads);
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void worker_loop(int index);
+    bool pop(int index, Task &task);
+    bool steal(int index, Task &task);
+    void run(const Task &task);
+
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker
+    std::vector<std::thread> workers;
+    std::atomic<int> queued;
+    std::atomic<unsigned> next_queue;
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    bool stop;
+};
+
+// Shorthand for ThreadPool::instance().parallel_for(n, grain, body).
+// Small ranges call `body` directly, and larger ones only wrap a reference to it,
+// so that no std::function ever needs to allocate whatever `body` captures.
+template <typename F>
+inline void parallel_for(int n, int grain, F &&body) {
+    if (n <= grain) {
+        if (n > 0) {
+            body(0, n);
+        }
+        return;
+    }
+    ThreadPool::instance().parallel_for(n, grain, [&body](int begin, int end) { body(begin, end); });
+}
+
+#endif // THREADPOOL_H
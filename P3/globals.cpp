@@ -3,6 +3,8 @@
 
 std::vector<Node *> all_nodes;
 
+Tape *capturing_tape = nullptr;
+
 // Function to push a Node* into the vector (initializing if nullptr)
 void push_node(Node *node)
 {
@@ -17,4 +19,77 @@ void clear_nodes()
         delete node; // Free dynamically allocated memory
     }
     all_nodes.clear();
-}
\ No newline at end of file
+}
+
+Tape::~Tape()
+{
+    if (capturing_tape == this)
+    {
+        end();
+    }
+    for (Node *node : nodes)
+    {
+        delete node;
+    }
+}
+
+void Tape::begin()
+{
+    if (capturing_tape != nullptr)
+    {
+        throw std::logic_error("A Tape is already capturing");
+    }
+    for (Node *node : nodes)
+    {
+        delete node;
+    }
+    nodes.clear();
+    forward_kernels.clear();
+    backward_kernels.clear();
+    capturing_tape = this;
+    first_node = all_nodes.size();
+}
+
+// The nodes made since begin() leave all_nodes for the tape.
+void Tape::end()
+{
+    if (capturing_tape != this)
+    {
+        throw std::logic_error("This Tape is not capturing");
+    }
+    nodes.assign(all_nodes.begin() + first_node, all_nodes.end());
+    all_nodes.resize(first_node);
+    capturing_tape = nullptr;
+    for (auto it = nodes.rbegin(); it != nodes.rend(); ++it)
+    {
+        if ((*it)->backward_op)
+        {
+            backward_kernels.push_back(&(*it)->backward_op);
+        }
+    }
+}
+
+void Tape::forward() const
+{
+    for (Node *node : nodes)
+    {
+        node->zero_grad();
+    }
+    for (const InlineFunction &kernel : forward_kernels)
+    {
+        kernel();
+    }
+}
+
+void Tape::backward() const
+{
+    for (const InlineFunction *kernel : backward_kernels)
+    {
+        (*kernel)();
+    }
+}
+
+void Tape::record(InlineFunction kernel)
+{
+    forward_kernels.push_back(std::move(kernel));
+}
@@ -1,12 +1,154 @@
 #ifndef GLOBALS_H
 #define GLOBALS_H
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 class Node;
 
+// Callable kept inside the object, through a table of plain function pointers: unlike
+// std::function, which allocates for a closure of more than two pointers, nothing is allocated
+// (the backward closures of the nodes and the kernels recorded by a Tape are a few pointers and
+// shared_ptrs, at most CAPACITY bytes, checked at compile time). Calling it is one indirect call.
+// Empty when default constructed.
+class InlineFunction
+{
+public:
+    static const std::size_t CAPACITY = 12 * sizeof(void *);
+
+    InlineFunction() = default;
+
+    template <class F, class = typename std::enable_if<!std::is_same<typename std::decay<F>::type, InlineFunction>::value>::type>
+    InlineFunction(F f)
+    {
+        static_assert(sizeof(F) <= CAPACITY && alignof(F) <= alignof(std::max_align_t),
+                      "The closure does not fit in an InlineFunction");
+        static_assert(std::is_nothrow_move_constructible<F>::value, "The closure must be nothrow movable");
+        new (storage) F(std::move(f));
+        ops = ops_of<F>();
+    }
+
+    InlineFunction(const InlineFunction &other)
+    {
+        if (other.ops)
+        {
+            other.ops->copy(other.storage, storage);
+            ops = other.ops;
+        }
+    }
+
+    InlineFunction(InlineFunction &&other) noexcept
+    {
+        if (other.ops)
+        {
+            other.ops->move(other.storage, storage);
+            ops = other.ops;
+        }
+    }
+
+    // (by value: a copy or a move of `other`, then moved in)
+    InlineFunction &operator=(InlineFunction other) noexcept
+    {
+        reset();
+        if (other.ops)
+        {
+            other.ops->move(other.storage, storage);
+            ops = other.ops;
+        }
+        return *this;
+    }
+
+    ~InlineFunction() { reset(); }
+
+    explicit operator bool() const { return ops != nullptr; }
+    // (the closures may be `mutable`, like with std::function)
+    void operator()() const { ops->call(storage); }
+
+private:
+    struct Ops
+    {
+        void (*call)(void *);
+        void (*copy)(const void *, void *);
+        void (*move)(void *, void *);
+        void (*destroy)(void *);
+    };
+
+    template <class F>
+    static const Ops *ops_of()
+    {
+        static const Ops table = {
+            [](void *f) { (*static_cast<F *>(f))(); },
+            [](const void *from, void *to) { new (to) F(*static_cast<const F *>(from)); },
+            [](void *from, void *to) { new (to) F(std::move(*static_cast<F *>(from))); },
+            [](void *f) { static_cast<F *>(f)->~F(); }};
+        return &table;
+    }
+
+    void reset()
+    {
+        if (ops)
+        {
+            ops->destroy(storage);
+            ops = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) mutable unsigned char storage[CAPACITY];
+    const Ops *ops = nullptr;
+};
+
 extern std::vector<Node *> all_nodes;
 
 void push_node(Node *node);
 void clear_nodes();
 
+// Capture of the graph of a training step: the nodes made between begin() and end() are kept by
+// the tape (clear_nodes does not delete them) and each operation records a kernel that
+// recomputes the values of its node into the buffers it already has. forward() and backward()
+// then run the graph again on the current values of the leaves it was built from (inputs,
+// targets, weights, which must outlive the tape): a walk over two flat lists of kernels bound
+// once (InlineFunction), without making a node, allocating or checking the operands again.
+class Tape
+{
+public:
+    Tape() = default;
+    ~Tape();
+    Tape(const Tape &) = delete;
+    Tape &operator=(const Tape &) = delete;
+
+    // Starts a capture, dropping the previous one (no clear_nodes until end()).
+    void begin();
+    void end();
+    bool empty() const { return nodes.empty(); }
+
+    // Values of the nodes of the tape from those of the leaves; their gradients are zeroed.
+    void forward() const;
+    // backward_op of the nodes of the tape in reverse order of creation (a topological order).
+    void backward() const;
+
+    // Called by the operations on nodes while capturing: `kernel` computes the new node.
+    void record(InlineFunction kernel);
+
+private:
+    std::vector<Node *> nodes;
+    std::vector<InlineFunction> forward_kernels;
+    std::vector<const InlineFunction *> backward_kernels; // the backward_op of the nodes
+    std::size_t first_node = 0; // in all_nodes, during the capture
+};
+
+// Tape capturing the nodes being made, if any.
+extern Tape *capturing_tape;
+
+// Records the kernel computing a new node while a Tape captures, does nothing otherwise.
+template <class F>
+void record_forward(F kernel)
+{
+    if (capturing_tape)
+    {
+        capturing_tape->record(InlineFunction(std::move(kernel)));
+    }
+}
+
 #endif // GLOBALS_H
\ No newline at end of file
@@ -110,6 +110,28 @@ void test_mlp_training(cl::Context context, cl::CommandQueue queue)
     printMatrix("MLP Output on Training Data", *final_output_node->values);
     clear_nodes(); // Clean up graph nodes created by forward pass
 
+    // Same model with master weights on the device and a dynamic loss scale
+    std::cout << "--- Mixed-Precision Training ---" << std::endl;
+    MixedPrecision precision;
+    precision.master_weights = true;
+    precision.loss_scale = 1024.0f;
+    precision.dynamic_loss_scale = true;
+    MLP mixed_model(3, 128, 1, 1.0f, context, queue);
+    mixed_model.train(data, 2000, precision);
+    Node* mixed_output_node = mixed_model.forward(final_input_node);
+    printMatrix("Mixed-Precision MLP Output on Training Data", *mixed_output_node->values);
+    clear_nodes();
+
+    // The dynamic loss scale checks the gradients in the update of the master weights
+    precision.master_weights = false;
+    bool rejected = false;
+    try {
+        mixed_model.train(data, 1, precision);
+    } catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+    assert(rejected);
+
 }
 
 
@@ -205,6 +227,33 @@ int main() {
         printMatrix("Matrix A * C", matMul);
         assert(verifyMatrix("Matrix A * C", matMul, {30.0f, 36.0f, 42.0f, 66.0f, 81.0f, 96.0f}));
 
+        // Test gemm with transposed operands, accumulating into the output:
+        // G = 1 + A^T(3x2) * B(2x3) and H = 1 + 2 * A(2x3) * B^T(3x2)
+        MatrixCL matG(3, 3, context, queue);
+        matG.fill(1.0f);
+        MatrixCL::gemm(true, false, 1.0f, matA, matB, 1.0f, matG);
+        printMatrix("Matrix 1 + A^T * B", matG);
+        assert(verifyMatrix("Matrix 1 + A^T * B", matG,
+                            {48.0f, 53.0f, 58.0f, 65.0f, 72.0f, 79.0f, 82.0f, 91.0f, 100.0f}));
+        MatrixCL matH(2, 2, context, queue);
+        matH.fill(1.0f);
+        MatrixCL::gemm(false, true, 2.0f, matA, matB, 1.0f, matH);
+        printMatrix("Matrix 1 + 2 * A * B^T", matH);
+        assert(verifyMatrix("Matrix 1 + 2 * A * B^T", matH, {101.0f, 137.0f, 245.0f, 335.0f}));
+
+        // Test lazy transpose: products and in-place updates read A^T without a transposed buffer
+        MatrixCL matATB = matA.transpose() * matB; // 3x3
+        printMatrix("Matrix A^T * B (lazy transpose)", matATB);
+        assert(verifyMatrix("Matrix A^T * B (lazy transpose)", matATB,
+                            {47.0f, 52.0f, 57.0f, 64.0f, 71.0f, 78.0f, 81.0f, 90.0f, 99.0f}));
+        MatrixCL matABT = matA * matB.transpose(); // 2x2
+        assert(verifyMatrix("Matrix A * B^T (lazy transpose)", matABT, {50.0f, 68.0f, 122.0f, 167.0f}));
+        MatrixCL matAccT(3, 2, context, queue);
+        matAccT.fill(1.0f);
+        matAccT += matA.transpose();
+        printMatrix("Matrix 1 + A^T (lazy transpose)", matAccT);
+        assert(verifyMatrix("Matrix 1 + A^T (lazy transpose)", matAccT, {2.0f, 5.0f, 3.0f, 6.0f, 4.0f, 7.0f}));
+
 
         // Test sub_mul: matA_copy = matA_copy - 2.0 * matB
         // matA_copy starts as {1, 2, 3, 4, 5, 6}
@@ -215,6 +264,29 @@ int main() {
         printMatrix("Matrix A Copy after sub_mul(2.0, B)", matA_copy);
         assert(verifyMatrix("Matrix A Copy sub_mul", matA_copy, {-13.0f, -14.0f, -15.0f, -16.0f, -17.0f, -18.0f}));
 
+        // Test in-place operators: ((A + B) * 0.5 - A) + 2 * B = 2.5 * B - 0.5 * A
+        MatrixCL matInPlace(matA);
+        matInPlace += matB;
+        matInPlace *= 0.5f;
+        matInPlace -= matA;
+        matInPlace.axpy(2.0f, matB);
+        printMatrix("Matrix ((A + B) * 0.5 - A) + 2 * B", matInPlace);
+        assert(verifyMatrix("Matrix in-place operators", matInPlace, {17.0f, 19.0f, 21.0f, 23.0f, 25.0f, 27.0f}));
+
+        // Test move constructor: takes over the buffer, the moved-from matrix is left empty
+        MatrixCL matMoved(std::move(matInPlace));
+        assert(matInPlace.numRows() == 0 && matInPlace.numCols() == 0);
+        assert(verifyMatrix("Matrix moved", matMoved, {17.0f, 19.0f, 21.0f, 23.0f, 25.0f, 27.0f}));
+
+        // Test add_into and transpose_into: written into the existing buffer of the output
+        auto bufMoved = matMoved.getBuffer()();
+        matA.add_into(matB, matMoved);
+        assert(matMoved.getBuffer()() == bufMoved);
+        assert(verifyMatrix("Matrix A + B (add_into)", matMoved, {8.0f, 10.0f, 12.0f, 14.0f, 16.0f, 18.0f}));
+        MatrixCL matIntoT(3, 2, context, queue);
+        matA.transpose_into(matIntoT);
+        assert(verifyMatrix("Matrix A^T (transpose_into)", matIntoT, {1.0f, 4.0f, 2.0f, 5.0f, 3.0f, 6.0f}));
+
 
         // 3. --- Neural Network Related Operations Test ---
         std::cout << "\n--- Neural Network Operations Test ---" << std::endl;
@@ -272,6 +344,14 @@ int main() {
         std::vector<float> expectedBCE = { t0, t1, t2, t3 };
         assert(verifyMatrix("Matrix BCE Loss Verify", matBCE, expectedBCE));
 
+        // Test sigmoid_into and bce_into: same values, into existing buffers
+        MatrixCL matSigmoidInto(1, 5, context, queue);
+        matSigmoidInput.sigmoid_into(matSigmoidInto);
+        assert(verifyMatrix("Matrix sigmoid_into Verify", matSigmoidInto, matSigmoidOutput.copyToHost()));
+        MatrixCL matBCEInto(1, 4, context, queue);
+        matPreds.bce_into(matTargets, matBCEInto);
+        assert(verifyMatrix("Matrix bce_into Verify", matBCEInto, expectedBCE));
+
 
         // Test binary_cross_entropy_backward()
         // grad_acc += (1/N) * (-target/pred + (1-target)/(1-pred)) * output_gradient_of_loss (assume 1)
@@ -7,6 +7,7 @@
 #include <sstream> // For building kernel source string
 #include <memory> 
 #include <mutex>  
+#include <utility>
 
 // ---------------------------------------------------------------------------
 // Static Member Definitions
@@ -58,6 +59,23 @@ const std::string kernel_source_sub_mul = R"(
         TODO (provided function signatures can be changed)
     }
 )";
+// A = A - scalar * B^T, where B is cols x rows (B^T is read in place, never materialised)
+const std::string kernel_source_sub_mul_transposed = R"(
+    __kernel void sub_mul_transposed(__global float* A, __global const float* B, float scalar, int rows, int cols) {
+        int i = get_global_id(0); int j = get_global_id(1);
+        if (i < rows && j < cols) {
+            A[i * cols + j] -= scalar * B[j * rows + i];
+        }
+    }
+)";
+const std::string kernel_source_scale = R"(
+    __kernel void scale(__global float* A, float scalar, int rows, int cols) {
+        int idx = get_global_id(0);
+        if (idx < rows * cols) {
+            A[idx] *= scalar;
+        }
+    }
+)";
 const std::string kernel_source_transpose = R"(
     __kernel void transpose(__global const float* A, __global float* B, int A_rows, int A_cols) {
         TODO (provided function signatures can be changed)
@@ -68,6 +86,22 @@ const std::string kernel_source_matrix_mul = R"(
         TODO (provided function signatures can be changed)
     }
 )";
+const std::string kernel_source_gemm = R"(
+    __kernel void gemm(__global const float* A, __global const float* B, __global float* C,
+                       int M, int N, int K, int transA, int transB, float alpha, float beta) {
+        int row = get_global_id(0); int col = get_global_id(1);
+        if (row < M && col < N) {
+            float sum = 0.0f;
+            for (int p = 0; p < K; ++p) {
+                float a = transA ? A[p * M + row] : A[row * K + p];
+                float b = transB ? B[col * K + p] : B[p * N + col];
+                sum += a * b;
+            }
+            // C is not read when beta == 0, like in BLAS.
+            C[row * N + col] = beta == 0.0f ? alpha * sum : alpha * sum + beta * C[row * N + col];
+        }
+    }
+)";
 const std::string kernel_source_sigmoid = R"(
     __kernel void sigmoid(__global const float* input, __global float* output, int rows, int cols) {
         TODO (provided function signatures can be changed)
@@ -95,6 +129,30 @@ const std::string kernel_source_bce_backward = R"(
         }
     }
 )";
+// Every work-item that finds a non-finite element writes the same value, no atomic is needed.
+const std::string kernel_source_check_finite = R"(
+    __kernel void check_finite(__global const float* A, __global float* overflow, int rows, int cols) {
+        int idx = get_global_id(0);
+        if (idx < rows * cols && !isfinite(A[idx])) {
+            overflow[0] = 1.0f;
+        }
+    }
+)";
+// (high, low) -= step * grads with the error-free sum of Knuth (TwoSum): low receives the rounding error of high.
+const std::string kernel_source_master_update = R"(
+    __kernel void master_update(__global float* high, __global float* low, __global const float* grads,
+                                __global const float* overflow, float step, int rows, int cols) {
+        int idx = get_global_id(0);
+        if (idx < rows * cols && overflow[0] == 0.0f) {
+            float a = high[idx];
+            float b = low[idx] - step * grads[idx];
+            float s = a + b;
+            float bb = s - a;
+            low[idx] = (a - (s - bb)) + (b - bb);
+            high[idx] = s;
+        }
+    }
+)";
 
 // ---------------------------------------------------------------------------
 // KernelCache Implementation
@@ -113,12 +171,21 @@ void KernelCache::compileKernels(cl::Context context, const std::vector<cl::Devi
         cl::Program prog_sub_mul = loadAndBuildProgram(context, devices, kernel_source_sub_mul, "sub_mul");
         kernel_sub_mul = cl::Kernel(prog_sub_mul, "sub_mul");
 
+        cl::Program prog_sub_mul_t = loadAndBuildProgram(context, devices, kernel_source_sub_mul_transposed, "sub_mul_transposed");
+        kernel_sub_mul_transposed = cl::Kernel(prog_sub_mul_t, "sub_mul_transposed");
+
+        cl::Program prog_scale = loadAndBuildProgram(context, devices, kernel_source_scale, "scale");
+        kernel_scale = cl::Kernel(prog_scale, "scale");
+
         cl::Program prog_transpose = loadAndBuildProgram(context, devices, kernel_source_transpose, "transpose");
         kernel_transpose = cl::Kernel(prog_transpose, "transpose");
 
         cl::Program prog_matrix_mul = loadAndBuildProgram(context, devices, kernel_source_matrix_mul, "matrix_mul");
         kernel_matrix_mul = cl::Kernel(prog_matrix_mul, "matrix_mul");
 
+        cl::Program prog_gemm = loadAndBuildProgram(context, devices, kernel_source_gemm, "gemm");
+        kernel_gemm = cl::Kernel(prog_gemm, "gemm");
+
         cl::Program prog_sigmoid = loadAndBuildProgram(context, devices, kernel_source_sigmoid, "sigmoid");
         kernel_sigmoid = cl::Kernel(prog_sigmoid, "sigmoid");
 
@@ -131,6 +198,12 @@ void KernelCache::compileKernels(cl::Context context, const std::vector<cl::Devi
         cl::Program prog_bce_bw = loadAndBuildProgram(context, devices, kernel_source_bce_backward, "bce_backward");
         kernel_bce_backward = cl::Kernel(prog_bce_bw, "bce_backward");
 
+        cl::Program prog_check_finite = loadAndBuildProgram(context, devices, kernel_source_check_finite, "check_finite");
+        kernel_check_finite = cl::Kernel(prog_check_finite, "check_finite");
+
+        cl::Program prog_master_update = loadAndBuildProgram(context, devices, kernel_source_master_update, "master_update");
+        kernel_master_update = cl::Kernel(prog_master_update, "master_update");
+
         initialized = true;
         std::cout << "OpenCL kernels compiled successfully." << std::endl;
 
@@ -186,7 +259,211 @@ size_t MatrixCL::buffer_size_bytes() const {
 
 
 
-void MatrixCL::binary_cross_entropy_backward(const MatrixCL& predictions, const MatrixCL& targets) {
+MatrixCL::MatrixCL(MatrixCL&& other) noexcept
+    : rows_(other.rows_), cols_(other.cols_),
+      context_(std::move(other.context_)), queue_(std::move(other.queue_)), buffer_(std::move(other.buffer_))
+{
+    other.rows_ = 0;
+    other.cols_ = 0;
+}
+
+MatrixCL& MatrixCL::operator=(MatrixCL&& other) noexcept {
+    if (this != &other) {
+        rows_ = other.rows_;
+        cols_ = other.cols_;
+        context_ = std::move(other.context_);
+        queue_ = std::move(other.queue_);
+        buffer_ = std::move(other.buffer_);
+        other.rows_ = 0;
+        other.cols_ = 0;
+    }
+    return *this;
+}
+
+void MatrixCL::copyFromHost(const std::vector<float>& host_data) {
+    if (host_data.size() != static_cast<size_t>(rows_) * cols_) {
+        throw std::invalid_argument("Host data size does not match matrix dimensions for copyFromHost.");
+    }
+    if (host_data.empty()) return;
+
+    try {
+        queue_.enqueueWriteBuffer(buffer_, CL_TRUE, 0, buffer_size_bytes(), host_data.data());
+    } catch (const cl::Error& err) {
+        throw std::runtime_error("OpenCL error during copyFromHost: " + std::string(err.what()) + " (" + std::to_string(err.err()) + ")");
+    }
+}
+
+// The in-place updates all reuse the sub_mul kernel: this = this - scalar * other.
+MatrixCL& MatrixCL::operator+=(const MatrixCL& other) {
+    sub_mul(-1.0f, other);
+    return *this;
+}
+
+MatrixCL& MatrixCL::operator-=(const MatrixCL& other) {
+    sub_mul(1.0f, other);
+    return *this;
+}
+
+void MatrixCL::axpy(float alpha, const MatrixCL& other) {
+    sub_mul(-alpha, other);
+}
+
+MatrixCL& MatrixCL::operator*=(float scalar) {
+    size_t num_elements = static_cast<size_t>(rows_) * cols_;
+    if (num_elements == 0) return *this;
+
+    try {
+        cl::Kernel kernel = kernels_->kernel_scale; // Use cached kernel
+
+        kernel.setArg(0, buffer_); // modified in place
+        kernel.setArg(1, scalar);
+        kernel.setArg(2, rows_);
+        kernel.setArg(3, cols_);
+
+        queue_.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(num_elements), cl::NullRange);
+
+    } catch (const cl::Error& err) {
+        throw std::runtime_error("OpenCL error during scale: " + std::string(err.what()) + " (" + std::to_string(err.err()) + ")");
+    }
+    return *this;
+}
+
+void MatrixCL::gemm(bool transA, bool transB, float alpha, const MatrixCL& A, const MatrixCL& B,
+                    float beta, MatrixCL& C) {
+    int m = transA ? A.numCols() : A.numRows();
+    int k = transA ? A.numRows() : A.numCols();
+    int n = transB ? B.numRows() : B.numCols();
+    if ((transB ? B.numCols() : B.numRows()) != k || C.numRows() != m || C.numCols() != n) {
+        throw std::invalid_argument("Matrix dimensions do not match for gemm.");
+    }
+    if (&C == &A || &C == &B) {
+        throw std::invalid_argument("The output of gemm must not alias its operands.");
+    }
+    if (A.getContext()() != C.getContext()() || A.getQueue()() != C.getQueue()() ||
+        B.getContext()() != C.getContext()() || B.getQueue()() != C.getQueue()()) {
+        throw std::runtime_error("Cannot perform gemm on matrices from different OpenCL contexts or queues.");
+    }
+    if (m == 0 || n == 0) return;
+
+    try {
+        cl::Kernel kernel = kernels_->kernel_gemm; // Use cached kernel
+
+        kernel.setArg(0, A.getBuffer());
+        kernel.setArg(1, B.getBuffer());
+        kernel.setArg(2, C.buffer_);    // output (read-write when beta != 0)
+        kernel.setArg(3, m);
+        kernel.setArg(4, n);
+        kernel.setArg(5, k);
+        kernel.setArg(6, transA ? 1 : 0);
+        kernel.setArg(7, transB ? 1 : 0);
+        kernel.setArg(8, alpha);
+        kernel.setArg(9, beta);
+
+        C.queue_.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(m, n), cl::NullRange);
+
+    } catch (const cl::Error& err) {
+        throw std::runtime_error("OpenCL error during gemm: " + std::string(err.what()) + " (" + std::to_string(err.err()) + ")");
+    }
+}
+
+// --- Lazy transpose ---
+// transpose() only wraps the matrix: the transposed elements are read in place by gemm and
+// sub_mul_transposed, the transpose kernel only runs when a MatrixCL is built from the view.
+MatrixCLTransposed MatrixCL::transpose() const {
+    return MatrixCLTransposed(*this);
+}
+
+MatrixCL::MatrixCL(const MatrixCLTransposed& t)
+    : MatrixCL(t.numRows(), t.numCols(), t.transpose().getContext(), t.transpose().getQueue())
+{
+    t.transpose().transpose_into(*this);
+}
+
+void MatrixCL::transpose_into(MatrixCL& out) const {
+    if (out.rows_ != cols_ || out.cols_ != rows_) {
+        throw std::invalid_argument("Matrix dimensions do not match for transpose_into.");
+    }
+    if (context_() != out.context_() || queue_() != out.queue_()) {
+        throw std::runtime_error("Cannot perform transpose on matrices from different OpenCL contexts or queues.");
+    }
+    if (&out == this) {
+        throw std::invalid_argument("transpose_into cannot transpose a matrix in place.");
+    }
+    if (rows_ == 0 || cols_ == 0) return;
+
+    try {
+        cl::Kernel kernel = kernels_->kernel_transpose; // Use cached kernel
+
+        kernel.setArg(0, buffer_);
+        kernel.setArg(1, out.buffer_);
+        kernel.setArg(2, rows_);
+        kernel.setArg(3, cols_);
+
+        queue_.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(rows_, cols_), cl::NullRange);
+
+    } catch (const cl::Error& err) {
+        throw std::runtime_error("OpenCL error during transpose: " + std::string(err.what()) + " (" + std::to_string(err.err()) + ")");
+    }
+}
+
+MatrixCL MatrixCL::operator*(const MatrixCLTransposed& other) const {
+    MatrixCL result(rows_, other.numCols(), context_, queue_);
+    gemm(false, true, 1.0f, *this, other.transpose(), 0.0f, result);
+    return result;
+}
+
+MatrixCL operator*(const MatrixCLTransposed& a, const MatrixCL& b) {
+    MatrixCL result(a.numRows(), b.numCols(), b.getContext(), b.getQueue());
+    MatrixCL::gemm(true, false, 1.0f, a.transpose(), b, 0.0f, result);
+    return result;
+}
+
+MatrixCL operator*(const MatrixCLTransposed& a, const MatrixCLTransposed& b) {
+    MatrixCL result(a.numRows(), b.numCols(), b.transpose().getContext(), b.transpose().getQueue());
+    MatrixCL::gemm(true, true, 1.0f, a.transpose(), b.transpose(), 0.0f, result);
+    return result;
+}
+
+void MatrixCL::sub_mul(float scalar, const MatrixCLTransposed& other) {
+    const MatrixCL& b = other.transpose();
+    if (rows_ != other.numRows() || cols_ != other.numCols()) {
+        throw std::invalid_argument("Matrix dimensions must match for sub_mul.");
+    }
+    if (context_() != b.getContext()() || queue_() != b.getQueue()()) {
+        throw std::runtime_error("Cannot perform sub_mul on matrices from different OpenCL contexts or queues.");
+    }
+    if (&b == this) {
+        throw std::invalid_argument("sub_mul cannot read the transpose of the matrix it updates.");
+    }
+    if (rows_ == 0 || cols_ == 0) return;
+
+    try {
+        cl::Kernel kernel = kernels_->kernel_sub_mul_transposed; // Use cached kernel
+
+        kernel.setArg(0, buffer_); // modified in place
+        kernel.setArg(1, b.getBuffer());
+        kernel.setArg(2, scalar);
+        kernel.setArg(3, rows_);
+        kernel.setArg(4, cols_);
+
+        queue_.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(rows_, cols_), cl::NullRange);
+
+    } catch (const cl::Error& err) {
+        throw std::runtime_error("OpenCL error during sub_mul: " + std::string(err.what()) + " (" + std::to_string(err.err()) + ")");
+    }
+}
+
+MatrixCL& MatrixCL::operator+=(const MatrixCLTransposed& other) {
+    sub_mul(-1.0f, other);
+    return *this;
+}
+
+MatrixCL& MatrixCL::operator-=(const MatrixCLTransposed& other) {
+    sub_mul(1.0f, other);
+    return *this;
+}
+
+void MatrixCL::binary_cross_entropy_backward(const MatrixCL& predictions, const MatrixCL& targets, float scale) {
      if (rows_ != predictions.numRows() || cols_ != predictions.numCols() ||
         rows_ != targets.numRows() || cols_ != targets.numCols()) {
         throw std::invalid_argument("Matrix dimensions must match for binary_cross_entropy_backward.");
@@ -200,7 +477,7 @@ void MatrixCL::binary_cross_entropy_backward(const MatrixCL& predictions, const
      if (num_elements == 0) return;
 
     const float epsilon = 1e-8f;
-    const float inv_num_elements = 1.0f / static_cast<float>(num_elements);
+    const float grad_scale = scale / static_cast<float>(num_elements);
 
     try {
         cl::Kernel kernel = kernels_->kernel_bce_backward; // Use cached kernel
@@ -211,7 +488,7 @@ void MatrixCL::binary_cross_entropy_backward(const MatrixCL& predictions, const
         kernel.setArg(3, rows_);
         kernel.setArg(4, cols_);
         kernel.setArg(5, epsilon);
-        kernel.setArg(6, inv_num_elements);
+        kernel.setArg(6, grad_scale);
 
         size_t global_work_size = num_elements;
         queue_.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(global_work_size), cl::NullRange);
@@ -221,4 +498,150 @@ void MatrixCL::binary_cross_entropy_backward(const MatrixCL& predictions, const
     } catch (const std::runtime_error& err) {
          throw std::runtime_error("Error during binary_cross_entropy_backward: " + std::string(err.what()));
     }
-}
\ No newline at end of file
+}
+
+void MatrixCL::check_finite(MatrixCL& overflow) const {
+    if (overflow.numRows() != 1 || overflow.numCols() != 1) {
+        throw std::invalid_argument("The overflow flag of check_finite must be a 1x1 matrix.");
+    }
+    if (context_() != overflow.getContext()() || queue_() != overflow.getQueue()()) {
+        throw std::runtime_error("Cannot perform check_finite on matrices from different OpenCL contexts or queues.");
+    }
+    size_t num_elements = static_cast<size_t>(rows_) * cols_;
+    if (num_elements == 0) return;
+
+    try {
+        cl::Kernel kernel = kernels_->kernel_check_finite; // Use cached kernel
+
+        kernel.setArg(0, buffer_);
+        kernel.setArg(1, overflow.buffer_); // set to 1 on a non-finite element
+        kernel.setArg(2, rows_);
+        kernel.setArg(3, cols_);
+
+        queue_.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(num_elements), cl::NullRange);
+
+    } catch (const cl::Error& err) {
+        throw std::runtime_error("OpenCL error during check_finite: " + std::string(err.what()) + " (" + std::to_string(err.err()) + ")");
+    }
+}
+
+void MatrixCL::master_update(MatrixCL& low, float step, const MatrixCL& grads, const MatrixCL& overflow) {
+    if (rows_ != low.numRows() || cols_ != low.numCols() ||
+        rows_ != grads.numRows() || cols_ != grads.numCols()) {
+        throw std::invalid_argument("Matrix dimensions must match for master_update.");
+    }
+    if (overflow.numRows() != 1 || overflow.numCols() != 1) {
+        throw std::invalid_argument("The overflow flag of master_update must be a 1x1 matrix.");
+    }
+    if (context_() != low.getContext()() || queue_() != low.getQueue()() ||
+        context_() != grads.getContext()() || queue_() != grads.getQueue()() ||
+        context_() != overflow.getContext()() || queue_() != overflow.getQueue()()) {
+        throw std::runtime_error("Cannot perform master_update on matrices from different OpenCL contexts or queues.");
+    }
+    if (&low == this || &grads == this || &grads == &low) {
+        throw std::invalid_argument("The weights, their low part and the gradients of master_update must be distinct matrices.");
+    }
+    size_t num_elements = static_cast<size_t>(rows_) * cols_;
+    if (num_elements == 0) return;
+
+    try {
+        cl::Kernel kernel = kernels_->kernel_master_update; // Use cached kernel
+
+        kernel.setArg(0, buffer_);      // modified in place
+        kernel.setArg(1, low.buffer_);  // modified in place
+        kernel.setArg(2, grads.getBuffer());
+        kernel.setArg(3, overflow.getBuffer());
+        kernel.setArg(4, step);
+        kernel.setArg(5, rows_);
+        kernel.setArg(6, cols_);
+
+        queue_.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(num_elements), cl::NullRange);
+
+    } catch (const cl::Error& err) {
+        throw std::runtime_error("OpenCL error during master_update: " + std::string(err.what()) + " (" + std::to_string(err.err()) + ")");
+    }
+}
+
+// --- Element-wise operations into an existing buffer (no allocation, e.g. for the replay of a graph) ---
+
+void MatrixCL::add_into(const MatrixCL& other, MatrixCL& out) const {
+    if (rows_ != other.rows_ || cols_ != other.cols_ || rows_ != out.rows_ || cols_ != out.cols_) {
+        throw std::invalid_argument("Matrix dimensions must match for add_into.");
+    }
+    if (context_() != other.context_() || queue_() != other.queue_() ||
+        context_() != out.context_() || queue_() != out.queue_()) {
+        throw std::runtime_error("Cannot add matrices from different OpenCL contexts or queues.");
+    }
+    size_t num_elements = static_cast<size_t>(rows_) * cols_;
+    if (num_elements == 0) return;
+
+    try {
+        cl::Kernel kernel = kernels_->kernel_add; // Use cached kernel
+
+        kernel.setArg(0, buffer_);
+        kernel.setArg(1, other.buffer_);
+        kernel.setArg(2, out.buffer_);
+        kernel.setArg(3, rows_);
+        kernel.setArg(4, cols_);
+
+        queue_.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(num_elements), cl::NullRange);
+
+    } catch (const cl::Error& err) {
+        throw std::runtime_error("OpenCL error during add_into: " + std::string(err.what()) + " (" + std::to_string(err.err()) + ")");
+    }
+}
+
+void MatrixCL::sigmoid_into(MatrixCL& out) const {
+    if (rows_ != out.rows_ || cols_ != out.cols_) {
+        throw std::invalid_argument("Matrix dimensions must match for sigmoid_into.");
+    }
+    if (context_() != out.context_() || queue_() != out.queue_()) {
+        throw std::runtime_error("Cannot perform sigmoid on matrices from different OpenCL contexts or queues.");
+    }
+    size_t num_elements = static_cast<size_t>(rows_) * cols_;
+    if (num_elements == 0) return;
+
+    try {
+        cl::Kernel kernel = kernels_->kernel_sigmoid; // Use cached kernel
+
+        kernel.setArg(0, buffer_);
+        kernel.setArg(1, out.buffer_);
+        kernel.setArg(2, rows_);
+        kernel.setArg(3, cols_);
+
+        queue_.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(num_elements), cl::NullRange);
+
+    } catch (const cl::Error& err) {
+        throw std::runtime_error("OpenCL error during sigmoid_into: " + std::string(err.what()) + " (" + std::to_string(err.err()) + ")");
+    }
+}
+
+void MatrixCL::bce_into(const MatrixCL& targets, MatrixCL& out) const {
+    if (rows_ != targets.rows_ || cols_ != targets.cols_ || rows_ != out.rows_ || cols_ != out.cols_) {
+        throw std::invalid_argument("Matrix dimensions must match for bce_into.");
+    }
+    if (context_() != targets.context_() || queue_() != targets.queue_() ||
+        context_() != out.context_() || queue_() != out.queue_()) {
+        throw std::runtime_error("Cannot perform BCE on matrices from different OpenCL contexts or queues.");
+    }
+    size_t num_elements = static_cast<size_t>(rows_) * cols_;
+    if (num_elements == 0) return;
+
+    const float epsilon = 1e-8f;
+
+    try {
+        cl::Kernel kernel = kernels_->kernel_bce_elementwise; // Use cached kernel
+
+        kernel.setArg(0, buffer_);          // predictions
+        kernel.setArg(1, targets.buffer_);
+        kernel.setArg(2, out.buffer_);      // element-wise losses
+        kernel.setArg(3, rows_);
+        kernel.setArg(4, cols_);
+        kernel.setArg(5, epsilon);
+
+        queue_.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(num_elements), cl::NullRange);
+
+    } catch (const cl::Error& err) {
+        throw std::runtime_error("OpenCL error during bce_into: " + std::string(err.what()) + " (" + std::to_string(err.err()) + ")");
+    }
+}
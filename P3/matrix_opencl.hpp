@@ -16,6 +16,7 @@
 
 // --- Forward Declarations ---
 class MatrixCL;
+class MatrixCLTransposed;
 
 // --- Kernel Cache Structure ---
 // Holds pre-compiled OpenCL kernels for reuse.
@@ -23,12 +24,17 @@ struct KernelCache {
     cl::Kernel kernel_fill;
     cl::Kernel kernel_add;
     cl::Kernel kernel_sub_mul;
+    cl::Kernel kernel_sub_mul_transposed;
+    cl::Kernel kernel_scale;
     cl::Kernel kernel_transpose;
     cl::Kernel kernel_matrix_mul;
+    cl::Kernel kernel_gemm;
     cl::Kernel kernel_sigmoid;
     cl::Kernel kernel_sigmoid_backward;
     cl::Kernel kernel_bce_elementwise;
     cl::Kernel kernel_bce_backward;
+    cl::Kernel kernel_check_finite;
+    cl::Kernel kernel_master_update;
 
     // Flag to indicate if kernels have been compiled
     bool initialized = false;
@@ -67,12 +73,20 @@ public:
     // Copy constructor (performs device-to-device copy)
     MatrixCL(const MatrixCL& other);
 
+    // Materialises a lazy transpose (runs the transpose kernel into a new buffer)
+    MatrixCL(const MatrixCLTransposed& t);
+
     // Destructor (cl::Buffer manages its own release via RAII)
     ~MatrixCL() = default; // RAII handles buffer release
 
     // Copy assignment operator
     MatrixCL& operator=(const MatrixCL& other);
 
+    // Move constructor and move assignment (take over the device buffer, no device copy)
+    // The moved-from matrix is left empty (0x0, no buffer).
+    MatrixCL(MatrixCL&& other) noexcept;
+    MatrixCL& operator=(MatrixCL&& other) noexcept;
+
     // Getters
     int numRows() const;
     int numCols() const;
@@ -82,6 +96,8 @@ public:
 
     // Copy data from device buffer back to host in an std::vector
     std::vector<float> copyToHost() const;
+    // Overwrite the elements with rows*cols values from the host (blocking write into the existing buffer)
+    void copyFromHost(const std::vector<float>& host_data);
 
     // --- Operations (Must be implemented with OpenCL Kernels) ---
     // Fill the entire matrix with a single value
@@ -89,27 +105,87 @@ public:
 
     // Addition: C = A + B
     MatrixCL operator+(const MatrixCL& other) const;
+    // Same into the existing buffer of `out` (e.g. to replay a graph without allocating)
+    void add_into(const MatrixCL& other, MatrixCL& out) const;
     
     // Matrix multiplication: C = A * B
     MatrixCL operator*(const MatrixCL& other) const;
+    // C = A * B^T, B^T read in place by the gemm kernel
+    MatrixCL operator*(const MatrixCLTransposed& other) const;
+
+    // General matrix product (BLAS-like): C = alpha * op(A) * op(B) + beta * C, op(X) = X or X^T.
+    // Transposed operands are read in place (no transpose() buffer) and C is updated in place.
+    static void gemm(bool transA, bool transB, float alpha, const MatrixCL& A, const MatrixCL& B,
+                     float beta, MatrixCL& C);
 
-    // Transpose: returns a new Matrix that is the transpose (B = A^T)
-    MatrixCL transpose() const;
+    // Transpose: returns a lazy view of A^T (see MatrixCLTransposed below), no buffer is allocated.
+    // `MatrixCL t = a.transpose();` runs the transpose kernel into a new matrix.
+    MatrixCLTransposed transpose() const;
+    // out = this^T, into the existing buffer of `out` (which must not be 'this')
+    void transpose_into(MatrixCL& out) const;
 
     // Subtract the product of a scalar and a given matrix: "this = this - scalar * other"
     // Performs the operation in-place on 'this' matrix's buffer.
     void sub_mul(float scalar, const MatrixCL& other);
+    // Same with a transposed matrix, read with swapped indices (e.g. `grads += dy.transpose();`)
+    void sub_mul(float scalar, const MatrixCLTransposed& other);
+
+    // In-place operations on 'this' matrix's buffer (no new buffer is allocated).
+    MatrixCL& operator+=(const MatrixCL& other);
+    MatrixCL& operator-=(const MatrixCL& other);
+    MatrixCL& operator+=(const MatrixCLTransposed& other);
+    MatrixCL& operator-=(const MatrixCLTransposed& other);
+    MatrixCL& operator*=(float scalar);
+    // this = this + alpha * other
+    void axpy(float alpha, const MatrixCL& other);
 
     // Applies sigmoid element-wise: Returns a matrix containing sigmoid(this)
     MatrixCL sigmoid() const;
+    // Same into the existing buffer of `out` (which may be 'this')
+    void sigmoid_into(MatrixCL& out) const;
     // Calculates gradient for sigmoid and adds it to 'this' matrix (gradient accumulator).
     void sigmoid_backward(const MatrixCL& input_values, const MatrixCL& output_gradient);
 
     // Calculates Binary Cross-Entropy Loss between the entries of 'this' matrix and the target matrix element-wise. Returns a MatrixCL containing the losses.
     MatrixCL binary_cross_entropy(const MatrixCL& targets) const;
+    // Same into the existing buffer of `out`
+    void bce_into(const MatrixCL& targets, MatrixCL& out) const;
     // Calculates the gradient of BCE w.r.t predictions and adds it to 'this' matrix. Note: divides the gradient by the number of elements.
-    void binary_cross_entropy_backward(const MatrixCL& predictions, const MatrixCL& targets);
+    // `scale` multiplies the gradient before it is added (e.g. the loss scale of mixed-precision training), in the same kernel.
+    void binary_cross_entropy_backward(const MatrixCL& predictions, const MatrixCL& targets, float scale = 1.0f);
+
+    // --- Master weights of mixed-precision training (see MixedPrecision in mlp_sgd.cpp) ---
+    // Sets the 1x1 `overflow` flag to 1 if an element of 'this' matrix is inf or NaN (it is left unchanged otherwise).
+    void check_finite(MatrixCL& overflow) const;
+    // this + low = this + low - step * grads, unless `overflow` is set: the master weights are the unevaluated
+    // sum of two floats, 'this' (the weights themselves, rounded) and `low` (its rounding error), so that the
+    // updates smaller than the precision of float still accumulate. In one kernel, without reading `overflow` back.
+    void master_update(MatrixCL& low, float step, const MatrixCL& grads, const MatrixCL& overflow);
 };
 
+// --- Lazy transpose ---
+// A^T as a reference to A, returned by MatrixCL::transpose(): no device buffer and no kernel.
+// Products pass it to the gemm kernel as a transposed operand (transA / transB) and the in-place
+// updates (+=, -=, sub_mul) read it with swapped indices, so only the code that needs a
+// transposed matrix of its own (`MatrixCL t = a.transpose();`) pays for the copy.
+// It must not outlive the matrix it refers to.
+class MatrixCLTransposed
+{
+private:
+    const MatrixCL& matrix_;
+
+public:
+    explicit MatrixCLTransposed(const MatrixCL& matrix) : matrix_(matrix) {}
+
+    int numRows() const { return matrix_.numCols(); }
+    int numCols() const { return matrix_.numRows(); }
+    // The matrix that is transposed: (A^T)^T = A
+    const MatrixCL& transpose() const { return matrix_; }
+};
+
+// C = A^T * B and C = A^T * B^T, through the gemm kernel
+MatrixCL operator*(const MatrixCLTransposed& a, const MatrixCL& b);
+MatrixCL operator*(const MatrixCLTransposed& a, const MatrixCLTransposed& b);
+
 
 #endif // MATRIX_OPENCL_HPP
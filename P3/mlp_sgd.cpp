@@ -2,9 +2,9 @@
 #include <memory>
 #include <vector>
 #include <random>
-#include <functional>
 #include <cmath>
 #include <stdexcept>
+#include <utility>
 
 
 #include "globals.hpp"
@@ -17,8 +17,11 @@ public: // We made it public for simplicity.
     int rows, cols;
     std::shared_ptr<MatrixCL> values;
     std::shared_ptr<MatrixCL> grads;
-    std::function<void()> backward_op;
+    InlineFunction backward_op;
     std::vector<Node *> dependencies;
+    // State of the last backward pass that reached this node (see backward)
+    unsigned backward_pass = 0;
+    int pending_consumers = 0;
 
     // Keep track of the context and queue needed by MatrixCL
     cl::Context context_;
@@ -44,6 +47,16 @@ public:
         this->grads->fill(0.0f); // Initialize gradients to zero
     }
 
+    // Constructor from a temporary MatrixCL (takes over its buffer, no device copy)
+    Node(MatrixCL &&initial_values)
+        : rows(initial_values.numRows()), cols(initial_values.numCols()),
+          context_(initial_values.getContext()), queue_(initial_values.getQueue())
+    {
+        this->values = std::make_shared<MatrixCL>(std::move(initial_values)); // Move constructor
+        this->grads = std::make_shared<MatrixCL>(rows, cols, context_, queue_);
+        this->grads->fill(0.0f); // Initialize gradients to zero
+    }
+
     // Copy constructor
     Node(const Node &other) : rows(other.rows), cols(other.cols),
                               values(other.values), grads(other.grads),
@@ -64,8 +77,12 @@ public:
         }
         // Perform multiplication using MatrixCL's operator*
         MatrixCL result_values = (*(this->values)) * (*other.values);
-        Node *result = new Node(result_values);
+        Node *result = new Node(std::move(result_values));
         push_node(result);
+        record_forward([a = values.get(), b = other.values.get(), c = result->values.get()]()
+        {
+            MatrixCL::gemm(false, false, 1.0f, *a, *b, 0.0f, *c);
+        });
 
         // Store shared pointers needed for backward pass
         auto this_values = this->values;
@@ -80,13 +97,11 @@ public:
         // Backward operation for multiplication
         result->backward_op = [this_values, this_grads, other_values, other_grads, result_grads]() mutable
         {
-            // dL/dA = dL/dC * B^T
-            MatrixCL grad_a_update = (*result_grads) * other_values->transpose();
-            *this_grads = *this_grads + grad_a_update;
+            // dL/dA += dL/dC * B^T, accumulated in place without transposing B
+            MatrixCL::gemm(false, true, 1.0f, *result_grads, *other_values, 1.0f, *this_grads);
 
-            // dL/dB = A^T * dL/dC
-            MatrixCL grad_b_update = this_values->transpose() * (*result_grads);
-            *other_grads = *other_grads + grad_b_update;
+            // dL/dB += A^T * dL/dC
+            MatrixCL::gemm(true, false, 1.0f, *this_values, *result_grads, 1.0f, *other_grads);
         };
 
         return result;
@@ -99,8 +114,12 @@ public:
             throw std::invalid_argument("Matrix dimensions do not match for addition");
         }
         MatrixCL result_values = (*(this->values)) + (*other.values);
-        Node *result = new Node(result_values);
+        Node *result = new Node(std::move(result_values));
         push_node(result);
+        record_forward([a = values.get(), b = other.values.get(), c = result->values.get()]()
+        {
+            a->add_into(*b, *c);
+        });
 
         auto this_grads = this->grads;
         auto other_grads = other.grads;
@@ -113,9 +132,9 @@ public:
         result->backward_op = [this_grads, other_grads, result_grads]() mutable
         {
             // dL/dA = dL/dC * 1 = dL/dC
-            *this_grads = *this_grads + *result_grads;
+            *this_grads += *result_grads;
             // dL/dB = dL/dC * 1 = dL/dC
-            *other_grads = *other_grads + *result_grads;
+            *other_grads += *result_grads;
         };
 
         return result;
@@ -126,8 +145,12 @@ public:
     {
         // Apply sigmoid using MatrixCL method
         MatrixCL result_values = this->values->sigmoid();
-        Node *result = new Node(result_values);
+        Node *result = new Node(std::move(result_values));
         push_node(result);
+        record_forward([a = values.get(), c = result->values.get()]()
+        {
+            a->sigmoid_into(*c);
+        });
 
         result->dependencies.push_back(this);
 
@@ -148,8 +171,12 @@ public:
     Node *transpose()
     {
         MatrixCL result_values = this->values->transpose();
-        Node *result = new Node(result_values);
+        Node *result = new Node(std::move(result_values));
         push_node(result);
+        record_forward([a = values.get(), c = result->values.get()]()
+        {
+            a->transpose_into(*c);
+        });
 
         auto this_grads = this->grads;
         auto result_grads = result->grads;
@@ -159,24 +186,55 @@ public:
         // Backward operation for transpose
         result->backward_op = [this_grads, result_grads]() mutable
         {
-            *this_grads = *this_grads + result_grads->transpose();
+            *this_grads += result_grads->transpose();
         };
 
         return result;
     }
 
-    // Recursive backward pass trigger
+    // Backward pass trigger, as a reverse topological sweep: a first pass counts the consumers
+    // of every node reachable from this one (one per use, so `x * x` counts twice), then a node
+    // runs its backward_op once all of them have run theirs. Each backward_op runs exactly once,
+    // however many paths lead to its node, so the cost is linear in the size of the graph.
     void backward()
     {
-        // Execute the operation's specific backward step
-        if (backward_op)
+        static unsigned passes = 0;
+        const unsigned pass = ++passes;
+        std::vector<Node *> stack{this};
+        backward_pass = pass;
+        pending_consumers = 0;
+        while (!stack.empty())
         {
-            backward_op();
+            Node *node = stack.back();
+            stack.pop_back();
+            for (Node *dep : node->dependencies)
+            {
+                if (!dep) // Basic null check
+                    continue;
+                if (dep->backward_pass != pass)
+                {
+                    dep->backward_pass = pass;
+                    dep->pending_consumers = 0;
+                    stack.push_back(dep);
+                }
+                ++dep->pending_consumers;
+            }
         }
-        for (Node *dep : dependencies)
+
+        stack.push_back(this);
+        while (!stack.empty())
         {
-            if (dep) { // Basic null check
-                 dep->backward();
+            Node *node = stack.back();
+            stack.pop_back();
+            // Execute the operation's specific backward step
+            if (node->backward_op)
+            {
+                node->backward_op();
+            }
+            for (Node *dep : node->dependencies)
+            {
+                if (dep && --dep->pending_consumers == 0)
+                    stack.push_back(dep);
             }
         }
     }
@@ -243,7 +301,9 @@ public:
 
 // --- Loss Function using MatrixCL ---
 
-inline Node *binary_cross_entropy(Node &predictions, Node &targets)
+// `*loss_scale` multiplies the gradient sent back to the predictions (loss scaling of mixed-precision
+// training, 1 without it). It is read by each backward pass, so a captured graph follows a dynamic scale.
+inline Node *binary_cross_entropy(Node &predictions, Node &targets, const float *loss_scale = nullptr)
 {
     if (predictions.rows != targets.rows || predictions.cols != targets.cols)
     {
@@ -258,8 +318,12 @@ inline Node *binary_cross_entropy(Node &predictions, Node &targets)
     MatrixCL loss_value_matrix = predictions.values->binary_cross_entropy(*targets.values);
 
     // Create a Node to hold the loss value.
-    Node *loss_node = new Node(loss_value_matrix);
+    Node *loss_node = new Node(std::move(loss_value_matrix));
     push_node(loss_node); // Manage node lifecycle
+    record_forward([p = predictions.values.get(), t = targets.values.get(), l = loss_node->values.get()]()
+    {
+        p->bce_into(*t, *l);
+    });
 
     loss_node->dependencies.push_back(&predictions);
     // Targets are constants in this context, typically no dependency added.
@@ -271,9 +335,10 @@ inline Node *binary_cross_entropy(Node &predictions, Node &targets)
     auto loss_grads = loss_node->grads; // Gradient *of* the loss node (dL/dL), assumed to be 1 here.
 
     // Set up backward operation using MatrixCL's bce_backward
-    loss_node->backward_op = [pred_values, pred_grads, target_values, loss_grads]() mutable
+    loss_node->backward_op = [pred_values, pred_grads, target_values, loss_grads, loss_scale]() mutable
     {
-        pred_grads->binary_cross_entropy_backward(*pred_values, *target_values); // Note does not use loss grads, directly backward from the prediction and targets
+        // Note does not use loss grads, directly backward from the prediction and targets (scaled by loss_scale in the same pass)
+        pred_grads->binary_cross_entropy_backward(*pred_values, *target_values, loss_scale ? *loss_scale : 1.0f);
     };
 
     return loss_node;
@@ -289,6 +354,27 @@ struct Dataset
     {}
 };
 
+// --- Mixed-precision training (see MLP::train) ---
+// The device computes in float; with `master_weights`, each weight matrix also gets a device buffer
+// of the rounding error of its float values (see MatrixCL::master_update): the pair holds the
+// weights to about twice the precision of float, so updates smaller than the precision of float
+// still accumulate, and the update runs in a kernel, without copying the weights or the gradients.
+// The loss scale multiplies the gradient of the loss and divides the weight gradients before the
+// update, so that tiny gradients are not lost in float. With `master_weights`, a step whose
+// gradients overflow (inf or NaN) is skipped on the device and only that flag is read back: with
+// `dynamic_loss_scale` it halves the scale, which doubles again after LOSS_SCALE_GROWTH_INTERVAL
+// good steps, with a static scale it is an error (std::runtime_error, the scale is too large).
+// `dynamic_loss_scale` thus needs `master_weights` (std::invalid_argument otherwise). The graph
+// is captured whatever the scale (see setGraphCapture), its backward pass reads the current one.
+struct MixedPrecision
+{
+    bool master_weights = false;
+    float loss_scale = 1.0f;
+    bool dynamic_loss_scale = false;
+};
+
+const int LOSS_SCALE_GROWTH_INTERVAL = 1000;
+
 // --- MLP Implementation using MatrixCL ---
 class MLP
 {
@@ -297,6 +383,7 @@ private:
     float learning_rate; // Use float
     cl::Context context_; // Store context
     cl::CommandQueue queue_; // Store queue
+    bool capture_graph = true; // see setGraphCapture
 
 public:
     // Constructor requires OpenCL context and queue
@@ -360,31 +447,86 @@ public:
         return output;
     }
 
-    // Training loop
-    void train(const Dataset &data, int epochs)
+    // By default, the graph built by the first epoch is kept (see Tape in globals.hpp) and
+    // replayed by the next ones on the same batch, instead of making its nodes and device
+    // buffers again every epoch. The result is the same, this only turns it off (e.g. to compare).
+    void setGraphCapture(bool enabled)
+    {
+        capture_graph = enabled;
+    }
+
+    // Training loop (see MixedPrecision for `precision`)
+    void train(const Dataset &data, int epochs, const MixedPrecision &precision = MixedPrecision())
     {
+        if (precision.dynamic_loss_scale && !precision.master_weights)
+        {
+            throw std::invalid_argument("The dynamic loss scale needs master_weights (the overflow check is part of their update)");
+        }
         std::cout << "Starting training for " << epochs << " epochs..." << std::endl;
 
+        Node *weights[] = {&W1, &W2};
+        // Low parts of the master weights (zero: the weights are exactly their float values)
+        // and overflow flag of the gradients, on the device
+        std::vector<MatrixCL> low;
+        MatrixCL overflow(1, 1, context_, queue_);
+        if (precision.master_weights)
+        {
+            for (Node *node : weights)
+            {
+                low.emplace_back(node->rows, node->cols, context_, queue_);
+                low.back().fill(0.0f);
+            }
+        }
+        float scale = precision.loss_scale;
+        int steps_without_overflow = 0;
+
+        Tape tape;
+        Node input = Node(data.X);
+        Node target = Node(data.Y);
+        Node *loss_node = nullptr;
+
         for (int epoch = 0; epoch < epochs; ++epoch)
         {
-            // Get current batch
-            Node input = Node(data.X);
-            Node target = Node(data.Y);
+            if (!tape.empty())
+            {
+                // --- Forward and Backward Passes of the captured graph ---
+                tape.forward();
+                tape.backward();
+            }
+            else
+            {
+                if (capture_graph)
+                {
+                    tape.begin();
+                }
+
+                // --- Forward Pass ---
+                Node *output = forward(input);
 
-            // --- Forward Pass ---
-            Node *output = forward(input);
+                // --- Compute Loss ---
+                loss_node = binary_cross_entropy(*output, target, &scale);
 
-            // --- Compute Loss ---
-            Node *loss_node = binary_cross_entropy(*output, target);
+                if (capture_graph)
+                {
+                    tape.end();
+                }
 
-            // --- Backward Pass ---
-            // Trigger backpropagation starting from the loss node
-            loss_node->backward();
+                // --- Backward Pass ---
+                // Trigger backpropagation starting from the loss node
+                loss_node->backward();
+            }
 
             // --- Update Weights and Biases ---
-            // Use MatrixCL's sub_mul for update: W = W - lr * grad(W)
-            W2.values->sub_mul(learning_rate, *W2.grads);
-            W1.values->sub_mul(learning_rate, *W1.grads);
+            if (precision.master_weights)
+            {
+                update_master_weights(weights, low.data(), overflow, scale, steps_without_overflow, precision.dynamic_loss_scale);
+            }
+            else
+            {
+                // Use MatrixCL's sub_mul for update: W = W - lr * grad(W)
+                W2.values->sub_mul(learning_rate / scale, *W2.grads);
+                W1.values->sub_mul(learning_rate / scale, *W1.grads);
+            }
 
             // --- Reset Gradients for Next Iteration ---
             W1.zero_grad();
@@ -413,10 +555,46 @@ public:
             }
 
 
-            // --- Clean up compute graph nodes ---
+            // --- Clean up compute graph nodes (those of the tape are kept) ---
             clear_nodes();
 
         } // End epoch loop
         std::cout << "Training finished." << std::endl;
     }
-};
\ No newline at end of file
+
+private:
+    // W = W - lr * grad(W) / scale on the master weights (W, low), on the device, unless a
+    // gradient is not finite; the overflow flag is the only value read back, for the loss scale.
+    void update_master_weights(Node *weights[2], MatrixCL low[2], MatrixCL &overflow, float &scale,
+                               int &steps_without_overflow, bool dynamic_loss_scale)
+    {
+        overflow.fill(0.0f);
+        for (int k = 0; k < 2; ++k)
+        {
+            weights[k]->grads->check_finite(overflow);
+        }
+        const float step = learning_rate / scale;
+        for (int k = 0; k < 2; ++k)
+        {
+            weights[k]->values->master_update(low[k], step, *weights[k]->grads, overflow);
+        }
+        const bool finite = overflow.copyToHost()[0] == 0.0f;
+        if (!finite && !dynamic_loss_scale)
+        {
+            throw std::runtime_error("Non-finite gradients with a static loss scale: lower it or enable dynamic_loss_scale");
+        }
+        if (dynamic_loss_scale)
+        {
+            if (!finite)
+            {
+                scale /= 2;
+                steps_without_overflow = 0;
+            }
+            else if (++steps_without_overflow == LOSS_SCALE_GROWTH_INTERVAL)
+            {
+                scale *= 2;
+                steps_without_overflow = 0;
+            }
+        }
+    }
+};